@@ -6,116 +6,297 @@
 #include <cstdio>
 #include <iterator>
 #include <memory>
+#include <memory_resource>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "api_registry.hpp"
 #include "constants.hpp"
 #include "datamap.hpp"
+#include "partition_table.hpp"
 #include "primitive.hpp"
 #include "request_message.hpp"
 #include "response_message.hpp"
 
+// Responses may be reused from the previous request on the connection:
+// elements are resized into place rather than rebuilt, so every field a
+// handler sends has to be set here, not left to the constructor.
+
+static void reset_k1_partition(res_k1_partition& p, sint32 partition,
+                               int16_t error_code) {
+  p.partition_index = partition;
+  p.error_code.val = error_code;
+  p.high_watermark.val = 0;
+  p.last_stable_offset.val = 0;
+  p.log_start_offset.val = 0;
+  p.aborted_transaction.is_null = true;
+  msg_resize(p.aborted_transaction.val, 0);
+  p.preferred_read_replica.val = 0;
+  p.records.is_null = false;
+  msg_resize(p.records.val, 0);
+}
+
 void api_fetch_k1_v16(request_k1_v16* req, response_k1_v16* res) {
-  res->responses.val.clear();
-  if (req->header->request_api_version.val < API_VERSION_MIN_1 ||
-      req->header->request_api_version.val > API_VERSION_MAX_1) {
-    res->responses.is_null = false;
-    for (k1_topic& topic : req->topics.val) {
-      k1_reponse& rep = res->responses.val.emplace_back();
-      rep.topic_id = topic.topic_id;
-      rep.partitions.is_null = false;
-      for (k1_partition& part : topic.partitions.val) {
-        res_k1_partition& p = rep.partitions.val.emplace_back();
-        p.partition_index = part.partition;
-        p.error_code.val = ERR_UNSUPPORTED_VERSION;
-      }
-    }
-  } else {
-    // read_log(topic_uuid_to_partitions, topic_name_to_uuid, log_fn);
-    res->responses.is_null = false;
-    for (k1_topic& topic : req->topics.val) {
-      k1_reponse& rep = res->responses.val.emplace_back();
-      rep.topic_id = topic.topic_id;
-
-      bool unkown_topic = topic_uuid_to_partitions.find(topic.topic_id.str()) ==
-                          topic_uuid_to_partitions.end();
-
-      rep.partitions.is_null = false;
-      for (k1_partition& part : topic.partitions.val) {
-        res_k1_partition& p = rep.partitions.val.emplace_back();
-        p.partition_index = part.partition;
-        p.records.is_null = false;
-        if (unkown_topic) {
-          p.error_code.val = ERR_UNKNOWN_TOPIC;
-        } else {
-          p.records = topic_uuid_to_partition_to_records[topic.topic_id.str()]
-                                                        [p.partition_index.val];
-        }
-      }
+  bool unsupported = !api_version_supported(
+      *find_api(1), req->header->request_api_version.val);
+  res->responses.is_null = false;
+  msg_resize(res->responses.val, req->topics.val.size());
+  // this version for the whole request, whatever is published meanwhile
+  std::shared_ptr<metadata_image const> m = current_metadata();
+  for (size_t i = 0; i < req->topics.val.size(); ++i) {
+    k1_topic& topic = req->topics.val[i];
+    k1_response& rep = res->responses.val[i];
+    rep.topic_id = topic.topic_id;
+    rep.partitions.is_null = false;
+    msg_resize(rep.partitions.val, topic.partitions.val.size());
+
+    partition_table const& table = m->partitions;
+    uint32_t t = table.find_topic(topic.topic_id.id());
+    bool unknown_topic =
+        t == partition_table::NONE || table.partitions(t).empty();
+
+    for (size_t j = 0; j < topic.partitions.val.size(); ++j) {
+      res_k1_partition& p = rep.partitions.val[j];
+      int16_t error_code = unsupported     ? ERR_UNSUPPORTED_VERSION
+                           : unknown_topic ? ERR_UNKNOWN_TOPIC_ID
+                                           : 0;
+      reset_k1_partition(p, topic.partitions.val[j].partition, error_code);
+      if (error_code != 0) continue;
+      uint32_t slot = table.find_partition(t, p.partition_index.val);
+      if (slot == partition_table::NONE) continue;
+      auto const* records = table.find_records(slot);
+      if (records) p.records = **records;
     }
   }
   res->throttle_time_ms.val = 0;
+  res->error_code.val = 0;
   res->session_id = req->session_id;
 }
 
 void api_api_version_k18_v4(request_k18_v4* req, response_k18_v4* res) {
-  if (req->header->request_api_version.val < API_VERSION_MIN_18 ||
-      req->header->request_api_version.val > API_VERSION_MAX_18) {
+  if (!api_version_supported(*find_api(18),
+                             req->header->request_api_version.val)) {
     res->error_code = sint16(ERR_UNSUPPORTED_VERSION);
+    res->throttle_time_ms = sint32(0);
   } else {
     res->error_code = sint16(0);
-    res->version_infos = scarray<version_info>(std::vector<version_info>{
-        version_info(18, API_VERSION_MIN_18, API_VERSION_MAX_18),
-        version_info(75, API_VERSION_MIN_75, API_VERSION_MAX_75),
-        version_info(1, API_VERSION_MIN_1, API_VERSION_MAX_1),
-    });
+    // what the registry serves, nothing more
+    res->version_infos.is_null = false;
+    msg_resize(res->version_infos.val, 0);
+    for (api_entry const& api : api_entries()) {
+      res->version_infos.val.emplace_back(api.api_key, api.min_version,
+                                          api.max_version);
+    }
     res->throttle_time_ms = sint32(0);
     res->tagged_buffer = stagged_fields();
   }
 }
 
+// a topic of the request that is not described
+static void error_topic(res_topic_info& r, std::string_view name,
+                        int16_t error_code) {
+  r.encoded = {};
+  r.error_code.val = error_code;
+  r.name.is_null = false;
+  r.name.val.assign(name);
+  r.topic_id = suuid(uuid128{});
+  r.is_internal.val = false;
+  r.partitions.is_null = false;
+  msg_resize(r.partitions.val, 0);
+  r.encoded_partitions.is_set = false;
+  r.topic_authorized_operations.val = 0;
+}
+
+// count partitions of a known topic from the first-th on in index order; the
+// whole topic is encoded once for every request asking for it
+static void describe_topic(res_topic_info& r, partition_table const& table,
+                           uint32_t t, size_t first, size_t count) {
+  std::span<uint32_t const> slots = table.partitions(t);
+  if (first == 0 && count == slots.size()) {
+    r.encoded = table.encoded_topic(t);
+    return;
+  }
+  r.encoded = {};
+  r.error_code.val = 0;
+  r.name.is_null = false;
+  r.name.val.assign(table.topic_name(t));
+  r.topic_id = suuid(table.topic_id[t]);
+  r.is_internal.val = false;
+  r.partitions.is_null = false;
+  msg_resize(r.partitions.val, 0);
+  r.encoded_partitions.is_set = true;
+  msg_resize(r.encoded_partitions.pieces, count);
+  for (size_t j = 0; j < count; ++j) {
+    r.encoded_partitions.pieces[j] = table.encoded_partition(t, first + j);
+  }
+  r.topic_authorized_operations.val = 0;
+}
+
 void api_describe_topic_partitions(request_k75_v0* req, response_k75_v0* res) {
-  if (req->header->request_api_version.val < API_VERSION_MIN_75 ||
-      req->header->request_api_version.val > API_VERSION_MAX_75) {
-    std::vector<res_topic_info> topics;
-    for (req_topic_info& req_topic : req->topics.val) {
-      topics.emplace_back();
-      res_topic_info& res_topic = topics.back();
-      res_topic.error_code.val = ERR_UNSUPPORTED_VERSION;
-      res_topic.name = scnstring(req_topic.name.val);
+  bool unsupported = !api_version_supported(
+      *find_api(75), req->header->request_api_version.val);
+  res->throttle_time_ms.val = 0;
+  res->topics.is_null = false;
+  res->next_cursor.is_null = true;
+  std::shared_ptr<metadata_image const> m = current_metadata();
+  partition_table const& table = m->partitions;
+  res->keep_alive = m;
+
+  // topics are appended as they are described, into elements kept from the
+  // previous response where there are some
+  size_t described{};
+  auto next_topic = [&]() -> res_topic_info& {
+    if (described == res->topics.val.size()) {
+      msg_emplace_back(res->topics.val);
+    }
+    return res->topics.val[described++];
+  };
+
+  if (unsupported) {
+    for (req_topic_info const& t : req->topics.val) {
+      error_topic(next_topic(), t.name.val, ERR_UNSUPPORTED_VERSION);
+    }
+    msg_resize(res->topics.val, described);
+    return;
+  }
+
+  // topics go in name order from the cursor on, and partitions up to the
+  // limit; the next cursor is where the following page starts
+  std::string_view cursor_name;
+  int32_t cursor_partition{};
+  if (!req->cursor.is_null) {
+    cursor_name = req->cursor.topic_name.val;
+    cursor_partition = std::max(req->cursor.partition_index.val, 0);
+  }
+  int32_t limit = req->response_partition_limit.val;
+  if (limit <= 0 || limit > DESCRIBE_TOPIC_PARTITIONS_LIMIT) {
+    limit = DESCRIBE_TOPIC_PARTITIONS_LIMIT;
+  }
+  size_t remaining = limit;
+  auto stop_at = [&](std::string_view name, size_t partition) {
+    res->next_cursor.is_null = false;
+    res->next_cursor.topic_name.val.assign(name);
+    res->next_cursor.partition_index.val = partition;
+  };
+  // false once the page is full
+  auto describe = [&](std::string_view name, uint32_t t) {
+    if (remaining == 0) {
+      stop_at(name, 0);
+      return false;
+    }
+    if (t == partition_table::NONE) {
+      error_topic(next_topic(), name, ERR_UNKNOWN_TOPIC_OR_PARTITION);
+      return true;
+    }
+    size_t total = table.partitions(t).size();
+    size_t first =
+        name == cursor_name ? std::min<size_t>(cursor_partition, total) : 0;
+    size_t count = std::min(total - first, remaining);
+    describe_topic(next_topic(), table, t, first, count);
+    if (first + count < total) {
+      stop_at(name, first + count);
+      return false;
+    }
+    remaining -= count;
+    return true;
+  };
+
+  if (req->topics.val.empty()) {
+    // all of them
+    for (uint32_t t : table.topics_from(cursor_name)) {
+      if (!describe(table.topic_name(t), t)) break;
     }
-    res->topics.val = std::move(topics);
-    res->topics.is_null = false;
-    res->next_cursor.is_null = true;
   } else {
-    // read_log(topic_uuid_to_partitions, topic_name_to_uuid, log_fn);
-    std::vector<res_topic_info> topics;
-    for (req_topic_info& req_topic : req->topics.val) {
-      topics.emplace_back();
-      res_topic_info& res_topic = topics.back();
-      res_topic.name = scnstring(req_topic.name.val);
-      if (topic_name_to_uuid.find(res_topic.name.val) ==
-          topic_name_to_uuid.end()) {
-        res_topic.error_code = sint16(ERR_UNKNOWN_TOPIC_OR_PARTITION);
-        res_topic.partitions.is_null = false;
+    std::pmr::vector<std::string_view> names(msg_resource());
+    for (req_topic_info const& t : req->topics.val) {
+      if (t.name.val >= cursor_name) names.push_back(t.name.val);
+    }
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    for (std::string_view name : names) {
+      if (!describe(name, table.find_topic(name))) break;
+    }
+  }
+  msg_resize(res->topics.val, described);
+}
+
+// a requested topic that is not there: by name before v10, or by id
+static void missing_k3_topic(res_k3_topic& r, req_k3_topic const& t,
+                             int16_t error_code) {
+  r.encoded = {};
+  r.error_code.val = error_code;
+  r.name.is_null = t.name.is_null;
+  r.name.val.assign(t.name.val);
+  r.topic_id = t.topic_id;
+  r.is_internal.val = false;
+  r.partitions.is_null = false;
+  msg_resize(r.partitions.val, 0);
+}
+
+void api_metadata_k3(request_k3* req, response_k3* res) {
+  int16_t version = req->version();
+  api_entry const& api = *find_api(3);
+  bool unsupported = !api_version_supported(api, version);
+  res->version = unsupported ? api.max_version : version;
+  res->throttle_time_ms.val = 0;
+  res->brokers.is_null = false;
+  msg_resize(res->brokers.val, 1);
+  res_k3_broker& broker = res->brokers.val[0];
+  broker.node_id.val = BROKER_NODE_ID;
+  broker.host.val.assign(BROKER_HOST);
+  broker.port.val = BROKER_PORT;
+  broker.rack.is_null = true;
+  broker.rack.val.clear();
+  res->cluster_id.is_null = true;
+  res->cluster_id.val.clear();
+  res->controller_id.val = BROKER_NODE_ID;
+  res->cluster_authorized_operations.val =
+      !unsupported && req->include_cluster_authorized_operations.val
+          ? CLUSTER_AUTHORIZED_OPERATIONS
+          : AUTHORIZED_OPERATIONS_OMITTED;
+  res->topics.is_null = false;
+  if (unsupported) {
+    msg_resize(res->topics.val, 0);
+    return;
+  }
+  std::shared_ptr<metadata_image const> m = current_metadata();
+  partition_table const& table = m->partitions;
+  res->keep_alive = m;
+
+  int32_t operations = req->include_topic_authorized_operations.val
+                           ? TOPIC_AUTHORIZED_OPERATIONS
+                           : AUTHORIZED_OPERATIONS_OMITTED;
+  auto found = [&](res_k3_topic& r, uint32_t t) {
+    partition_table::topic_bytes const& bytes = table.metadata_topic(t);
+    r.encoded = bytes.metadata;
+    r.encoded_id_at = bytes.metadata_id_at;
+  };
+  if (req->topics.is_null) {
+    std::span<uint32_t const> all = table.topics_from("");
+    msg_resize(res->topics.val, all.size());
+    for (size_t i = 0; i < all.size(); ++i) found(res->topics.val[i], all[i]);
+  } else {
+    msg_resize(res->topics.val, req->topics.val.size());
+    for (size_t i = 0; i < req->topics.val.size(); ++i) {
+      req_k3_topic const& want = req->topics.val[i];
+      res_k3_topic& r = res->topics.val[i];
+      uint32_t t = want.name.is_null ? table.find_topic(want.topic_id.id())
+                                     : table.find_topic(want.name.val);
+      if (t != partition_table::NONE && table.topic_named[t]) {
+        found(r, t);
       } else {
-        std::string topic_uuid = topic_name_to_uuid[res_topic.name.val];
-        res_topic.topic_id = suuid(topic_uuid);
-        res_topic.partitions.is_null = false;
-        std::vector<std::shared_ptr<res_partition>>& p =
-            topic_uuid_to_partitions[topic_uuid];
-        std::transform(p.begin(), p.end(),
-                       std::back_inserter(res_topic.partitions.val),
-                       [](std::shared_ptr<res_partition> prp) {
-                         return res_partition(*prp);
-                       });
+        missing_k3_topic(r, want,
+                         want.name.is_null ? ERR_UNKNOWN_TOPIC_ID
+                                           : ERR_UNKNOWN_TOPIC_OR_PARTITION);
       }
     }
-
-    res->topics.val = std::move(topics);
-    res->topics.is_null = false;
-    res->next_cursor.is_null = true;
+  }
+  for (res_k3_topic& r : res->topics.val) {
+    r.topic_authorized_operations.val = operations;
+    r.tagged_fields.fields.clear();
   }
 }
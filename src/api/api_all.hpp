@@ -8,4 +8,5 @@
 void api_fetch_k1_v16(request_k1_v16* req, response_k1_v16* res);
 void api_api_version_k18_v4(request_k18_v4* req, response_k18_v4* res);
 void api_describe_topic_partitions(request_k75_v0* req, response_k75_v0* res);
+void api_metadata_k3(request_k3* req, response_k3* res);
 #endif
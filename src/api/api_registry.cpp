@@ -0,0 +1,89 @@
+#include "api_registry.hpp"
+
+#include <array>
+#include <cstdint>
+#include <span>
+
+#include "api_all.hpp"
+#include "constants.hpp"
+#include "primitive.hpp"
+#include "response_cache.hpp"
+#include "response_message.hpp"
+
+namespace {
+
+api_entry const APIS[] = {
+    {1, API_VERSION_MIN_1, API_VERSION_MAX_1, 1,
+     [](message_pool& msgs, int8_t* in) {
+       return msgs.fetch_req.deserialize(in);
+     },
+     [](message_pool& msgs, chunk_writer& out) {
+       api_fetch_k1_v16(&msgs.fetch_req, &msgs.fetch_res);
+       return stream_message(out, &msgs.fetch_res);
+     }},
+    {3, API_VERSION_MIN_3, API_VERSION_MAX_3, 1,
+     [](message_pool& msgs, int8_t* in) {
+       // before v9 neither the request nor its answer is in the flexible
+       // encoding served here; as Kafka does with a request it cannot
+       // parse, the connection is closed rather than sent a frame the client
+       // can't read
+       if (msgs.req_header.request_api_version.val < find_api(3)->min_version)
+         throw decode_error("Metadata request before v9");
+       return msgs.metadata_req.deserialize(in);
+     },
+     [](message_pool& msgs, chunk_writer& out) {
+       api_metadata_k3(&msgs.metadata_req, &msgs.metadata_res);
+       int32_t sz = stream_message(out, &msgs.metadata_res);
+       // copied out, the metadata version may go
+       msgs.metadata_res.keep_alive.reset();
+       return sz;
+     }},
+    {18, API_VERSION_MIN_18, API_VERSION_MAX_18, 0,
+     // the answer only depends on this table, see response_cache.hpp
+     [](message_pool&, int8_t*) { return 0; },
+     [](message_pool& msgs, chunk_writer& out) {
+       return write_api_versions_k18(out, msgs.req_header);
+     }},
+    {75, API_VERSION_MIN_75, API_VERSION_MAX_75, 1,
+     [](message_pool& msgs, int8_t* in) {
+       return msgs.describe_req.deserialize(in);
+     },
+     [](message_pool& msgs, chunk_writer& out) {
+       api_describe_topic_partitions(&msgs.describe_req, &msgs.describe_res);
+       int32_t sz = stream_message(out, &msgs.describe_res);
+       msgs.describe_res.keep_alive.reset();
+       return sz;
+     }},
+};
+
+std::array<api_entry const*, API_KEY_LIMIT> const BY_KEY = [] {
+  std::array<api_entry const*, API_KEY_LIMIT> by_key{};
+  for (api_entry const& api : APIS) by_key[api.api_key] = &api;
+  return by_key;
+}();
+
+}  // namespace
+
+std::span<api_entry const> api_entries() { return APIS; }
+
+api_entry const* find_api(int16_t api_key) {
+  if (api_key < 0 || api_key >= API_KEY_LIMIT) return nullptr;
+  return BY_KEY[api_key];
+}
+
+bool api_version_supported(api_entry const& api, int16_t version) {
+  return version >= api.min_version && version <= api.max_version;
+}
+
+int32_t serve_request(message_pool& msgs, int8_t* in, chunk_writer& out) {
+  api_entry const* api = find_api(msgs.req_header.request_api_key.val);
+  if (!api) return -1;
+  sint32 correlation_id = msgs.req_header.correlation_id;
+  if (api->response_header_version == 0) {
+    msgs.res_header_v0.correlation_id = correlation_id;
+  } else {
+    msgs.res_header_v1.correlation_id = correlation_id;
+  }
+  api->decode(msgs, in);
+  return api->answer(msgs, out);
+}
@@ -0,0 +1,43 @@
+#ifndef API_REGISTRY_H
+#define API_REGISTRY_H
+
+#include <cstdint>
+#include <span>
+
+#include "chunk_writer.hpp"
+#include "message_pool.hpp"
+
+// Every API the broker answers, in one table: the versions it serves, the
+// response header version, how the request body is decoded into the
+// connection's messages and how it is answered. Requests are dispatched by
+// indexing the table with their api key, and ApiVersions lists exactly what
+// is in it, so an API is served and advertised by adding its entry.
+struct api_entry {
+  int16_t api_key;
+  int16_t min_version;
+  int16_t max_version;
+  // 0 for ApiVersions, whatever its version, 1 for the flexible versions of
+  // the others
+  int8_t response_header_version;
+  // decodes the body at in, returns what it read. A request of a version out
+  // of range goes through here as well, and is answered with the API's error,
+  // or throws decode_error when it is in an encoding not decoded here
+  int32_t (*decode)(message_pool& msgs, int8_t* in);
+  // writes the whole response frame, returns its size
+  int32_t (*answer)(message_pool& msgs, chunk_writer& out);
+};
+
+// api keys are below this
+int16_t const API_KEY_LIMIT = 128;
+
+// ordered by api key
+std::span<api_entry const> api_entries();
+// null when the api key is not served
+api_entry const* find_api(int16_t api_key);
+bool api_version_supported(api_entry const& api, int16_t version);
+
+// answers the request whose header is in msgs.req_header and whose body is at
+// in; -1 when its API is not served
+int32_t serve_request(message_pool& msgs, int8_t* in, chunk_writer& out);
+
+#endif
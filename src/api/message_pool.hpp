@@ -0,0 +1,31 @@
+#ifndef MESSAGE_POOL_H
+#define MESSAGE_POOL_H
+
+#include "request_message.hpp"
+#include "response_message.hpp"
+
+// The message objects of one connection, decoded into and filled again for
+// every request. Arrays resize in place, so the capacity a request grows
+// stays around for the next one and a steady stream of similar requests stops
+// allocating. Build the pool outside of any request arena: its containers
+// then take their memory from the heap and outlive each request's reset.
+struct message_pool {
+  request_header_v2 req_header;
+  response_header_v0 res_header_v0;
+  response_header_v1 res_header_v1;
+
+  request_k1_v16 fetch_req{&req_header};
+  response_k1_v16 fetch_res{&res_header_v1};
+
+  request_k3 metadata_req{&req_header};
+  response_k3 metadata_res{&res_header_v1};
+
+  request_k75_v0 describe_req{&req_header};
+  response_k75_v0 describe_res{&res_header_v1};
+
+  message_pool() = default;
+  message_pool(message_pool const&) = delete;
+  message_pool& operator=(message_pool const&) = delete;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#include "response_cache.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "api_all.hpp"
+#include "api_registry.hpp"
+#include "constants.hpp"
+#include "primitive.hpp"
+#include "request_message.hpp"
+#include "response_message.hpp"
+
+namespace {
+
+std::atomic<std::shared_ptr<response_cache const>> cache;
+
+cached_response encode_api_versions(int16_t version) {
+  int8_t buf[BUFSIZ];
+  request_header_v2 req_header;
+  req_header.request_api_version.val = version;
+  request_k18_v4 req(&req_header);
+  response_header_v0 res_header;
+  res_header.correlation_id.val = 0;
+  response_k18_v4 res(&res_header);
+  api_api_version_k18_v4(&req, &res);
+  int32_t len = write_message(buf, &res);
+  return cached_response{std::vector<int8_t>(buf, buf + len)};
+}
+
+}  // namespace
+
+int32_t cached_response::write(chunk_writer& w, int32_t correlation_id) const {
+  int8_t id[sizeof(int32_t)];
+  store_big_endian(id, correlation_id);
+  int32_t rest = CORRELATION_ID_OFFSET + sizeof(id);
+  w.write(frame.data(), CORRELATION_ID_OFFSET);
+  w.write(id, sizeof(id));
+  w.write(frame.data() + rest, frame.size() - rest);
+  return frame.size();
+}
+
+void rebuild_response_cache() {
+  auto next = std::make_shared<response_cache>();
+  next->api_versions = encode_api_versions(API_VERSION_MAX_18);
+  next->api_versions_unsupported = encode_api_versions(API_VERSION_MAX_18 + 1);
+  cache.store(std::move(next));
+}
+
+std::shared_ptr<response_cache const> current_response_cache() {
+  return cache.load();
+}
+
+int32_t write_api_versions_k18(chunk_writer& w,
+                               request_header_v2 const& header) {
+  std::shared_ptr<response_cache const> c = current_response_cache();
+  int16_t version = header.request_api_version.val;
+  cached_response const& res = api_version_supported(*find_api(18), version)
+                                    ? c->api_versions
+                                    : c->api_versions_unsupported;
+  return res.write(w, header.correlation_id.val);
+}
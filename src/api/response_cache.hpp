@@ -0,0 +1,36 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "chunk_writer.hpp"
+#include "request_message.hpp"
+
+// A whole response frame, size prefix included, encoded once. Serving it is
+// a copy with the request's correlation id put in along the way.
+struct cached_response {
+  static constexpr int32_t CORRELATION_ID_OFFSET = sizeof(int32_t);
+
+  std::vector<int8_t> frame;
+  int32_t write(chunk_writer& w, int32_t correlation_id) const;
+};
+
+// responses that only depend on the API registry
+struct response_cache {
+  cached_response api_versions;
+  cached_response api_versions_unsupported;
+};
+
+// encodes every cached response again and publishes the result; called on
+// startup and whenever what they are built from changes. Requests already
+// holding the previous cache finish with it.
+void rebuild_response_cache();
+std::shared_ptr<response_cache const> current_response_cache();
+
+// ApiVersions straight from the cache, without decoding the request body
+int32_t write_api_versions_k18(chunk_writer& w,
+                               request_header_v2 const& header);
+
+#endif
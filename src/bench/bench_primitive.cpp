@@ -0,0 +1,355 @@
+// Encode/decode throughput of the wire types and of realistic messages.
+//
+//   bench_primitive --benchmark_format=json --benchmark_out=run.json
+//
+// writes a run that can be diffed against another one, e.g. with
+// google-benchmark's tools/compare.py.
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "chunk_writer.hpp"
+#include "primitive.hpp"
+#include "record.hpp"
+#include "request_message.hpp"
+#include "response_message.hpp"
+#include "uuid.hpp"
+
+namespace {
+
+size_t const BS = 1 << 22;
+
+std::vector<int8_t>& buffer() {
+  static std::vector<int8_t> buf(BS);
+  return buf;
+}
+
+uuid128 const TOPIC = [] {
+  uuid128 id;
+  uuid128::parse("00000000-0000-4000-8000-000000000091", id);
+  return id;
+}();
+
+// one typical value per wire type
+template <typename T>
+T sample();
+
+template <>
+sbool sample() { return sbool(true); }
+template <>
+sint8 sample() { return sint8(-7); }
+template <>
+sint16 sample() { return sint16(1234); }
+template <>
+sint32 sample() { return sint32(123456); }
+template <>
+sint64 sample() { return sint64(1234567890123); }
+template <>
+suint32 sample() { return suint32(123456); }
+template <>
+suint64 sample() { return suint64(1234567890123); }
+template <>
+suvint sample() { return suvint(300); }
+template <>
+svint sample() { return svint(-300); }
+template <>
+suvlong sample() { return suvlong(1234567890123); }
+template <>
+svlong sample() { return svlong(-1234567890123); }
+template <>
+suuid sample() { return suuid(TOPIC); }
+template <>
+sstring sample() { return sstring("kafka-client-1"); }
+template <>
+snstring sample() { return snstring("kafka-client-1"); }
+template <>
+scstring sample() { return scstring("kafka-client-1"); }
+template <>
+scnstring sample() { return scnstring("kafka-client-1"); }
+template <>
+sstring_view sample() { return sstring_view("kafka-client-1"); }
+template <>
+snstring_view sample() { return snstring_view("kafka-client-1"); }
+template <>
+scstring_view sample() { return scstring_view("kafka-client-1"); }
+template <>
+scnstring_view sample() { return scnstring_view("kafka-client-1"); }
+template <>
+sarray<sint32> sample() {
+  return sarray<sint32>(std::vector<sint32>(16, sint32(3)));
+}
+template <>
+scarray<sint32> sample() {
+  return scarray<sint32>(std::vector<sint32>(16, sint32(3)));
+}
+template <>
+sfixarray<int32_t> sample() {
+  return sfixarray<int32_t>(std::vector<int32_t>(16, 3));
+}
+template <>
+scfixarray<int32_t> sample() {
+  return scfixarray<int32_t>(std::vector<int32_t>(16, 3));
+}
+template <>
+stagged_fields sample() {
+  return stagged_fields(std::vector<stagged_fields::field>{
+      stagged_fields::field(0, {'h', 'e', 'l', 'l', 'o'}),
+      stagged_fields::field(3, {'w', 'o', 'r', 'l', 'd'})});
+}
+template <>
+stagged_fields_view sample() {
+  static int8_t raw[] = {2, 0, 5, 'h', 'e', 'l', 'l', 'o',
+                         3, 5, 'w', 'o', 'r', 'l', 'd'};
+  stagged_fields_view v;
+  v.deserialize(raw);
+  return v;
+}
+
+template <typename T>
+void BM_encode(benchmark::State& state) {
+  T v = sample<T>();
+  int8_t* buf = buffer().data();
+  int64_t bytes{};
+  for (auto _ : state) {
+    bytes += v.serialize(buf);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(bytes);
+}
+
+template <typename T>
+void BM_decode(benchmark::State& state) {
+  T v = sample<T>();
+  int8_t* buf = buffer().data();
+  v.serialize(buf);
+  T d;
+  int64_t bytes{};
+  for (auto _ : state) {
+    bytes += d.deserialize(buf);
+    benchmark::DoNotOptimize(d);
+  }
+  state.SetBytesProcessed(bytes);
+}
+
+#define BENCH_TYPE(...)                   \
+  BENCHMARK_TEMPLATE(BM_encode, __VA_ARGS__); \
+  BENCHMARK_TEMPLATE(BM_decode, __VA_ARGS__)
+
+BENCH_TYPE(sbool);
+BENCH_TYPE(sint8);
+BENCH_TYPE(sint16);
+BENCH_TYPE(sint32);
+BENCH_TYPE(sint64);
+BENCH_TYPE(suint32);
+BENCH_TYPE(suint64);
+BENCH_TYPE(suvint);
+BENCH_TYPE(svint);
+BENCH_TYPE(suvlong);
+BENCH_TYPE(svlong);
+BENCH_TYPE(suuid);
+BENCH_TYPE(sstring);
+BENCH_TYPE(snstring);
+BENCH_TYPE(scstring);
+BENCH_TYPE(scnstring);
+BENCH_TYPE(sstring_view);
+BENCH_TYPE(snstring_view);
+BENCH_TYPE(scstring_view);
+BENCH_TYPE(scnstring_view);
+BENCH_TYPE(sarray<sint32>);
+BENCH_TYPE(scarray<sint32>);
+BENCH_TYPE(sfixarray<int32_t>);
+BENCH_TYPE(scfixarray<int32_t>);
+BENCH_TYPE(stagged_fields);
+BENCH_TYPE(stagged_fields_view);
+
+// a consumer fetching range(0) partitions of one topic
+void fill_fetch(request_k1_v16& req, int32_t partitions) {
+  req.max_wait_ms.val = 500;
+  req.min_bytes.val = 1;
+  req.max_bytes.val = 50 << 20;
+  req.isolation_level.val = 0;
+  req.session_id.val = 0;
+  req.session_epoch.val = -1;
+  req.topics.is_null = false;
+  k1_topic& t = req.topics.emplace_back();
+  t.topic_id = suuid(TOPIC);
+  t.partitions.is_null = false;
+  for (int32_t i = 0; i < partitions; ++i) {
+    k1_partition& p = t.partitions.emplace_back();
+    p.partition.val = i;
+    p.current_leader_epoch.val = 3;
+    p.fetch_offset.val = 100000 + i;
+    p.last_fetched_epoch.val = -1;
+    p.log_start_offset.val = 0;
+    p.partition_max_bytes.val = 1 << 20;
+  }
+  req.rack_id = scstring_view("rack-a");
+}
+
+// DescribeTopicPartitions answer for one topic of range(0) partitions on a
+// three broker cluster
+void fill_describe(response_k75_v0& res, int32_t partitions) {
+  res.header->correlation_id.val = 1;
+  res.throttle_time_ms.val = 0;
+  res.topics.is_null = false;
+  res_topic_info& t = res.topics.emplace_back();
+  t.error_code.val = 0;
+  t.name = scnstring("orders");
+  t.topic_id = suuid(TOPIC);
+  t.is_internal.val = false;
+  t.topic_authorized_operations.val = 0;
+  t.partitions.is_null = false;
+  for (int32_t i = 0; i < partitions; ++i) {
+    res_partition& p = t.partitions.emplace_back();
+    p.error_code.val = 0;
+    p.partition_index.val = i;
+    p.leader_id.val = i % 3;
+    p.leader_epoch.val = 5;
+    p.replica_nodes = scfixarray<int32_t>({i % 3, (i + 1) % 3, (i + 2) % 3});
+    p.isr_nodes = scfixarray<int32_t>({i % 3, (i + 1) % 3});
+    p.eligible_leader_replicas.is_null = false;
+    p.last_known_elr.is_null = false;
+    p.offline_replicas.is_null = false;
+  }
+  res.next_cursor.is_null = true;
+}
+
+// a metadata log batch of one topic record and range(0) partition records
+void fill_batch(record_batch& batch, int32_t partitions) {
+  batch.base_offset.val = 0;
+  batch.batch_length.val = 0;
+  batch.partition_leader_epoch.val = 1;
+  batch.magic_byte.val = 2;
+  batch.crc.val = 0;
+  batch.attributes.val = 0;
+  batch.last_offset_data.val = partitions;
+  batch.base_timestamp.val = 1700000000000;
+  batch.max_timestamp.val = 1700000000000;
+  batch.producer_id.val = -1;
+  batch.producer_epoch.val = -1;
+  batch.base_sequence.val = -1;
+  batch.records.is_null = false;
+  for (int32_t i = 0; i <= partitions; ++i) {
+    record& r = batch.records.emplace_back();
+    r.attributes.val = 0;
+    r.timestamp_delta.val = 0;
+    r.offset_delta.val = i;
+    r.value.frame_version.val = 1;
+    r.value.version.val = 0;
+    if (i == 0) {
+      auto v = std::make_shared<record_value_type2_t>();
+      v->topic_name = scstring("orders");
+      v->topic_uuid = suuid(TOPIC);
+      r.value.type.val = 2;
+      r.value.value = v;
+    } else {
+      auto v = std::make_shared<record_value_type3_t>();
+      v->partition_id.val = i - 1;
+      v->topic_uuid = suuid(TOPIC);
+      v->replica_array = scfixarray<int32_t>({1, 2, 3});
+      v->in_sync_replica_array = scfixarray<int32_t>({1, 2, 3});
+      v->removing_replica_array.is_null = false;
+      v->adding_replica_array.is_null = false;
+      v->leader.val = 1;
+      v->leader_epoch.val = 0;
+      v->partition_epoch.val = 0;
+      v->directories_array = scarray<suuid>({suuid(TOPIC)});
+      r.value.type.val = 3;
+      r.value.value = v;
+    }
+  }
+}
+
+void BM_encode_fetch_request(benchmark::State& state) {
+  request_header_v2 header;
+  request_k1_v16 req(&header);
+  fill_fetch(req, state.range(0));
+  int8_t* buf = buffer().data();
+  int64_t bytes{};
+  for (auto _ : state) {
+    bytes += req.serialize(buf);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(bytes);
+}
+
+void BM_decode_fetch_request(benchmark::State& state) {
+  request_header_v2 header;
+  request_k1_v16 req(&header);
+  fill_fetch(req, state.range(0));
+  int8_t* buf = buffer().data();
+  req.serialize(buf);
+  request_k1_v16 d(&header);
+  int64_t bytes{};
+  for (auto _ : state) {
+    bytes += d.deserialize(buf);
+    benchmark::DoNotOptimize(d);
+  }
+  state.SetBytesProcessed(bytes);
+}
+
+void BM_encode_describe_response(benchmark::State& state) {
+  response_header_v1 header;
+  response_k75_v0 res(&header);
+  fill_describe(res, state.range(0));
+  int8_t* buf = buffer().data();
+  int64_t bytes{};
+  for (auto _ : state) {
+    bytes += write_message(buf, &res);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(bytes);
+}
+
+// the same into the chunk chain the broker sends from
+void BM_stream_describe_response(benchmark::State& state) {
+  response_header_v1 header;
+  response_k75_v0 res(&header);
+  fill_describe(res, state.range(0));
+  chunk_writer w;
+  int64_t bytes{};
+  for (auto _ : state) {
+    w.clear();
+    bytes += stream_message(w, &res);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(bytes);
+}
+
+void BM_encode_record_batch(benchmark::State& state) {
+  record_batch batch;
+  fill_batch(batch, state.range(0));
+  int8_t* buf = buffer().data();
+  int64_t bytes{};
+  for (auto _ : state) {
+    bytes += batch.serialize(buf);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(bytes);
+}
+
+void BM_decode_record_batch(benchmark::State& state) {
+  record_batch batch;
+  fill_batch(batch, state.range(0));
+  int8_t* buf = buffer().data();
+  batch.serialize(buf);
+  record_batch d;
+  int64_t bytes{};
+  for (auto _ : state) {
+    bytes += d.deserialize(buf);
+    benchmark::DoNotOptimize(d);
+  }
+  state.SetBytesProcessed(bytes);
+}
+
+BENCHMARK(BM_encode_fetch_request)->RangeMultiplier(16)->Range(1, 4096);
+BENCHMARK(BM_decode_fetch_request)->RangeMultiplier(16)->Range(1, 4096);
+BENCHMARK(BM_encode_describe_response)->RangeMultiplier(16)->Range(1, 4096);
+BENCHMARK(BM_stream_describe_response)->RangeMultiplier(16)->Range(1, 4096);
+BENCHMARK(BM_encode_record_batch)->RangeMultiplier(16)->Range(1, 4096);
+BENCHMARK(BM_decode_record_batch)->RangeMultiplier(16)->Range(1, 4096);
+
+}  // namespace
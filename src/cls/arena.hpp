@@ -0,0 +1,101 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+// Message containers (sarray, scarray, stagged_fields) take their memory
+// resource from the thread's current message resource when they are
+// constructed, and build their own elements from that same resource. Outside
+// of a request that is the global heap; inside one it is the connection arena.
+
+inline thread_local std::pmr::memory_resource* current_msg_resource = nullptr;
+
+inline std::pmr::memory_resource* msg_resource() {
+  return current_msg_resource ? current_msg_resource
+                              : std::pmr::get_default_resource();
+}
+
+// makes r the message resource of this thread until the end of the scope
+struct msg_resource_scope {
+  std::pmr::memory_resource* prev;
+  explicit msg_resource_scope(std::pmr::memory_resource* r)
+      : prev(current_msg_resource) {
+    current_msg_resource = r;
+  }
+  msg_resource_scope(msg_resource_scope const&) = delete;
+  msg_resource_scope& operator=(msg_resource_scope const&) = delete;
+  ~msg_resource_scope() { current_msg_resource = prev; }
+};
+
+// monotonic arena owned by a connection; whatever a request builds outside of
+// the connection's pooled messages is bump-allocated from it and dropped
+// together by reset()
+struct msg_arena {
+  static constexpr size_t INITIAL_SIZE = 64 * 1024;
+
+  std::unique_ptr<std::byte[]> initial;
+  std::pmr::monotonic_buffer_resource res;
+
+  explicit msg_arena(size_t size = INITIAL_SIZE)
+      : initial(new std::byte[size]),
+        res(initial.get(), size, std::pmr::get_default_resource()) {}
+  msg_arena(msg_arena const&) = delete;
+  msg_arena& operator=(msg_arena const&) = delete;
+
+  std::pmr::memory_resource* resource() { return &res; }
+  // back to the initial buffer, overflow blocks go back upstream
+  void reset() { res.release(); }
+};
+
+// activates the arena for one request and resets it afterwards; declare it
+// before any message object of the request so it outlives all of them
+struct msg_arena_scope {
+  msg_arena& arena;
+  msg_resource_scope scope;
+  explicit msg_arena_scope(msg_arena& a) : arena(a), scope(a.resource()) {}
+  ~msg_arena_scope() { arena.reset(); }
+};
+
+template <typename T>
+std::pmr::memory_resource* resource_of(std::pmr::vector<T> const& v) {
+  return v.get_allocator().resource();
+}
+
+// copies src into dst; new elements are built from dst's resource
+template <typename T>
+void msg_assign(std::pmr::vector<T>& dst, std::pmr::vector<T> const& src) {
+  msg_resource_scope scope(resource_of(dst));
+  dst = src;
+}
+
+// steals src's storage when both share a resource, copies otherwise so dst
+// never ends up holding memory from a shorter-lived arena
+template <typename T>
+void msg_assign(std::pmr::vector<T>& dst, std::pmr::vector<T>&& src) {
+  if (resource_of(dst) == resource_of(src)) {
+    dst = std::move(src);
+  } else {
+    msg_assign(dst, std::as_const(src));
+  }
+}
+
+// elements already in v are kept along with the capacity they hold, so
+// decoding into a reused message does not reallocate; new ones are built from
+// v's resource
+template <typename T>
+void msg_resize(std::pmr::vector<T>& v, size_t n) {
+  msg_resource_scope scope(resource_of(v));
+  v.resize(n);
+}
+
+template <typename T>
+T& msg_emplace_back(std::pmr::vector<T>& v) {
+  msg_resource_scope scope(resource_of(v));
+  return v.emplace_back();
+}
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef CHUNK_WRITER_H
+#define CHUNK_WRITER_H
+
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "buffer_pool.hpp"
+
+// Output of a response that may not fit one buffer: a chain of fixed-size
+// chunks from the buffer pool, handed to writev as they are. Chunks are kept
+// across clear(), so a connection reusing its writer stops going to the pool
+// once it has grown to its largest response.
+//
+// A chunk's tail may stay unused when the next piece has to be contiguous, so
+// positions are (chunk, offset) pairs rather than plain offsets.
+struct chunk_writer {
+  static constexpr size_t CHUNK_SIZE = 4096;
+  // what reserve() can promise; types encoding to more override sbase::stream
+  static constexpr size_t MAX_INLINE_SIZE = 256;
+
+  struct chunk {
+    pooled_buffer buf;
+    size_t used{};
+  };
+  struct position {
+    size_t chunk;
+    size_t offset;
+  };
+
+  std::vector<chunk> chunks;
+  size_t current{};
+  size_t total{};
+
+  chunk_writer() = default;
+  chunk_writer(chunk_writer const&) = delete;
+  chunk_writer& operator=(chunk_writer const&) = delete;
+
+  void clear() {
+    for (chunk& c : chunks) c.used = 0;
+    current = 0;
+    total = 0;
+  }
+  size_t size() const { return total; }
+
+  // bytes left in the current chunk
+  size_t room() const {
+    return chunks.empty() ? 0 : CHUNK_SIZE - chunks[current].used;
+  }
+
+  // n <= CHUNK_SIZE contiguous bytes to write into, made visible by commit()
+  int8_t* reserve(size_t n) {
+    if (room() < n) next_chunk();
+    return chunks[current].buf.data + chunks[current].used;
+  }
+  void commit(size_t n) {
+    chunks[current].used += n;
+    total += n;
+  }
+
+  void write(int8_t const* p, size_t n) {
+    while (n > 0) {
+      if (room() == 0) next_chunk();
+      size_t k = std::min(n, room());
+      std::memcpy(chunks[current].buf.data + chunks[current].used, p, k);
+      commit(k);
+      p += k;
+      n -= k;
+    }
+  }
+
+  // where the next byte lands, for patch() to come back to
+  position tell() const {
+    return chunks.empty() ? position{0, 0}
+                          : position{current, chunks[current].used};
+  }
+
+  // overwrites n bytes already written from at on
+  void patch(position at, int8_t const* p, size_t n) {
+    while (n > 0) {
+      chunk& c = chunks[at.chunk];
+      if (at.offset >= c.used) {
+        at = {at.chunk + 1, 0};
+        continue;
+      }
+      size_t k = std::min(n, c.used - at.offset);
+      std::memcpy(c.buf.data + at.offset, p, k);
+      at.offset += k;
+      p += k;
+      n -= k;
+    }
+  }
+
+  // the written chunks as writev() takes them
+  void iovecs(std::vector<iovec>& out) const {
+    out.clear();
+    for (size_t i = 0; i <= current && i < chunks.size(); ++i) {
+      if (chunks[i].used == 0) continue;
+      out.push_back({chunks[i].buf.data, chunks[i].used});
+    }
+  }
+
+  // moves on to a fresh chunk, reusing one kept from an earlier message
+  void next_chunk() {
+    if (!chunks.empty() && chunks[current].used == 0) return;
+    if (!chunks.empty()) ++current;
+    if (current == chunks.size()) {
+      chunks.push_back({pooled_buffer(CHUNK_SIZE)});
+    }
+  }
+};
+
+#endif
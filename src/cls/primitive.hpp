@@ -1,27 +1,112 @@
 #ifndef PRIMITIVE_H
 #define PRIMITIVE_H
 
-#include <arpa/inet.h>
-#include <netinet/in.h>
-
 #include <algorithm>
+#include <bit>
 #include <cstdint>
 #include <cstring>
 #include <iomanip>
 #include <ios>
 #include <iostream>
 #include <iterator>
+#include <memory_resource>
 #include <ostream>
+#include <span>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <vector>
 
+#include "arena.hpp"
+#include "chunk_writer.hpp"
 #include "hexutil.hpp"
+#include "uuid.hpp"
+
+// Thrown by deserialize when the input is malformed: truncated, or with a
+// length that does not fit. Bounds are only known while a decode_bounds scope
+// is active; outside of one, decoders trust their input as they always did.
+struct decode_error : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+struct decode_bounds;
+inline thread_local decode_bounds const* current_decode_bounds = nullptr;
+
+// limits decoding on this thread to [buf, buf + len) until the end of the scope
+struct decode_bounds {
+  int8_t const* end;
+  decode_bounds const* prev;
+  decode_bounds(int8_t const* buf, size_t len)
+      : end(buf + len), prev(current_decode_bounds) {
+    current_decode_bounds = this;
+  }
+  decode_bounds(decode_bounds const&) = delete;
+  decode_bounds& operator=(decode_bounds const&) = delete;
+  ~decode_bounds() { current_decode_bounds = prev; }
+};
+
+// throws unless n more bytes can be read at buf
+inline void check_decode(int8_t const* buf, size_t n) {
+  decode_bounds const* b = current_decode_bounds;
+  if (b && (buf > b->end || n > static_cast<size_t>(b->end - buf)))
+    throw decode_error("input ends before its declared size");
+}
+
+// Big-endian loads and stores of fixed-width integers. Fields sit at any
+// offset of a frame, memcpy keeps those accesses defined where a cast to I*
+// would not be; the bulk loops are plain enough for the compiler to turn into
+// vector byte shuffles.
+template <typename I>
+constexpr I to_big_endian(I v) {
+  if constexpr (std::endian::native == std::endian::little) {
+    return std::byteswap(v);
+  } else {
+    return v;
+  }
+}
+
+template <typename I>
+void store_big_endian(int8_t* buf, I v) {
+  v = to_big_endian(v);
+  std::memcpy(buf, &v, sizeof(I));
+}
+
+template <typename I>
+I load_big_endian(int8_t const* buf) {
+  I v;
+  std::memcpy(&v, buf, sizeof(I));
+  return to_big_endian(v);
+}
+
+template <typename I>
+void store_big_endian(int8_t* buf, I const* src, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    I v = to_big_endian(src[i]);
+    std::memcpy(buf + i * sizeof(I), &v, sizeof(I));
+  }
+}
+
+template <typename I>
+void load_big_endian(I* dst, int8_t const* buf, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    I v;
+    std::memcpy(&v, buf + i * sizeof(I), sizeof(I));
+    dst[i] = to_big_endian(v);
+  }
+}
 
 struct sbase {
   virtual int32_t serialize(int8_t*) = 0;
   virtual int32_t deserialize(int8_t*) = 0;
+  // serialize into a chunk chain; in place by default, which is only right
+  // for types that never take more than chunk_writer::MAX_INLINE_SIZE bytes
+  virtual int32_t stream(chunk_writer& w) {
+    int32_t n = serialize(w.reserve(chunk_writer::MAX_INLINE_SIZE));
+    w.commit(n);
+    return n;
+  }
   sbase() = default;
   sbase(const sbase&) = default;
   sbase(sbase&&) noexcept = default;
@@ -39,6 +124,7 @@ struct sbool : public sbase {
     return sizeof(val);
   }
   int32_t deserialize(int8_t* buf) override {
+    check_decode(buf, sizeof(val));
     val = *buf;
     return sizeof(val);
   }
@@ -53,6 +139,7 @@ struct sint8 : public sbase {
     return sizeof(val);
   }
   int32_t deserialize(int8_t* buf) override {
+    check_decode(buf, sizeof(val));
     val = *buf;
     return sizeof(val);
   }
@@ -63,11 +150,12 @@ struct sint16 : public sbase {
   sint16() = default;
   explicit sint16(int16_t v) : val(v) {}
   int32_t serialize(int8_t* buf) override {
-    *reinterpret_cast<int16_t*>(buf) = htons(val);
+    store_big_endian(buf, val);
     return sizeof(val);
   }
   int32_t deserialize(int8_t* buf) override {
-    val = ntohs(*reinterpret_cast<int16_t*>(buf));
+    check_decode(buf, sizeof(val));
+    val = load_big_endian<int16_t>(buf);
     return sizeof(val);
   }
 };
@@ -77,11 +165,12 @@ struct sint32 : public sbase {
   sint32() = default;
   explicit sint32(int32_t v) : val(v) {}
   int32_t serialize(int8_t* buf) override {
-    *reinterpret_cast<int32_t*>(buf) = htonl(val);
+    store_big_endian(buf, val);
     return sizeof(val);
   }
   int32_t deserialize(int8_t* buf) override {
-    val = ntohl(*reinterpret_cast<int32_t*>(buf));
+    check_decode(buf, sizeof(val));
+    val = load_big_endian<int32_t>(buf);
     return sizeof(val);
   }
 };
@@ -91,15 +180,12 @@ struct sint64 : public sbase {
   sint64() = default;
   explicit sint64(int64_t v) : val(v) {}
   int32_t serialize(int8_t* buf) override {
-    *reinterpret_cast<int32_t*>(buf) = htonl(val >> 32);
-    *reinterpret_cast<int32_t*>(buf + sizeof(int32_t)) =
-        htonl(val & 0xffffffff);
+    store_big_endian(buf, val);
     return sizeof(val);
   }
   int32_t deserialize(int8_t* buf) override {
-    val =
-        (static_cast<int64_t>(ntohl(*reinterpret_cast<int32_t*>(buf))) << 32) |
-        ntohl(*reinterpret_cast<int32_t*>(buf + sizeof(int32_t)));
+    check_decode(buf, sizeof(val));
+    val = load_big_endian<int64_t>(buf);
     return sizeof(val);
   }
 };
@@ -109,15 +195,12 @@ struct suint64 : public sbase {
   suint64() = default;
   explicit suint64(uint64_t v) : val(v) {}
   int32_t serialize(int8_t* buf) override {
-    *reinterpret_cast<uint32_t*>(buf) = htonl(val >> 32);
-    *reinterpret_cast<uint32_t*>(buf + sizeof(int32_t)) =
-        htonl(val & 0xffffffff);
+    store_big_endian(buf, val);
     return sizeof(val);
   }
   int32_t deserialize(int8_t* buf) override {
-    val = (static_cast<uint64_t>(ntohl(*reinterpret_cast<uint32_t*>(buf)))
-           << 32) |
-          ntohl(*reinterpret_cast<uint32_t*>(buf + sizeof(uint32_t)));
+    check_decode(buf, sizeof(val));
+    val = load_big_endian<uint64_t>(buf);
     return sizeof(val);
   }
 };
@@ -127,11 +210,12 @@ struct suint32 : public sbase {
   suint32() = default;
   explicit suint32(uint32_t v) : val(v) {}
   int32_t serialize(int8_t* buf) override {
-    *reinterpret_cast<uint32_t*>(buf) = htonl(val);
+    store_big_endian(buf, val);
     return sizeof(val);
   }
   int32_t deserialize(int8_t* buf) override {
-    val = ntohl(*reinterpret_cast<uint32_t*>(buf));
+    check_decode(buf, sizeof(val));
+    val = load_big_endian<uint32_t>(buf);
     return sizeof(val);
   }
 };
@@ -152,10 +236,13 @@ struct suvint final : public sbase {
     } while (tmp);
     return size;
   }
+  static constexpr int32_t MAX_SIZE = 5;
   int32_t deserialize(int8_t* buf) override {
     val = 0;
     int32_t size{}, order{};
     do {
+      if (size == MAX_SIZE) throw decode_error("varint too long");
+      check_decode(buf, 1);
       val |= static_cast<uint32_t>(*buf & 0x7f) << order;
       order += 7;
       ++size;
@@ -168,20 +255,15 @@ struct svint : public sbase {
   int32_t val;
   svint() = default;
   explicit svint(int32_t v) : val(v) {}
+  // zigzag: 0, -1, 1, -2... map to 0, 1, 2, 3...
   int32_t serialize(int8_t* buf) override {
-    if (val < 0)
-      return suvint(2 * -(val + 1) + 1).serialize(buf);
-    else
-      return suvint(val * 2).serialize(buf);
+    uint32_t u = static_cast<uint32_t>(val);
+    return suvint(u << 1 ^ (val < 0 ? ~0u : 0u)).serialize(buf);
   }
   int32_t deserialize(int8_t* buf) override {
     suvint tmp;
     int32_t size = tmp.deserialize(buf);
-    if (tmp.val & 1)
-      // wrong: val = -(tmp.val + 1) / 2
-      val = -(tmp.val >> 1) - 1;
-    else
-      val = tmp.val >> 1;
+    val = static_cast<int32_t>(tmp.val >> 1 ^ (0u - (tmp.val & 1)));
     return size;
   }
 };
@@ -202,10 +284,13 @@ struct suvlong : public sbase {
     } while (tmp);
     return size;
   }
+  static constexpr int32_t MAX_SIZE = 10;
   int32_t deserialize(int8_t* buf) override {
     val = 0;
     int32_t size{}, order{};
     do {
+      if (size == MAX_SIZE) throw decode_error("varlong too long");
+      check_decode(buf, 1);
       val |= static_cast<uint64_t>(*buf & 0x7f) << order;
       order += 7;
       ++size;
@@ -219,18 +304,13 @@ struct svlong : public sbase {
   svlong() = default;
   explicit svlong(int64_t v) : val(v) {}
   int32_t serialize(int8_t* buf) override {
-    if (val & 1)
-      return suvlong(2 * -(val + 1) + 1).serialize(buf);
-    else
-      return suvlong(val * 2).serialize(buf);
+    uint64_t u = static_cast<uint64_t>(val);
+    return suvlong(u << 1 ^ (val < 0 ? ~0ull : 0ull)).serialize(buf);
   }
   int32_t deserialize(int8_t* buf) override {
     suvlong tmp;
     int32_t size = tmp.deserialize(buf);
-    if (tmp.val & 1)
-      val = -(tmp.val >> 1) - 1;
-    else
-      val = tmp.val >> 1;
+    val = static_cast<int64_t>(tmp.val >> 1 ^ (0ull - (tmp.val & 1)));
     return size;
   }
 };
@@ -238,88 +318,76 @@ struct svlong : public sbase {
 struct suuid : public sbase {
   int8_t val[16]{};
   suuid() = default;
+  explicit suuid(uuid128 const& v) { std::memcpy(val, v.bytes, sizeof(val)); }
   explicit suuid(std::string const& v) {
-    std::istringstream is(v);
-    int i{};
-    for (; i < 4; ++i) {
-      readbyte(is, val + i);
-    }
-    is.ignore();
-    for (; i < 6; ++i) {
-      readbyte(is, val + i);
-    }
-    is.ignore();
-    for (; i < 8; ++i) {
-      readbyte(is, val + i);
-    }
-    is.ignore();
-    for (; i < 10; ++i) {
-      readbyte(is, val + i);
-    }
-    is.ignore();
-    for (; i < 16; ++i) {
-      readbyte(is, val + i);
-    }
+    uuid128 u;
+    if (uuid128::parse(v, u)) std::memcpy(val, u.bytes, sizeof(val));
   }
   int32_t serialize(int8_t* buf) override {
     std::copy(val, val + 16, buf);
     return 16;
   }
   int32_t deserialize(int8_t* buf) override {
+    check_decode(buf, 16);
     std::copy(buf, buf + 16, val);
     return 16;
   }
-  std::string str() {
-    std::ostringstream os;
-    os << std::hex;
-    int i{};
-    for (; i < 4; ++i) {
-      os << std::setw(2) << std::setfill('0')
-         << static_cast<int>(static_cast<uint8_t>(val[i]));
-    }
-    os << '-';
-    for (; i < 6; ++i) {
-      os << std::setw(2) << std::setfill('0')
-         << static_cast<int>(static_cast<uint8_t>(val[i]));
-    }
-    os << '-';
-    for (; i < 8; ++i) {
-      os << std::setw(2) << std::setfill('0')
-         << static_cast<int>(static_cast<uint8_t>(val[i]));
-    }
-    os << '-';
-    for (; i < 10; ++i) {
-      os << std::setw(2) << std::setfill('0')
-         << static_cast<int>(static_cast<uint8_t>(val[i]));
-    }
-    os << '-';
-    for (; i < 16; ++i) {
-      os << std::setw(2) << std::setfill('0')
-         << static_cast<int>(static_cast<uint8_t>(val[i]));
-    }
-    return os.str();
+  uuid128 id() const {
+    uuid128 u;
+    std::memcpy(u.bytes, val, sizeof(val));
+    return u;
   }
+  std::string str() const { return id().str(); }
 };
 
+// Length prefixes of the string types, checked against what is left of the
+// input: the int16 one of classic strings and the uvint N + 1 of compact ones.
+// Both return -1 for null, which only nullable types accept.
+inline int32_t decode_string_size(int8_t* buf, bool nullable) {
+  check_decode(buf, sizeof(int16_t));
+  int16_t size = load_big_endian<int16_t>(buf);
+  if (size < (nullable ? -1 : 0)) throw decode_error("bad string length");
+  if (size > 0) check_decode(buf + sizeof(int16_t), size);
+  return size;
+}
+
+inline int32_t decode_compact_size(suvint& sz, int8_t* buf, int32_t& len_sz,
+                                   bool nullable) {
+  len_sz = sz.deserialize(buf);
+  if (sz.val == 0) {
+    if (!nullable) throw decode_error("null in a non-nullable string");
+    return -1;
+  }
+  check_decode(buf + len_sz, sz.val - 1);
+  return sz.val - 1;
+}
+
+// a length prefix followed by data that may run over several chunks
+inline int32_t stream_prefixed(chunk_writer& w, sbase&& prefix,
+                               void const* data, size_t n) {
+  int32_t sz = prefix.stream(w);
+  w.write(static_cast<int8_t const*>(data), n);
+  return sz + n;
+}
+
 struct sstring : public sbase {
   std::string val;
   sstring() = default;
   explicit sstring(std::string v) : val(v) {}
   int32_t serialize(int8_t* buf) override {
-    *reinterpret_cast<int16_t*>(buf) = htons(static_cast<int16_t>(val.size()));
+    store_big_endian(buf, static_cast<int16_t>(val.size()));
     buf += sizeof(int16_t);
     std::copy(val.c_str(), val.c_str() + val.size(),
               reinterpret_cast<char*>(buf));
     return sizeof(int16_t) + val.size();
   }
+  int32_t stream(chunk_writer& w) override {
+    return stream_prefixed(w, sint16(val.size()), val.data(), val.size());
+  }
   int32_t deserialize(int8_t* buf) override {
-    int16_t size = ntohs(*reinterpret_cast<int16_t*>(buf));
-    val.reserve(size);
-    val.clear();
+    int32_t size = decode_string_size(buf, false);
     buf += sizeof(int16_t);
-    std::copy(reinterpret_cast<char*>(buf), reinterpret_cast<char*>(buf) + size,
-              std::back_inserter(val));
-    val.resize(size);
+    val.assign(reinterpret_cast<char*>(buf), size);
     return sizeof(int16_t) + size;
   }
 };
@@ -332,10 +400,9 @@ struct snstring : public sbase {
   int32_t serialize(int8_t* buf) override {
     int32_t sz{sizeof(int16_t)};
     if (is_null) {
-      *reinterpret_cast<int16_t*>(buf) = htons(static_cast<int16_t>(-1));
+      store_big_endian(buf, static_cast<int16_t>(-1));
     } else {
-      *reinterpret_cast<int16_t*>(buf) =
-          htons(static_cast<int16_t>(val.size()));
+      store_big_endian(buf, static_cast<int16_t>(val.size()));
       buf += sizeof(int16_t);
       std::copy(val.c_str(), val.c_str() + val.size(),
                 reinterpret_cast<char*>(buf));
@@ -343,16 +410,17 @@ struct snstring : public sbase {
     }
     return sz;
   }
+  int32_t stream(chunk_writer& w) override {
+    if (is_null) return sint16(-1).stream(w);
+    return stream_prefixed(w, sint16(val.size()), val.data(), val.size());
+  }
   int32_t deserialize(int8_t* buf) override {
     int32_t sz{sizeof(int16_t)};
-    int16_t size = ntohs(*reinterpret_cast<int16_t*>(buf));
+    int32_t size = decode_string_size(buf, true);
     val.clear();
-    if (size != -1) {
-      val.reserve(size);
-      buf += sizeof(int16_t);
-      std::copy(reinterpret_cast<char*>(buf),
-                reinterpret_cast<char*>(buf) + size, std::back_inserter(val));
-      val.resize(size);
+    is_null = size == -1;
+    if (!is_null) {
+      val.assign(reinterpret_cast<char*>(buf) + sz, size);
       sz += size;
     }
     return sz;
@@ -369,17 +437,14 @@ struct scstring final : public sbase {
               reinterpret_cast<char*>(buf) + len_sz);
     return val.size() + len_sz;
   }
+  int32_t stream(chunk_writer& w) override {
+    return stream_prefixed(w, suvint(val.size() + 1), val.data(), val.size());
+  }
   int32_t deserialize(int8_t* buf) override {
     suvint sz;
-    int32_t len_sz{sz.deserialize(buf)};
-    val.clear();
-    uint32_t n = sz.val - 1;
-    val.reserve(n);
-    // sz = N + 1
-    // std::cout << "copying " << n << " characters into a " << val.capacity() << " sized" << std::endl;
-    std::copy(reinterpret_cast<char*>(buf) + len_sz,
-              reinterpret_cast<char*>(buf) + len_sz + n,
-              std::back_inserter(val));
+    int32_t len_sz;
+    int32_t n = decode_compact_size(sz, buf, len_sz, false);
+    val.assign(reinterpret_cast<char*>(buf) + len_sz, n);
     return len_sz + n;
   }
 };
@@ -398,31 +463,186 @@ struct scnstring final : public sbase {
               reinterpret_cast<char*>(buf) + len_sz);
     return val.size() + len_sz;
   }
+  int32_t stream(chunk_writer& w) override {
+    if (is_null) return suvint(0).stream(w);
+    return stream_prefixed(w, suvint(val.size() + 1), val.data(), val.size());
+  }
   int32_t deserialize(int8_t* buf) override {
     suvint sz;
-    int32_t len_sz{sz.deserialize(buf)};
+    int32_t len_sz;
+    int32_t n = decode_compact_size(sz, buf, len_sz, true);
     val.clear();
-    if (sz.val == 0) {
-      return len_sz;
+    is_null = n == -1;
+    if (is_null) return len_sz;
+    val.assign(reinterpret_cast<char*>(buf) + len_sz, n);
+    return len_sz + n;
+  }
+};
+
+// The *_view strings borrow from the buffer they were decoded from and are
+// only valid while that frame is alive. Use them on the request path only.
+struct sstring_view final : public sbase {
+  std::string_view val;
+  sstring_view() = default;
+  explicit sstring_view(std::string_view v) : val(v) {}
+  int32_t serialize(int8_t* buf) override {
+    store_big_endian(buf, static_cast<int16_t>(val.size()));
+    buf += sizeof(int16_t);
+    std::copy(val.begin(), val.end(), reinterpret_cast<char*>(buf));
+    return sizeof(int16_t) + val.size();
+  }
+  int32_t stream(chunk_writer& w) override {
+    return stream_prefixed(w, sint16(val.size()), val.data(), val.size());
+  }
+  int32_t deserialize(int8_t* buf) override {
+    int32_t size = decode_string_size(buf, false);
+    val = std::string_view(reinterpret_cast<char*>(buf) + sizeof(int16_t),
+                           size);
+    return sizeof(int16_t) + size;
+  }
+};
+
+struct snstring_view final : public sbase {
+  std::string_view val;
+  bool is_null{true};
+  snstring_view() = default;
+  explicit snstring_view(std::string_view v) : val(v), is_null(false) {}
+  int32_t serialize(int8_t* buf) override {
+    int32_t sz{sizeof(int16_t)};
+    if (is_null) {
+      store_big_endian(buf, static_cast<int16_t>(-1));
     } else {
-      uint32_t n = sz.val - 1;
-      val.reserve(n);
-      // sz = N + 1
-      std::copy(reinterpret_cast<char*>(buf) + len_sz,
-                reinterpret_cast<char*>(buf) + len_sz + n,
-                std::back_inserter(val));
-      return len_sz + n;
+      store_big_endian(buf, static_cast<int16_t>(val.size()));
+      buf += sizeof(int16_t);
+      std::copy(val.begin(), val.end(), reinterpret_cast<char*>(buf));
+      sz += val.size();
+    }
+    return sz;
+  }
+  int32_t stream(chunk_writer& w) override {
+    if (is_null) return sint16(-1).stream(w);
+    return stream_prefixed(w, sint16(val.size()), val.data(), val.size());
+  }
+  int32_t deserialize(int8_t* buf) override {
+    int32_t sz{sizeof(int16_t)};
+    int32_t size = decode_string_size(buf, true);
+    val = {};
+    is_null = size == -1;
+    if (!is_null) {
+      val = std::string_view(reinterpret_cast<char*>(buf) + sz, size);
+      sz += size;
     }
+    return sz;
   }
 };
 
+struct scstring_view final : public sbase {
+  std::string_view val;
+  scstring_view() = default;
+  explicit scstring_view(std::string_view v) : val(v) {}
+  int32_t serialize(int8_t* buf) override {
+    int32_t len_sz{suvint(val.size() + 1).serialize(buf)};
+    std::copy(val.begin(), val.end(), reinterpret_cast<char*>(buf) + len_sz);
+    return val.size() + len_sz;
+  }
+  int32_t stream(chunk_writer& w) override {
+    return stream_prefixed(w, suvint(val.size() + 1), val.data(), val.size());
+  }
+  int32_t deserialize(int8_t* buf) override {
+    suvint sz;
+    int32_t len_sz;
+    int32_t n = decode_compact_size(sz, buf, len_sz, false);
+    val = std::string_view(reinterpret_cast<char*>(buf) + len_sz, n);
+    return len_sz + n;
+  }
+};
+
+struct scnstring_view final : public sbase {
+  std::string_view val;
+  bool is_null{true};
+  scnstring_view() = default;
+  explicit scnstring_view(std::string_view v) : val(v), is_null(false) {}
+  int32_t serialize(int8_t* buf) override {
+    if (is_null) {
+      return suvint(0).serialize(buf);
+    }
+    int32_t len_sz{suvint(val.size() + 1).serialize(buf)};
+    std::copy(val.begin(), val.end(), reinterpret_cast<char*>(buf) + len_sz);
+    return val.size() + len_sz;
+  }
+  int32_t stream(chunk_writer& w) override {
+    if (is_null) return suvint(0).stream(w);
+    return stream_prefixed(w, suvint(val.size() + 1), val.data(), val.size());
+  }
+  int32_t deserialize(int8_t* buf) override {
+    suvint sz;
+    int32_t len_sz;
+    int32_t n = decode_compact_size(sz, buf, len_sz, true);
+    val = {};
+    is_null = n == -1;
+    if (is_null) return len_sz;
+    val = std::string_view(reinterpret_cast<char*>(buf) + len_sz, n);
+    return len_sz + n;
+  }
+};
+
+// Array elements into a chunk chain. Bytes (sint8, the records of a fetch)
+// and fixed-width integers go over in runs as long as the current chunk
+// allows rather than one element at a time.
+template <typename T>
+int32_t stream_elements(chunk_writer& w, std::pmr::vector<T>& val) {
+  if constexpr (std::is_same_v<T, sint8>) {
+    for (size_t i = 0; i < val.size();) {
+      size_t k = std::min(val.size() - i,
+                          w.room() ? w.room() : chunk_writer::CHUNK_SIZE);
+      int8_t* p = w.reserve(k);
+      for (size_t j = 0; j < k; ++j) p[j] = val[i + j].val;
+      w.commit(k);
+      i += k;
+    }
+    return val.size();
+  } else {
+    int32_t size{};
+    for (T& e : val) size += e.stream(w);
+    return size;
+  }
+}
+
+template <typename I>
+int32_t stream_fixed(chunk_writer& w, std::pmr::vector<I> const& val) {
+  for (size_t i = 0; i < val.size();) {
+    size_t room =
+        w.room() >= sizeof(I) ? w.room() : chunk_writer::CHUNK_SIZE;
+    size_t k = std::min(val.size() - i, room / sizeof(I));
+    store_big_endian(w.reserve(k * sizeof(I)), val.data() + i, k);
+    w.commit(k * sizeof(I));
+    i += k;
+  }
+  return val.size() * sizeof(I);
+}
+
 template <typename T,
           std::enable_if_t<std::is_base_of_v<sbase, T>, bool> = true>
 struct sarray : public sbase {
-  std::vector<T> val;
+  std::pmr::vector<T> val = std::pmr::vector<T>(msg_resource());
   bool is_null{true};
   sarray() = default;
-  explicit sarray(std::vector<T> v) : val(v), is_null(false) {}
+  explicit sarray(std::vector<T> v)
+      : val(v.begin(), v.end(), msg_resource()), is_null(false) {}
+  sarray(sarray const& o)
+      : sbase(o), val(o.val, msg_resource()), is_null(o.is_null) {}
+  sarray(sarray&&) noexcept = default;
+  sarray& operator=(sarray const& o) {
+    msg_assign(val, o.val);
+    is_null = o.is_null;
+    return *this;
+  }
+  sarray& operator=(sarray&& o) {
+    msg_assign(val, std::move(o.val));
+    is_null = o.is_null;
+    return *this;
+  }
+  T& emplace_back() { return msg_emplace_back(val); }
   int32_t serialize(int8_t* buf) override {
     int32_t size{};
     if (is_null) {
@@ -435,20 +655,23 @@ struct sarray : public sbase {
     }
     return size;
   }
+  int32_t stream(chunk_writer& w) override {
+    if (is_null) return sint32(-1).stream(w);
+    return sint32(val.size()).stream(w) + stream_elements(w, val);
+  }
   int32_t deserialize(int8_t* buf) override {
     int32_t size{};
     sint32 n;
     size += n.deserialize(buf);
 
-    val.clear();
-    if (n.val == -1) {
-      is_null = true;
-    } else {
-      is_null = false;
-      for (int32_t i = 0; i < n.val; ++i) {
-        val.push_back(T());
-        size += val.back().deserialize(buf + size);
-      }
+    if (n.val < -1) throw decode_error("bad array length");
+    is_null = n.val == -1;
+    // every element takes at least a byte, so a count that cannot fit is
+    // rejected before anything is allocated for it
+    if (!is_null) check_decode(buf + size, n.val);
+    msg_resize(val, is_null ? 0 : n.val);
+    for (T& e : val) {
+      size += e.deserialize(buf + size);
     }
     return size;
   }
@@ -457,10 +680,25 @@ struct sarray : public sbase {
 template <typename T,
           std::enable_if_t<std::is_base_of_v<sbase, T>, bool> = true>
 struct scarray : public sbase {
-  std::vector<T> val;
+  std::pmr::vector<T> val = std::pmr::vector<T>(msg_resource());
   bool is_null{true};
   scarray() = default;
-  explicit scarray(std::vector<T> v) : val(v), is_null(false) {}
+  explicit scarray(std::vector<T> v)
+      : val(v.begin(), v.end(), msg_resource()), is_null(false) {}
+  scarray(scarray const& o)
+      : sbase(o), val(o.val, msg_resource()), is_null(o.is_null) {}
+  scarray(scarray&&) noexcept = default;
+  scarray& operator=(scarray const& o) {
+    msg_assign(val, o.val);
+    is_null = o.is_null;
+    return *this;
+  }
+  scarray& operator=(scarray&& o) {
+    msg_assign(val, std::move(o.val));
+    is_null = o.is_null;
+    return *this;
+  }
+  T& emplace_back() { return msg_emplace_back(val); }
   int32_t serialize(int8_t* buf) override {
     int32_t size{};
     if (is_null) {
@@ -473,35 +711,144 @@ struct scarray : public sbase {
     }
     return size;
   }
+  int32_t stream(chunk_writer& w) override {
+    if (is_null) return suvint(0).stream(w);
+    return suvint(val.size() + 1).stream(w) + stream_elements(w, val);
+  }
   int32_t deserialize(int8_t* buf) override {
     int32_t size{};
     suvint n;
     size += n.deserialize(buf);
-    val.clear();
-    // null array, abort
-    if (n.val == 0) {
-      is_null = true;
-    } else {
-      is_null = false;
-      for (uint32_t i = 0; i < n.val - 1; ++i) {
-        val.push_back(T());
-        size += val.back().deserialize(buf + size);
-      }
+    is_null = n.val == 0;
+    if (!is_null) check_decode(buf + size, n.val - 1);
+    msg_resize(val, is_null ? 0 : n.val - 1);
+    for (T& e : val) {
+      size += e.deserialize(buf + size);
     }
     return size;
   }
 };
 
+// Arrays of fixed-width integers (replica lists, partition ids) kept as
+// contiguous I instead of sint* elements, so they encode in one bulk pass.
+template <typename I, std::enable_if_t<std::is_integral_v<I>, bool> = true>
+struct sfixarray : public sbase {
+  std::pmr::vector<I> val = std::pmr::vector<I>(msg_resource());
+  bool is_null{true};
+  sfixarray() = default;
+  explicit sfixarray(std::vector<I> v)
+      : val(v.begin(), v.end(), msg_resource()), is_null(false) {}
+  sfixarray(sfixarray const& o)
+      : sbase(o), val(o.val, msg_resource()), is_null(o.is_null) {}
+  sfixarray(sfixarray&&) noexcept = default;
+  sfixarray& operator=(sfixarray const& o) {
+    msg_assign(val, o.val);
+    is_null = o.is_null;
+    return *this;
+  }
+  sfixarray& operator=(sfixarray&& o) {
+    msg_assign(val, std::move(o.val));
+    is_null = o.is_null;
+    return *this;
+  }
+  int32_t serialize(int8_t* buf) override {
+    if (is_null) return sint32(-1).serialize(buf);
+    int32_t size = sint32(val.size()).serialize(buf);
+    store_big_endian(buf + size, val.data(), val.size());
+    return size + val.size() * sizeof(I);
+  }
+  int32_t stream(chunk_writer& w) override {
+    if (is_null) return sint32(-1).stream(w);
+    return sint32(val.size()).stream(w) + stream_fixed(w, val);
+  }
+  int32_t deserialize(int8_t* buf) override {
+    sint32 n;
+    int32_t size = n.deserialize(buf);
+    if (n.val < -1) throw decode_error("bad array length");
+    is_null = n.val == -1;
+    if (!is_null) check_decode(buf + size, size_t(n.val) * sizeof(I));
+    val.resize(is_null ? 0 : n.val);
+    load_big_endian(val.data(), buf + size, val.size());
+    return size + val.size() * sizeof(I);
+  }
+};
+
+template <typename I, std::enable_if_t<std::is_integral_v<I>, bool> = true>
+struct scfixarray : public sbase {
+  std::pmr::vector<I> val = std::pmr::vector<I>(msg_resource());
+  bool is_null{true};
+  scfixarray() = default;
+  explicit scfixarray(std::vector<I> v)
+      : val(v.begin(), v.end(), msg_resource()), is_null(false) {}
+  scfixarray(scfixarray const& o)
+      : sbase(o), val(o.val, msg_resource()), is_null(o.is_null) {}
+  scfixarray(scfixarray&&) noexcept = default;
+  scfixarray& operator=(scfixarray const& o) {
+    msg_assign(val, o.val);
+    is_null = o.is_null;
+    return *this;
+  }
+  scfixarray& operator=(scfixarray&& o) {
+    msg_assign(val, std::move(o.val));
+    is_null = o.is_null;
+    return *this;
+  }
+  int32_t serialize(int8_t* buf) override {
+    if (is_null) return suvint(0).serialize(buf);
+    int32_t size = suvint(val.size() + 1).serialize(buf);
+    store_big_endian(buf + size, val.data(), val.size());
+    return size + val.size() * sizeof(I);
+  }
+  int32_t stream(chunk_writer& w) override {
+    if (is_null) return suvint(0).stream(w);
+    return suvint(val.size() + 1).stream(w) + stream_fixed(w, val);
+  }
+  int32_t deserialize(int8_t* buf) override {
+    suvint n;
+    int32_t size = n.deserialize(buf);
+    is_null = n.val == 0;
+    if (!is_null) check_decode(buf + size, size_t(n.val - 1) * sizeof(I));
+    val.resize(is_null ? 0 : n.val - 1);
+    load_big_endian(val.data(), buf + size, val.size());
+    return size + val.size() * sizeof(I);
+  }
+};
+
 struct stagged_fields final : sbase {
   struct field {
     suvint tag;
-    std::vector<int8_t> data;
+    std::pmr::vector<int8_t> data = std::pmr::vector<int8_t>(msg_resource());
     field() = default;
-    field(uint32_t t, std::vector<int8_t> d) : tag{t}, data{d} {}
+    field(uint32_t t, std::vector<int8_t> d)
+        : tag{t}, data(d.begin(), d.end(), msg_resource()) {}
+    field(field const& o) : tag(o.tag), data(o.data, msg_resource()) {}
+    field(field&&) noexcept = default;
+    field& operator=(field const& o) {
+      tag = o.tag;
+      msg_assign(data, o.data);
+      return *this;
+    }
+    field& operator=(field&& o) {
+      tag = o.tag;
+      msg_assign(data, std::move(o.data));
+      return *this;
+    }
   };
-  std::vector<field> fields;
+  std::pmr::vector<field> fields = std::pmr::vector<field>(msg_resource());
   stagged_fields() = default;
-  explicit stagged_fields(std::vector<field> v) : fields(v) {}
+  explicit stagged_fields(std::vector<field> v)
+      : fields(v.begin(), v.end(), msg_resource()) {}
+  stagged_fields(stagged_fields const& o)
+      : sbase(o), fields(o.fields, msg_resource()) {}
+  stagged_fields(stagged_fields&&) noexcept = default;
+  stagged_fields& operator=(stagged_fields const& o) {
+    msg_assign(fields, o.fields);
+    return *this;
+  }
+  stagged_fields& operator=(stagged_fields&& o) {
+    msg_assign(fields, std::move(o.fields));
+    return *this;
+  }
   int32_t serialize(int8_t* buf) override {
     int32_t sz{};
     sz += suvint(fields.size()).serialize(buf + sz);
@@ -513,25 +860,162 @@ struct stagged_fields final : sbase {
     }
     return sz;
   }
+  int32_t stream(chunk_writer& w) override {
+    int32_t sz = suvint(fields.size()).stream(w);
+    for (field& f : fields) {
+      sz += f.tag.stream(w);
+      sz += stream_prefixed(w, suvint(f.data.size()), f.data.data(),
+                            f.data.size());
+    }
+    return sz;
+  }
   int32_t deserialize(int8_t* buf) override {
     int32_t sz{};
     suvint array_len;
     sz += array_len.deserialize(buf + sz);
-    fields.clear();
-    for (uint32_t i = 0; i < array_len.val; ++i) {
-      fields.push_back(field());
-      field& f = fields.back();
+    check_decode(buf + sz, array_len.val);
+    msg_resize(fields, array_len.val);
+    for (field& f : fields) {
       sz += f.tag.deserialize(buf + sz);
       suvint field_size;
       sz += field_size.deserialize(buf + sz);
-      std::cout << "field tag " << f.tag.val << " size " << field_size.val
-                << std::endl;
-      f.data.reserve(field_size.val);
-      std::copy(buf + sz, buf + sz + field_size.val, f.data.begin());
+      check_decode(buf + sz, field_size.val);
+      f.data.assign(buf + sz, buf + sz + field_size.val);
       sz += field_size.val;
     }
     return sz;
   }
 };
 
+// Tagged fields skipped by length on decode, without copying anything. raw is
+// the whole section as it came in, count prefix included, and is written back
+// verbatim. Like the string views it borrows from the frame.
+struct stagged_fields_view final : sbase {
+  std::span<int8_t> raw;
+  int32_t serialize(int8_t* buf) override {
+    if (raw.empty()) return suvint(0).serialize(buf);
+    std::copy(raw.begin(), raw.end(), buf);
+    return raw.size();
+  }
+  int32_t stream(chunk_writer& w) override {
+    if (raw.empty()) return suvint(0).stream(w);
+    w.write(raw.data(), raw.size());
+    return raw.size();
+  }
+  int32_t deserialize(int8_t* buf) override {
+    int32_t sz{};
+    suvint n;
+    sz += n.deserialize(buf + sz);
+    for (uint32_t i = 0; i < n.val; ++i) {
+      suvint tag, len;
+      sz += tag.deserialize(buf + sz);
+      sz += len.deserialize(buf + sz);
+      check_decode(buf + sz, len.val);
+      sz += len.val;
+    }
+    raw = std::span<int8_t>(buf, sz);
+    return sz;
+  }
+  // calls f(tag, data) for every field in the section
+  template <typename F>
+  void for_each(F&& f) const {
+    if (raw.empty()) return;
+    int32_t sz{};
+    suvint n;
+    sz += n.deserialize(raw.data());
+    for (uint32_t i = 0; i < n.val; ++i) {
+      suvint tag, len;
+      sz += tag.deserialize(raw.data() + sz);
+      sz += len.deserialize(raw.data() + sz);
+      f(tag.val, raw.subspan(sz, len.val));
+      sz += len.val;
+    }
+  }
+  // data of the field with the given tag, empty when it is absent
+  std::span<int8_t> find(uint32_t tag) const {
+    std::span<int8_t> found;
+    for_each([&](uint32_t t, std::span<int8_t> data) {
+      if (t == tag) found = data;
+    });
+    return found;
+  }
+};
+
+// A compact array whose elements were encoded ahead of time, written piece
+// by piece in place of the decoded elements. The pieces borrow memory the
+// caller keeps alive until the message is written. Only ever sent, so there
+// is nothing to decode into.
+struct scencoded_array {
+  std::pmr::vector<std::span<int8_t const>> pieces =
+      std::pmr::vector<std::span<int8_t const>>(msg_resource());
+  bool is_set{};
+  scencoded_array() = default;
+  scencoded_array(scencoded_array const& o)
+      : pieces(o.pieces, msg_resource()), is_set(o.is_set) {}
+  scencoded_array(scencoded_array&&) noexcept = default;
+  scencoded_array& operator=(scencoded_array const& o) {
+    msg_assign(pieces, o.pieces);
+    is_set = o.is_set;
+    return *this;
+  }
+  scencoded_array& operator=(scencoded_array&& o) {
+    msg_assign(pieces, std::move(o.pieces));
+    is_set = o.is_set;
+    return *this;
+  }
+  int32_t serialize(int8_t* buf) const {
+    int32_t sz = suvint(pieces.size() + 1).serialize(buf);
+    for (std::span<int8_t const> p : pieces) {
+      std::copy(p.begin(), p.end(), buf + sz);
+      sz += p.size();
+    }
+    return sz;
+  }
+  int32_t stream(chunk_writer& w) const {
+    int32_t sz = suvint(pieces.size() + 1).stream(w);
+    for (std::span<int8_t const> p : pieces) {
+      w.write(p.data(), p.size());
+      sz += p.size();
+    }
+    return sz;
+  }
+};
+
+// A subtree the handler never reads. It is decoded only to learn its length,
+// into a per-thread scratch object that keeps its capacity between requests,
+// and kept as raw frame bytes; decode() builds the real thing on demand.
+template <typename T,
+          std::enable_if_t<std::is_base_of_v<sbase, T>, bool> = true>
+struct sskip final : sbase {
+  std::span<int8_t> raw;
+  int32_t serialize(int8_t* buf) override {
+    if (raw.empty()) return T().serialize(buf);
+    std::copy(raw.begin(), raw.end(), buf);
+    return raw.size();
+  }
+  int32_t stream(chunk_writer& w) override {
+    if (raw.empty()) return T().stream(w);
+    w.write(raw.data(), raw.size());
+    return raw.size();
+  }
+  int32_t deserialize(int8_t* buf) override {
+    int32_t sz = scratch().deserialize(buf);
+    raw = std::span<int8_t>(buf, sz);
+    return sz;
+  }
+  T decode() const {
+    T t;
+    if (!raw.empty()) t.deserialize(raw.data());
+    return t;
+  }
+  // lives past any request, so it must not take memory from a request arena
+  static T& scratch() {
+    thread_local T t = [] {
+      msg_resource_scope scope(std::pmr::get_default_resource());
+      return T();
+    }();
+    return t;
+  }
+};
+
 #endif
@@ -10,9 +10,33 @@
 #include <memory>
 #include <ostream>
 #include <string>
+#include <vector>
 
 #include "primitive.hpp"
 
+int32_t const MAX_SVINT_SIZE = 5;
+
+// Records and their values start with their own size as a signed varint,
+// only known once the rest is written: body(b) writes behind the widest
+// possible prefix and is slid down afterwards.
+template <typename F>
+int32_t write_size_prefixed(int8_t *buf, F &&body) {
+  int32_t n = body(buf + MAX_SVINT_SIZE);
+  int32_t sz = svint(n).serialize(buf);
+  std::memmove(buf + sz, buf + MAX_SVINT_SIZE, n);
+  return sz + n;
+}
+
+// reads such a prefix, checking the size fits in the input
+inline int32_t read_size_prefix(int8_t *buf, int32_t &size) {
+  svint len;
+  int32_t sz = len.deserialize(buf);
+  if (len.val < 0) throw decode_error("negative record size");
+  check_decode(buf + sz, len.val);
+  size = len.val;
+  return sz;
+}
+
 struct record_string_t final : sbase {
   std::string val;
   bool is_null{true};
@@ -34,20 +58,37 @@ struct record_string_t final : sbase {
     svint len;
     sz += len.deserialize(buf + sz);
     val.clear();
-    if (len.val == -1) {
-      is_null = true;
-    } else {
-      val.reserve(len.val);
-      std::copy(reinterpret_cast<char *>(buf + sz),
-                reinterpret_cast<char *>(buf + sz + len.val),
-                std::back_inserter(val));
+    if (len.val < -1) throw decode_error("bad record string length");
+    is_null = len.val == -1;
+    if (!is_null) {
+      check_decode(buf + sz, len.val);
+      val.assign(reinterpret_cast<char *>(buf + sz), len.val);
       sz += len.val;
     }
     return sz;
   }
 };
 
-struct record_value_gen_t : sbase {};
+// Some record fields are tagged: they come in the tagged fields of the record
+// value, which record_value_t keeps as they are, and read_tags picks out the
+// ones a value knows.
+struct record_value_gen_t : sbase {
+  virtual void read_tags(stagged_fields &) {}
+};
+
+// decodes a tagged field's data into v
+inline void decode_tag(stagged_fields::field &f, sbase &v) {
+  decode_bounds bounds(f.data.data(), f.data.size());
+  v.deserialize(f.data.data());
+}
+
+// v encoded as the data of a tagged field
+inline stagged_fields::field encode_tag(uint32_t tag, sbase &v,
+                                        size_t max_size) {
+  std::vector<int8_t> data(max_size);
+  data.resize(v.serialize(data.data()));
+  return stagged_fields::field(tag, std::move(data));
+}
 
 // feature level record
 struct record_value_type12_t final : record_value_gen_t {
@@ -87,19 +128,22 @@ struct record_value_type2_t final : record_value_gen_t {
 
 // partition record
 struct record_value_type3_t final : record_value_gen_t {
-  sint32 paritition_id;
+  sint32 partition_id;
   suuid topic_uuid;
-  scarray<sint32> replica_array;
-  scarray<sint32> in_sync_replica_array;
-  scarray<sint32> removing_replica_array;
-  scarray<sint32> adding_replica_array;
+  scfixarray<int32_t> replica_array;
+  scfixarray<int32_t> in_sync_replica_array;
+  scfixarray<int32_t> removing_replica_array;
+  scfixarray<int32_t> adding_replica_array;
   sint32 leader;
   sint32 leader_epoch;
   sint32 partition_epoch;
   scarray<suuid> directories_array;
+  // tagged from v2, null when absent
+  scfixarray<int32_t> eligible_leader_replicas;
+  scfixarray<int32_t> last_known_elr;
   int32_t serialize(int8_t *buf) override {
     int32_t sz{};
-    sz += paritition_id.serialize(buf + sz);
+    sz += partition_id.serialize(buf + sz);
     sz += topic_uuid.serialize(buf + sz);
     sz += replica_array.serialize(buf + sz);
     sz += in_sync_replica_array.serialize(buf + sz);
@@ -113,7 +157,7 @@ struct record_value_type3_t final : record_value_gen_t {
   }
   int32_t deserialize(int8_t *buf) override {
     int32_t sz{};
-    sz += paritition_id.deserialize(buf + sz);
+    sz += partition_id.deserialize(buf + sz);
     sz += topic_uuid.deserialize(buf + sz);
     sz += replica_array.deserialize(buf + sz);
     sz += in_sync_replica_array.deserialize(buf + sz);
@@ -125,6 +169,105 @@ struct record_value_type3_t final : record_value_gen_t {
     sz += directories_array.deserialize(buf + sz);
     return sz;
   }
+  void read_tags(stagged_fields &tags) override {
+    eligible_leader_replicas.is_null = true;
+    last_known_elr.is_null = true;
+    for (stagged_fields::field &f : tags.fields) {
+      if (f.tag.val == 1) decode_tag(f, eligible_leader_replicas);
+      if (f.tag.val == 2) decode_tag(f, last_known_elr);
+    }
+  }
+};
+
+// partition change record: the partition, then only what changed, all of it
+// in tagged fields
+struct record_value_type5_t final : record_value_gen_t {
+  // the leader when it stays the same
+  static constexpr int32_t NO_LEADER_CHANGE = -2;
+
+  sint32 partition_id;
+  suuid topic_uuid;
+  // from the tagged fields; null lists are unchanged
+  scfixarray<int32_t> isr;
+  sint32 leader{NO_LEADER_CHANGE};
+  scfixarray<int32_t> replicas;
+  scfixarray<int32_t> removing_replicas;
+  scfixarray<int32_t> adding_replicas;
+  scfixarray<int32_t> eligible_leader_replicas;
+  scfixarray<int32_t> last_known_elr;
+  scarray<suuid> directories;
+  int32_t serialize(int8_t *buf) override {
+    int32_t sz{};
+    sz += partition_id.serialize(buf + sz);
+    sz += topic_uuid.serialize(buf + sz);
+    return sz;
+  }
+  int32_t deserialize(int8_t *buf) override {
+    int32_t sz{};
+    sz += partition_id.deserialize(buf + sz);
+    sz += topic_uuid.deserialize(buf + sz);
+    return sz;
+  }
+  void read_tags(stagged_fields &tags) override {
+    for (scfixarray<int32_t> *a : {&isr, &replicas, &removing_replicas,
+                                   &adding_replicas, &eligible_leader_replicas,
+                                   &last_known_elr}) {
+      a->is_null = true;
+      a->val.clear();
+    }
+    leader.val = NO_LEADER_CHANGE;
+    directories.is_null = true;
+    directories.val.clear();
+    for (stagged_fields::field &f : tags.fields) {
+      switch (f.tag.val) {
+        case 0:
+          decode_tag(f, isr);
+          break;
+        case 1:
+          decode_tag(f, leader);
+          break;
+        case 2:
+          decode_tag(f, replicas);
+          break;
+        case 3:
+          decode_tag(f, removing_replicas);
+          break;
+        case 4:
+          decode_tag(f, adding_replicas);
+          break;
+        // 5 is the leader recovery state, not kept
+        case 6:
+          decode_tag(f, eligible_leader_replicas);
+          break;
+        case 7:
+          decode_tag(f, last_known_elr);
+          break;
+        case 8:
+          decode_tag(f, directories);
+          break;
+      }
+    }
+  }
+};
+
+// remove topic record
+struct record_value_type9_t final : record_value_gen_t {
+  suuid topic_uuid;
+  int32_t serialize(int8_t *buf) override { return topic_uuid.serialize(buf); }
+  int32_t deserialize(int8_t *buf) override {
+    return topic_uuid.deserialize(buf);
+  }
+};
+
+// a record type this broker does not interpret, kept as it came in (tagged
+// fields included) so it can be written back unchanged
+struct record_value_raw_t final : record_value_gen_t {
+  std::vector<int8_t> data;
+  int32_t serialize(int8_t *buf) override {
+    std::copy(data.begin(), data.end(), buf);
+    return data.size();
+  }
+  int32_t deserialize(int8_t *) override { return 0; }
 };
 
 struct record_value_t final : sbase {
@@ -135,26 +278,30 @@ struct record_value_t final : sbase {
   std::shared_ptr<record_value_gen_t> value;
   stagged_fields tagged_fields;
   int32_t serialize(int8_t *buf) override {
-    if (!value) {
-      std::cerr << "record value is null" << std::endl;
-    }
-    int32_t sz{};
-    svint len;
-    sz += len.serialize(buf + sz);
-    sz += frame_version.serialize(buf + sz);
-    sz += type.serialize(buf + sz);
-    sz += version.serialize(buf + sz);
-    sz += value->serialize(buf + sz);
-    sz += tagged_fields.serialize(buf + sz);
-    return sz;
+    return write_size_prefixed(buf, [&](int8_t *body) {
+      int32_t sz{};
+      sz += frame_version.serialize(body + sz);
+      sz += type.serialize(body + sz);
+      sz += version.serialize(body + sz);
+      if (!value) {
+        std::cerr << "record value is null" << std::endl;
+        return sz;
+      }
+      sz += value->serialize(body + sz);
+      if (!dynamic_cast<record_value_raw_t *>(value.get()))
+        sz += tagged_fields.serialize(body + sz);
+      return sz;
+    });
   }
   int32_t deserialize(int8_t *buf) override {
-    int32_t sz{};
-    svint len;
-    sz += len.deserialize(buf + sz);
+    int32_t len;
+    int32_t sz = read_size_prefix(buf, len);
+    int32_t end = sz + len;
     sz += frame_version.deserialize(buf + sz);
     sz += type.deserialize(buf + sz);
     sz += version.deserialize(buf + sz);
+    if (sz > end) throw decode_error("record value shorter than its header");
+    tagged_fields.fields.clear();
     switch (type.val) {
       case 2:
         value.reset(new record_value_type2_t());
@@ -162,19 +309,66 @@ struct record_value_t final : sbase {
       case 3:
         value.reset(new record_value_type3_t());
         break;
+      case 5:
+        value.reset(new record_value_type5_t());
+        break;
+      case 9:
+        value.reset(new record_value_type9_t());
+        break;
       case 12:
         value.reset(new record_value_type12_t());
         break;
+      default: {
+        auto raw = std::make_shared<record_value_raw_t>();
+        raw->data.assign(buf + sz, buf + end);
+        value = raw;
+        return end;
+      }
     }
     sz += value->deserialize(buf + sz);
     sz += tagged_fields.deserialize(buf + sz);
+    if (sz > end) throw decode_error("record value longer than its size");
+    value->read_tags(tagged_fields);
+    // anything a newer version appends after the fields we know is skipped
+    return end;
+  }
+};
+
+struct record_header final : sbase {
+  record_string_t key;
+  record_string_t value;
+  int32_t serialize(int8_t *buf) override {
+    int32_t sz{};
+    sz += key.serialize(buf + sz);
+    sz += value.serialize(buf + sz);
+    return sz;
+  }
+  int32_t deserialize(int8_t *buf) override {
+    int32_t sz{};
+    sz += key.deserialize(buf + sz);
+    sz += value.deserialize(buf + sz);
     return sz;
   }
 };
 
-struct batch_header final : sbase {
-  int32_t serialize(int8_t *buf) override { return 0; }
-  int32_t deserialize(int8_t *buf) override { return 0; }
+// counted by a signed varint, not a compact array
+struct record_headers final : sbase {
+  std::vector<record_header> val;
+  int32_t serialize(int8_t *buf) override {
+    int32_t sz = svint(val.size()).serialize(buf);
+    for (record_header &h : val) sz += h.serialize(buf + sz);
+    return sz;
+  }
+  int32_t deserialize(int8_t *buf) override {
+    svint n;
+    int32_t sz = n.deserialize(buf);
+    if (n.val < 0) throw decode_error("negative header count");
+    // a header is at least its two sizes
+    check_decode(buf + sz, 2 * static_cast<size_t>(n.val));
+    val.resize(n.val);
+    for (record_header &h : val) sz += h.deserialize(buf + sz);
+    return sz;
+  }
 };
 
 struct record final : sbase {
@@ -184,23 +378,22 @@ struct record final : sbase {
   svint offset_delta;
   record_string_t key;
   record_value_t value;
-  scarray<batch_header> headers;
+  record_headers headers;
   int32_t serialize(int8_t *buf) override {
-    int32_t sz{};
-    svint len;
-    sz += len.serialize(buf + sz);
-    sz += attributes.serialize(buf + sz);
-    sz += timestamp_delta.serialize(buf + sz);
-    sz += offset_delta.serialize(buf + sz);
-    sz += key.serialize(buf + sz);
-    sz += value.serialize(buf + sz);
-    sz += headers.serialize(buf + sz);
-    return sz;
+    return write_size_prefixed(buf, [&](int8_t *body) {
+      int32_t sz{};
+      sz += attributes.serialize(body + sz);
+      sz += timestamp_delta.serialize(body + sz);
+      sz += offset_delta.serialize(body + sz);
+      sz += key.serialize(body + sz);
+      sz += value.serialize(body + sz);
+      sz += headers.serialize(body + sz);
+      return sz;
+    });
   }
   int32_t deserialize(int8_t *buf) override {
-    int32_t sz{};
-    svint len;
-    sz += len.deserialize(buf + sz);
+    int32_t len;
+    int32_t sz = read_size_prefix(buf, len);
     sz += attributes.deserialize(buf + sz);
     sz += timestamp_delta.deserialize(buf + sz);
     sz += offset_delta.deserialize(buf + sz);
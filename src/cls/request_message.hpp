@@ -10,8 +10,8 @@ struct request_header_v2 final : sbase {
   sint16 request_api_key;
   sint16 request_api_version;
   sint32 correlation_id;
-  snstring client_id;
-  stagged_fields tagged_fields;
+  snstring_view client_id;
+  stagged_fields_view tagged_fields;
   int32_t serialize(int8_t* buf) override {
     int32_t sz{};
     sz += request_api_key.serialize(buf + sz);
@@ -43,9 +43,9 @@ struct request_header_v2 final : sbase {
 
 struct request_k18_v4 final : sbase {
   request_header_v2* header;
-  scstring client_software_name;
-  scstring client_software_version;
-  stagged_fields tagged_fields;
+  scstring_view client_software_name;
+  scstring_view client_software_version;
+  stagged_fields_view tagged_fields;
   request_k18_v4(request_header_v2* h) : header(h) {}
   int32_t serialize(int8_t* buf) override {
     int32_t sz{};
@@ -64,8 +64,8 @@ struct request_k18_v4 final : sbase {
 };
 
 struct req_topic_info final : sbase {
-  scstring name;
-  stagged_fields tagged_buffer;
+  scstring_view name;
+  stagged_fields_view tagged_buffer;
   int32_t serialize(int8_t* buf) {
     int32_t sz{};
     sz += name.serialize(buf + sz);
@@ -80,12 +80,16 @@ struct req_topic_info final : sbase {
   }
 };
 
+// nullable struct: -1 for null, 1 followed by the fields otherwise
 struct topic_cursor final : sbase {
-  scstring topic_name;
+  bool is_null{true};
+  scstring_view topic_name;
   sint32 partition_index;
-  stagged_fields tagged_buffer;
+  stagged_fields_view tagged_buffer;
   int32_t serialize(int8_t* buf) {
     int32_t sz{};
+    sz += sint8(is_null ? -1 : 1).serialize(buf + sz);
+    if (is_null) return sz;
     sz += topic_name.serialize(buf + sz);
     sz += partition_index.serialize(buf + sz);
     sz += tagged_buffer.serialize(buf + sz);
@@ -93,6 +97,10 @@ struct topic_cursor final : sbase {
   }
   int32_t deserialize(int8_t* buf) {
     int32_t sz{};
+    sint8 present;
+    sz += present.deserialize(buf + sz);
+    is_null = present.val < 0;
+    if (is_null) return sz;
     sz += topic_name.deserialize(buf + sz);
     sz += partition_index.deserialize(buf + sz);
     sz += tagged_buffer.deserialize(buf + sz);
@@ -105,7 +113,7 @@ struct request_k75_v0 final : sbase {
   scarray<req_topic_info> topics;
   sint32 response_partition_limit;
   topic_cursor cursor;
-  stagged_fields tagged_buffer;
+  stagged_fields_view tagged_buffer;
   request_k75_v0(request_header_v2* h) : header(h) {}
   int32_t serialize(int8_t* buf) override {
     int32_t sz{};
@@ -118,7 +126,7 @@ struct request_k75_v0 final : sbase {
   int32_t deserialize(int8_t* buf) override {
     int32_t sz{};
     sz += topics.deserialize(buf + sz);
-    sz += response_partition_limit.serialize(buf + sz);
+    sz += response_partition_limit.deserialize(buf + sz);
     sz += cursor.deserialize(buf + sz);
     sz += tagged_buffer.deserialize(buf + sz);
     return sz;
@@ -129,16 +137,16 @@ struct k1_partition final : sbase {
   sint32 partition;
   sint32 current_leader_epoch;
   sint64 fetch_offset;
-  sint32 last_fetched_eopich;
+  sint32 last_fetched_epoch;
   sint64 log_start_offset;
   sint32 partition_max_bytes;
-  stagged_fields tagged_fields;
+  stagged_fields_view tagged_fields;
   int32_t serialize(int8_t* buf) override {
     int32_t sz{};
     sz += partition.serialize(buf + sz);
     sz += current_leader_epoch.serialize(buf + sz);
     sz += fetch_offset.serialize(buf + sz);
-    sz += last_fetched_eopich.serialize(buf + sz);
+    sz += last_fetched_epoch.serialize(buf + sz);
     sz += log_start_offset.serialize(buf + sz);
     sz += partition_max_bytes.serialize(buf + sz);
     sz += tagged_fields.serialize(buf + sz);
@@ -149,7 +157,7 @@ struct k1_partition final : sbase {
     sz += partition.deserialize(buf + sz);
     sz += current_leader_epoch.deserialize(buf + sz);
     sz += fetch_offset.deserialize(buf + sz);
-    sz += last_fetched_eopich.deserialize(buf + sz);
+    sz += last_fetched_epoch.deserialize(buf + sz);
     sz += log_start_offset.deserialize(buf + sz);
     sz += partition_max_bytes.deserialize(buf + sz);
     sz += tagged_fields.deserialize(buf + sz);
@@ -160,7 +168,7 @@ struct k1_partition final : sbase {
 struct k1_topic final : sbase {
   suuid topic_id;
   scarray<k1_partition> partitions;
-  stagged_fields tagged_fields;
+  stagged_fields_view tagged_fields;
   int32_t serialize(int8_t* buf) override {
     int32_t sz{};
     sz += topic_id.serialize(buf + sz);
@@ -179,8 +187,8 @@ struct k1_topic final : sbase {
 
 struct k1_forgotten_topic_data final : sbase {
   suuid topic_id;
-  scarray<sint32> partitions;
-  stagged_fields tagged_fields;
+  scfixarray<int32_t> partitions;
+  stagged_fields_view tagged_fields;
   int32_t serialize(int8_t* buf) override {
     int32_t sz{};
     sz += topic_id.serialize(buf + sz);
@@ -206,9 +214,9 @@ struct request_k1_v16 final : sbase {
   sint32 session_id;
   sint32 session_epoch;
   scarray<k1_topic> topics;
-  scarray<k1_forgotten_topic_data> forgotten_topic_data;
-  scstring rack_id;
-  stagged_fields tagged_fields;
+  sskip<scarray<k1_forgotten_topic_data>> forgotten_topic_data;
+  scstring_view rack_id;
+  stagged_fields_view tagged_fields;
   explicit request_k1_v16(request_header_v2* h) : header(h) {}
   int32_t serialize(int8_t* buf) override {
     int32_t sz{};
@@ -240,4 +248,73 @@ struct request_k1_v16 final : sbase {
   }
 };
 
+// Metadata, versions 9 to 12: what differs between them goes by the header's
+// version, which the topics are given before they are encoded or decoded
+struct req_k3_topic final : sbase {
+  int16_t version{};
+  suuid topic_id;
+  scnstring_view name;
+  stagged_fields_view tagged_buffer;
+  int32_t serialize(int8_t* buf) override {
+    int32_t sz{};
+    if (version >= 10) sz += topic_id.serialize(buf + sz);
+    sz += name.serialize(buf + sz);
+    sz += tagged_buffer.serialize(buf + sz);
+    return sz;
+  }
+  int32_t deserialize(int8_t* buf) override {
+    int32_t sz{};
+    topic_id = suuid();
+    if (version >= 10) sz += topic_id.deserialize(buf + sz);
+    sz += name.deserialize(buf + sz);
+    sz += tagged_buffer.deserialize(buf + sz);
+    return sz;
+  }
+};
+
+struct request_k3 final : sbase {
+  request_header_v2* header;
+  // null for all topics
+  scarray<req_k3_topic> topics;
+  sbool allow_auto_topic_creation{false};
+  // up to v10
+  sbool include_cluster_authorized_operations{false};
+  sbool include_topic_authorized_operations{false};
+  stagged_fields_view tagged_buffer;
+  explicit request_k3(request_header_v2* h) : header(h) {}
+  int16_t version() const { return header->request_api_version.val; }
+  int32_t serialize(int8_t* buf) override {
+    int32_t sz{};
+    for (req_k3_topic& t : topics.val) t.version = version();
+    sz += topics.serialize(buf + sz);
+    sz += allow_auto_topic_creation.serialize(buf + sz);
+    if (version() <= 10) {
+      sz += include_cluster_authorized_operations.serialize(buf + sz);
+    }
+    sz += include_topic_authorized_operations.serialize(buf + sz);
+    sz += tagged_buffer.serialize(buf + sz);
+    return sz;
+  }
+  int32_t deserialize(int8_t* buf) override {
+    int32_t sz{};
+    suvint n;
+    sz += n.deserialize(buf + sz);
+    topics.is_null = n.val == 0;
+    if (!topics.is_null) check_decode(buf + sz, n.val - 1);
+    msg_resize(topics.val, topics.is_null ? 0 : n.val - 1);
+    for (req_k3_topic& t : topics.val) {
+      t.version = version();
+      sz += t.deserialize(buf + sz);
+    }
+    sz += allow_auto_topic_creation.deserialize(buf + sz);
+    include_cluster_authorized_operations.val = false;
+    if (version() <= 10) {
+      sz += include_cluster_authorized_operations.deserialize(buf + sz);
+    }
+    sz += include_topic_authorized_operations.deserialize(buf + sz);
+    sz += tagged_buffer.deserialize(buf + sz);
+    return sz;
+  }
+};
+
 #endif
@@ -3,8 +3,11 @@
 #include <iostream>
 #include <sched.h>
 
+#include <array>
 #include <cstdint>
 #include <cstring>
+#include <memory>
+#include <span>
 #include <scoped_allocator>
 
 #include "./primitive.hpp"
@@ -32,6 +35,12 @@ struct response_header_v1 final : sbase {
     sz += tagged_fields.serialize(buf + sz);
     return sz;
   }
+  int32_t stream(chunk_writer& w) override {
+    int32_t sz{};
+    sz += correlation_id.stream(w);
+    sz += tagged_fields.stream(w);
+    return sz;
+  }
   int32_t deserialize(int8_t* buf) override {
     int32_t sz{};
     sz += correlation_id.deserialize(buf + sz);
@@ -56,6 +65,14 @@ struct version_info final : sbase {
     sz += tagged_buffer.serialize(buf + sz);
     return sz;
   }
+  int32_t stream(chunk_writer& w) override {
+    int32_t sz{};
+    sz += api_key.stream(w);
+    sz += min_version.stream(w);
+    sz += max_version.stream(w);
+    sz += tagged_buffer.stream(w);
+    return sz;
+  }
   int32_t deserialize(int8_t* buf) override {
     int32_t sz{};
     sz += api_key.deserialize(buf + sz);
@@ -82,6 +99,15 @@ struct response_k18_v4 final : sbase {
     sz += tagged_buffer.serialize(buf + sz);
     return sz;
   }
+  int32_t stream(chunk_writer& w) override {
+    int32_t sz{};
+    sz += header->stream(w);
+    sz += error_code.stream(w);
+    sz += version_infos.stream(w);
+    sz += throttle_time_ms.stream(w);
+    sz += tagged_buffer.stream(w);
+    return sz;
+  }
   int32_t deserialize(int8_t* buf) override {
     int32_t sz{};
     sz += header->deserialize(buf + sz);
@@ -98,11 +124,11 @@ struct res_partition final : sbase {
   sint32 partition_index;
   sint32 leader_id;
   sint32 leader_epoch;
-  scarray<sint32> replica_nodes;
-  scarray<sint32> isr_nodes;
-  scarray<sint32> eligible_leader_replicas;
-  scarray<sint32> last_known_elr;
-  scarray<sint32> offline_replicas;
+  scfixarray<int32_t> replica_nodes;
+  scfixarray<int32_t> isr_nodes;
+  scfixarray<int32_t> eligible_leader_replicas;
+  scfixarray<int32_t> last_known_elr;
+  scfixarray<int32_t> offline_replicas;
   stagged_fields tagged_fields;
   int32_t serialize(int8_t* buf) override {
     int32_t sz{};
@@ -118,6 +144,32 @@ struct res_partition final : sbase {
     sz += tagged_fields.serialize(buf + sz);
     return sz;
   }
+  // upper bound of the encoding when there are no tagged fields
+  size_t max_size() const {
+    size_t ids = replica_nodes.val.size() + isr_nodes.val.size() +
+                 eligible_leader_replicas.val.size() +
+                 last_known_elr.val.size() + offline_replicas.val.size();
+    return 14 + 5 * suvint::MAX_SIZE + ids * sizeof(int32_t) + 1;
+  }
+  int32_t stream(chunk_writer& w) override {
+    // one of many per topic and nearly always small: in one piece if it can
+    if (tagged_fields.fields.empty() &&
+        max_size() <= chunk_writer::MAX_INLINE_SIZE) {
+      return sbase::stream(w);
+    }
+    int32_t sz{};
+    sz += error_code.stream(w);
+    sz += partition_index.stream(w);
+    sz += leader_id.stream(w);
+    sz += leader_epoch.stream(w);
+    sz += replica_nodes.stream(w);
+    sz += isr_nodes.stream(w);
+    sz += eligible_leader_replicas.stream(w);
+    sz += last_known_elr.stream(w);
+    sz += offline_replicas.stream(w);
+    sz += tagged_fields.stream(w);
+    return sz;
+  }
   int32_t deserialize(int8_t* buf) override {
     int32_t sz{};
     sz += error_code.deserialize(buf + sz);
@@ -140,19 +192,45 @@ struct res_topic_info final : sbase {
   suuid topic_id;
   sbool is_internal;
   scarray<res_partition> partitions;
+  // sent instead of partitions when set
+  scencoded_array encoded_partitions;
   sint32 topic_authorized_operations;
   stagged_fields tagged_buffer;
+  // the whole topic encoded ahead of time, sent instead of all of the above
+  // when not empty; borrowed like encoded_partitions
+  std::span<int8_t const> encoded;
   int32_t serialize(int8_t* buf) override {
+    if (!encoded.empty()) {
+      std::copy(encoded.begin(), encoded.end(), buf);
+      return encoded.size();
+    }
     int32_t sz{};
     sz += error_code.serialize(buf + sz);
     sz += name.serialize(buf + sz);
     sz += topic_id.serialize(buf + sz);
     sz += is_internal.serialize(buf + sz);
-    sz += partitions.serialize(buf + sz);
+    sz += encoded_partitions.is_set ? encoded_partitions.serialize(buf + sz)
+                                    : partitions.serialize(buf + sz);
     sz += topic_authorized_operations.serialize(buf + sz);
     sz += tagged_buffer.serialize(buf + sz);
     return sz;
   }
+  int32_t stream(chunk_writer& w) override {
+    if (!encoded.empty()) {
+      w.write(encoded.data(), encoded.size());
+      return encoded.size();
+    }
+    int32_t sz{};
+    sz += error_code.stream(w);
+    sz += name.stream(w);
+    sz += topic_id.stream(w);
+    sz += is_internal.stream(w);
+    sz += encoded_partitions.is_set ? encoded_partitions.stream(w)
+                                    : partitions.stream(w);
+    sz += topic_authorized_operations.stream(w);
+    sz += tagged_buffer.stream(w);
+    return sz;
+  }
   int32_t deserialize(int8_t* buf) override {
     int32_t sz{};
     sz += error_code.deserialize(buf + sz);
@@ -166,24 +244,36 @@ struct res_topic_info final : sbase {
   }
 };
 
+// nullable struct: -1 for null, 1 followed by the fields otherwise
 struct res_topic_next_cursor final : sbase {
-  bool is_null;
+  bool is_null{true};
   scstring topic_name;
   sint32 partition_index;
   stagged_fields tagged_buffer;
   int32_t serialize(int8_t* buf) override {
     int32_t sz{};
-    if (is_null) {
-      sz += sint8(-1).serialize(buf + sz);
-    } else {
-      sz += topic_name.serialize(buf + sz);
-      sz += partition_index.serialize(buf + sz);
-      sz += tagged_buffer.serialize(buf + sz);
-    }
+    sz += sint8(is_null ? -1 : 1).serialize(buf + sz);
+    if (is_null) return sz;
+    sz += topic_name.serialize(buf + sz);
+    sz += partition_index.serialize(buf + sz);
+    sz += tagged_buffer.serialize(buf + sz);
+    return sz;
+  }
+  int32_t stream(chunk_writer& w) override {
+    int32_t sz{};
+    sz += sint8(is_null ? -1 : 1).stream(w);
+    if (is_null) return sz;
+    sz += topic_name.stream(w);
+    sz += partition_index.stream(w);
+    sz += tagged_buffer.stream(w);
     return sz;
   }
   int32_t deserialize(int8_t* buf) override {
     int32_t sz{};
+    sint8 present;
+    sz += present.deserialize(buf + sz);
+    is_null = present.val < 0;
+    if (is_null) return sz;
     sz += topic_name.deserialize(buf + sz);
     sz += partition_index.deserialize(buf + sz);
     sz += tagged_buffer.deserialize(buf + sz);
@@ -197,6 +287,9 @@ struct response_k75_v0 final : sbase {
   scarray<res_topic_info> topics;
   res_topic_next_cursor next_cursor;
   stagged_fields tagged_buffer;
+  // what the encoded topics and partitions point into, until the response
+  // is written
+  std::shared_ptr<void const> keep_alive;
   explicit response_k75_v0(response_header_v1* h) : header(h) {}
   int32_t serialize(int8_t* buf) override {
     int32_t sz{};
@@ -207,13 +300,22 @@ struct response_k75_v0 final : sbase {
     sz += tagged_buffer.serialize(buf + sz);
     return sz;
   }
+  int32_t stream(chunk_writer& w) override {
+    int32_t sz{};
+    sz += header->stream(w);
+    sz += throttle_time_ms.stream(w);
+    sz += topics.stream(w);
+    sz += next_cursor.stream(w);
+    sz += tagged_buffer.stream(w);
+    return sz;
+  }
   int32_t deserialize(int8_t* buf) override {
     int32_t sz{};
-    sz += header->serialize(buf + sz);
-    sz += throttle_time_ms.serialize(buf + sz);
-    sz += topics.serialize(buf + sz);
-    sz += next_cursor.serialize(buf + sz);
-    sz += tagged_buffer.serialize(buf + sz);
+    sz += header->deserialize(buf + sz);
+    sz += throttle_time_ms.deserialize(buf + sz);
+    sz += topics.deserialize(buf + sz);
+    sz += next_cursor.deserialize(buf + sz);
+    sz += tagged_buffer.deserialize(buf + sz);
     return sz;
   }
 };
@@ -229,6 +331,13 @@ struct k1_aborted_transaction final : sbase {
     sz += tagged_fields.serialize(buf + sz);
     return sz;
   }
+  int32_t stream(chunk_writer& w) override {
+    int32_t sz{};
+    sz += producer_id.stream(w);
+    sz += first_offset.stream(w);
+    sz += tagged_fields.stream(w);
+    return sz;
+  }
   int32_t deserialize(int8_t* buf) override {
     int32_t sz{};
     sz += producer_id.deserialize(buf + sz);
@@ -261,6 +370,19 @@ struct res_k1_partition final : sbase {
     sz += tagged_fields.serialize(buf + sz);
     return sz;
   }
+  int32_t stream(chunk_writer& w) override {
+    int32_t sz{};
+    sz += partition_index.stream(w);
+    sz += error_code.stream(w);
+    sz += high_watermark.stream(w);
+    sz += last_stable_offset.stream(w);
+    sz += log_start_offset.stream(w);
+    sz += aborted_transaction.stream(w);
+    sz += preferred_read_replica.stream(w);
+    sz += records.stream(w);
+    sz += tagged_fields.stream(w);
+    return sz;
+  }
   int32_t deserialize(int8_t* buf) override {
     int32_t sz{};
     sz += partition_index.deserialize(buf + sz);
@@ -276,7 +398,7 @@ struct res_k1_partition final : sbase {
   }
 };
 
-struct k1_reponse final : sbase {
+struct k1_response final : sbase {
   suuid topic_id;
   scarray<res_k1_partition> partitions;
   stagged_fields tagged_fields;
@@ -284,14 +406,21 @@ struct k1_reponse final : sbase {
     int32_t sz{};
     sz += topic_id.serialize(buf + sz);
     sz += partitions.serialize(buf + sz);
-    sz += tagged_fields.serialize(buf);
+    sz += tagged_fields.serialize(buf + sz);
+    return sz;
+  }
+  int32_t stream(chunk_writer& w) override {
+    int32_t sz{};
+    sz += topic_id.stream(w);
+    sz += partitions.stream(w);
+    sz += tagged_fields.stream(w);
     return sz;
   }
   int32_t deserialize(int8_t* buf) {
     int32_t sz{};
     sz += topic_id.deserialize(buf + sz);
     sz += partitions.deserialize(buf + sz);
-    sz += tagged_fields.deserialize(buf);
+    sz += tagged_fields.deserialize(buf + sz);
     return sz;
   }
 };
@@ -301,7 +430,7 @@ struct response_k1_v16 final : sbase {
   sint32 throttle_time_ms;
   sint16 error_code;
   sint32 session_id;
-  scarray<k1_reponse> responses;
+  scarray<k1_response> responses;
   stagged_fields tagged_fields;
   explicit response_k1_v16(response_header_v1* h) : header(h) {}
   int32_t serialize(int8_t* buf) override {
@@ -314,6 +443,16 @@ struct response_k1_v16 final : sbase {
     sz += tagged_fields.serialize(buf + sz);
     return sz;
   }
+  int32_t stream(chunk_writer& w) override {
+    int32_t sz{};
+    sz += header->stream(w);
+    sz += throttle_time_ms.stream(w);
+    sz += error_code.stream(w);
+    sz += session_id.stream(w);
+    sz += responses.stream(w);
+    sz += tagged_fields.stream(w);
+    return sz;
+  }
   int32_t deserialize(int8_t* buf) override {
     int32_t sz{};
     sz += header->deserialize(buf + sz);
@@ -326,9 +465,250 @@ struct response_k1_v16 final : sbase {
   }
 };
 
+// Metadata, versions 9 to 12, see request_k3
+struct res_k3_broker final : sbase {
+  sint32 node_id;
+  scstring host;
+  sint32 port;
+  scnstring rack;
+  stagged_fields tagged_fields;
+  int32_t serialize(int8_t* buf) override {
+    int32_t sz{};
+    sz += node_id.serialize(buf + sz);
+    sz += host.serialize(buf + sz);
+    sz += port.serialize(buf + sz);
+    sz += rack.serialize(buf + sz);
+    sz += tagged_fields.serialize(buf + sz);
+    return sz;
+  }
+  int32_t stream(chunk_writer& w) override {
+    int32_t sz{};
+    sz += node_id.stream(w);
+    sz += host.stream(w);
+    sz += port.stream(w);
+    sz += rack.stream(w);
+    sz += tagged_fields.stream(w);
+    return sz;
+  }
+  int32_t deserialize(int8_t* buf) override {
+    int32_t sz{};
+    sz += node_id.deserialize(buf + sz);
+    sz += host.deserialize(buf + sz);
+    sz += port.deserialize(buf + sz);
+    sz += rack.deserialize(buf + sz);
+    sz += tagged_fields.deserialize(buf + sz);
+    return sz;
+  }
+};
+
+struct res_k3_partition final : sbase {
+  sint16 error_code;
+  sint32 partition_index;
+  sint32 leader_id;
+  sint32 leader_epoch;
+  scfixarray<int32_t> replica_nodes;
+  scfixarray<int32_t> isr_nodes;
+  scfixarray<int32_t> offline_replicas;
+  stagged_fields tagged_fields;
+  int32_t serialize(int8_t* buf) override {
+    int32_t sz{};
+    sz += error_code.serialize(buf + sz);
+    sz += partition_index.serialize(buf + sz);
+    sz += leader_id.serialize(buf + sz);
+    sz += leader_epoch.serialize(buf + sz);
+    sz += replica_nodes.serialize(buf + sz);
+    sz += isr_nodes.serialize(buf + sz);
+    sz += offline_replicas.serialize(buf + sz);
+    sz += tagged_fields.serialize(buf + sz);
+    return sz;
+  }
+  // upper bound of the encoding when there are no tagged fields
+  size_t max_size() const {
+    size_t ids = replica_nodes.val.size() + isr_nodes.val.size() +
+                 offline_replicas.val.size();
+    return 14 + 3 * suvint::MAX_SIZE + ids * sizeof(int32_t) + 1;
+  }
+  int32_t stream(chunk_writer& w) override {
+    if (tagged_fields.fields.empty() &&
+        max_size() <= chunk_writer::MAX_INLINE_SIZE) {
+      return sbase::stream(w);
+    }
+    int32_t sz{};
+    sz += error_code.stream(w);
+    sz += partition_index.stream(w);
+    sz += leader_id.stream(w);
+    sz += leader_epoch.stream(w);
+    sz += replica_nodes.stream(w);
+    sz += isr_nodes.stream(w);
+    sz += offline_replicas.stream(w);
+    sz += tagged_fields.stream(w);
+    return sz;
+  }
+  int32_t deserialize(int8_t* buf) override {
+    int32_t sz{};
+    sz += error_code.deserialize(buf + sz);
+    sz += partition_index.deserialize(buf + sz);
+    sz += leader_id.deserialize(buf + sz);
+    sz += leader_epoch.deserialize(buf + sz);
+    sz += replica_nodes.deserialize(buf + sz);
+    sz += isr_nodes.deserialize(buf + sz);
+    sz += offline_replicas.deserialize(buf + sz);
+    sz += tagged_fields.deserialize(buf + sz);
+    return sz;
+  }
+};
+
+struct res_k3_topic final : sbase {
+  int16_t version{};
+  sint16 error_code;
+  scnstring name;
+  // from v10
+  suuid topic_id;
+  sbool is_internal{false};
+  scarray<res_k3_partition> partitions;
+  sint32 topic_authorized_operations;
+  stagged_fields tagged_fields;
+  // when not empty, the topic from error_code through partitions encoded
+  // ahead of time with its topic_id at encoded_id_at, sent in place of those
+  // fields; borrowed like res_topic_info::encoded
+  std::span<int8_t const> encoded;
+  size_t encoded_id_at{};
+  int32_t serialize(int8_t* buf) override {
+    int32_t sz{};
+    if (!encoded.empty()) {
+      for (std::span<int8_t const> piece : encoded_pieces()) {
+        std::copy(piece.begin(), piece.end(), buf + sz);
+        sz += piece.size();
+      }
+    } else {
+      sz += error_code.serialize(buf + sz);
+      sz += name.serialize(buf + sz);
+      if (version >= 10) sz += topic_id.serialize(buf + sz);
+      sz += is_internal.serialize(buf + sz);
+      sz += partitions.serialize(buf + sz);
+    }
+    sz += topic_authorized_operations.serialize(buf + sz);
+    sz += tagged_fields.serialize(buf + sz);
+    return sz;
+  }
+  int32_t stream(chunk_writer& w) override {
+    int32_t sz{};
+    if (!encoded.empty()) {
+      for (std::span<int8_t const> piece : encoded_pieces()) {
+        w.write(piece.data(), piece.size());
+        sz += piece.size();
+      }
+    } else {
+      sz += error_code.stream(w);
+      sz += name.stream(w);
+      if (version >= 10) sz += topic_id.stream(w);
+      sz += is_internal.stream(w);
+      sz += partitions.stream(w);
+    }
+    sz += topic_authorized_operations.stream(w);
+    sz += tagged_fields.stream(w);
+    return sz;
+  }
+  int32_t deserialize(int8_t* buf) override {
+    int32_t sz{};
+    encoded = {};
+    sz += error_code.deserialize(buf + sz);
+    sz += name.deserialize(buf + sz);
+    topic_id = suuid();
+    if (version >= 10) sz += topic_id.deserialize(buf + sz);
+    sz += is_internal.deserialize(buf + sz);
+    sz += partitions.deserialize(buf + sz);
+    sz += topic_authorized_operations.deserialize(buf + sz);
+    sz += tagged_fields.deserialize(buf + sz);
+    return sz;
+  }
+  // encoded without the topic id before v10
+  std::array<std::span<int8_t const>, 2> encoded_pieces() const {
+    size_t id_end = encoded_id_at + sizeof(topic_id.val);
+    return {encoded.first(version >= 10 ? id_end : encoded_id_at),
+            encoded.subspan(id_end)};
+  }
+};
+
+struct response_k3 final : sbase {
+  response_header_v1* header;
+  int16_t version{};
+  sint32 throttle_time_ms;
+  scarray<res_k3_broker> brokers;
+  scnstring cluster_id;
+  sint32 controller_id;
+  scarray<res_k3_topic> topics;
+  // up to v10
+  sint32 cluster_authorized_operations;
+  stagged_fields tagged_fields;
+  // what the encoded topics point into, until the response is written
+  std::shared_ptr<void const> keep_alive;
+  explicit response_k3(response_header_v1* h) : header(h) {}
+  int32_t serialize(int8_t* buf) override {
+    for (res_k3_topic& t : topics.val) t.version = version;
+    int32_t sz{};
+    sz += header->serialize(buf + sz);
+    sz += throttle_time_ms.serialize(buf + sz);
+    sz += brokers.serialize(buf + sz);
+    sz += cluster_id.serialize(buf + sz);
+    sz += controller_id.serialize(buf + sz);
+    sz += topics.serialize(buf + sz);
+    if (version <= 10) sz += cluster_authorized_operations.serialize(buf + sz);
+    sz += tagged_fields.serialize(buf + sz);
+    return sz;
+  }
+  int32_t stream(chunk_writer& w) override {
+    for (res_k3_topic& t : topics.val) t.version = version;
+    int32_t sz{};
+    sz += header->stream(w);
+    sz += throttle_time_ms.stream(w);
+    sz += brokers.stream(w);
+    sz += cluster_id.stream(w);
+    sz += controller_id.stream(w);
+    sz += topics.stream(w);
+    if (version <= 10) sz += cluster_authorized_operations.stream(w);
+    sz += tagged_fields.stream(w);
+    return sz;
+  }
+  int32_t deserialize(int8_t* buf) override {
+    int32_t sz{};
+    sz += header->deserialize(buf + sz);
+    sz += throttle_time_ms.deserialize(buf + sz);
+    sz += brokers.deserialize(buf + sz);
+    sz += cluster_id.deserialize(buf + sz);
+    sz += controller_id.deserialize(buf + sz);
+    suvint n;
+    sz += n.deserialize(buf + sz);
+    topics.is_null = n.val == 0;
+    if (!topics.is_null) check_decode(buf + sz, n.val - 1);
+    msg_resize(topics.val, topics.is_null ? 0 : n.val - 1);
+    for (res_k3_topic& t : topics.val) {
+      t.version = version;
+      sz += t.deserialize(buf + sz);
+    }
+    if (version <= 10) {
+      sz += cluster_authorized_operations.deserialize(buf + sz);
+    }
+    sz += tagged_fields.deserialize(buf + sz);
+    return sz;
+  }
+};
+
 inline int32_t write_message(int8_t* buf, sbase* msg) {
   sint32 size{msg->serialize(buf + sizeof(int32_t))};
   size.serialize(buf);
   return size.val + sizeof(int32_t);
 }
+
+// write_message without a bound on the response size: the size prefix is
+// left blank and patched in once the message is in the chunks
+inline int32_t stream_message(chunk_writer& w, sbase* msg) {
+  chunk_writer::position at = w.tell();
+  int8_t size[sizeof(int32_t)]{};
+  w.write(size, sizeof(size));
+  int32_t n = msg->stream(w);
+  store_big_endian(size, n);
+  w.patch(at, size, sizeof(size));
+  return n + sizeof(int32_t);
+}
 #endif
@@ -0,0 +1,80 @@
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "hexutil.hpp"
+#include "primitive.hpp"
+
+// Checks shared by the fuzz targets. A target hands arbitrary bytes to a
+// decoder, which must either reject them with decode_error or accept them;
+// whatever it accepts must encode to a canonical form that decodes whole and
+// encodes back to the very same bytes.
+
+// bytes of data m decodes, -1 when it rejects them
+template <typename M>
+int32_t fuzz_decode(M& m, int8_t* data, size_t size) {
+  decode_bounds bounds(data, size);
+  try {
+    return m.deserialize(data);
+  } catch (decode_error const&) {
+    return -1;
+  }
+}
+
+// the canonical form of an input is never longer than the input itself, the
+// slack only covers encoders that write ahead before sliding bytes down
+template <typename M>
+std::vector<int8_t> fuzz_encode(M& m, size_t hint) {
+  std::vector<int8_t> out(2 * hint + 64);
+  out.resize(m.serialize(out.data()));
+  return out;
+}
+
+[[noreturn]] inline void fuzz_fail(char const* what,
+                                   std::vector<int8_t> const& a,
+                                   std::vector<int8_t> const& b) {
+  std::fprintf(stderr, "%s\n  %s\n  %s\n", what,
+               tohex(a.data(), a.size()).c_str(),
+               tohex(b.data(), b.size()).c_str());
+  std::abort();
+}
+
+// decodes data into first and checks its encoding is canonical by decoding
+// it again into second; the canonical bytes, empty when data is rejected
+template <typename M>
+std::vector<int8_t> fuzz_round_trip(M& first, M& second, int8_t* data,
+                                    size_t size, int32_t* consumed = nullptr) {
+  int32_t n = fuzz_decode(first, data, size);
+  if (consumed) *consumed = n;
+  if (n < 0) return {};
+  std::vector<int8_t> a = fuzz_encode(first, size);
+  if (fuzz_decode(second, a.data(), a.size()) != int32_t(a.size()))
+    fuzz_fail("canonical encoding does not decode whole", a, {});
+  std::vector<int8_t> b = fuzz_encode(second, a.size());
+  if (a != b) fuzz_fail("encoding is not stable", a, b);
+  return a;
+}
+
+// the generated codec G is the reference for the hand-written H: it has to
+// read H's canonical bytes, and H has to carry G's canonical bytes through
+// unchanged. G may still reject what H takes as opaque, e.g. the contents of
+// a tagged field only G interprets.
+template <typename G, typename H>
+void fuzz_differential(std::vector<int8_t>& canonical, G& gen, H& hand) {
+  int32_t n = fuzz_decode(gen, canonical.data(), canonical.size());
+  if (n < 0) return;
+  if (n != int32_t(canonical.size()))
+    fuzz_fail("generated codec reads a different length", canonical, {});
+  std::vector<int8_t> g = fuzz_encode(gen, canonical.size());
+  if (fuzz_decode(hand, g.data(), g.size()) != int32_t(g.size()))
+    fuzz_fail("hand-written codec rejects generated bytes", canonical, g);
+  std::vector<int8_t> h = fuzz_encode(hand, g.size());
+  if (g != h) fuzz_fail("codecs disagree", g, h);
+}
+
+#endif
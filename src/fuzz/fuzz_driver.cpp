@@ -0,0 +1,108 @@
+// Stand-in for libFuzzer's main when the targets are built without it. Every
+// file named on the command line, and every file of a named directory, is fed
+// to the target once, which also serves AFL (afl-fuzz ... -- ./target @@).
+// -mutations=N additionally feeds N variants of each input, mutated from a
+// fixed seed so a failing run can be repeated. Ends with the corpus
+// throughput.
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const* data, size_t size);
+
+namespace {
+
+// xorshift64, good enough to pick bytes and offsets
+struct prng {
+  uint64_t s{0x9e3779b97f4a7c15};
+  uint64_t next() {
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return s;
+  }
+  size_t below(size_t n) { return n ? next() % n : 0; }
+};
+
+// values that tend to sit on length and varint boundaries
+uint8_t const INTERESTING[] = {0x00, 0x01, 0x7f, 0x80, 0xfe, 0xff};
+
+void mutate(std::vector<uint8_t>& v, prng& r) {
+  for (size_t ops = 1 + r.below(4); ops > 0; --ops) {
+    switch (r.below(5)) {
+      case 0:
+        if (!v.empty()) v[r.below(v.size())] ^= 1 << r.below(8);
+        break;
+      case 1:
+        if (!v.empty())
+          v[r.below(v.size())] = INTERESTING[r.below(sizeof(INTERESTING))];
+        break;
+      case 2:
+        v.resize(r.below(v.size() + 1));
+        break;
+      case 3:
+        v.insert(v.begin() + r.below(v.size() + 1), uint8_t(r.next()));
+        break;
+      case 4:
+        if (!v.empty()) v.erase(v.begin() + r.below(v.size()));
+        break;
+    }
+  }
+}
+
+std::vector<uint8_t> read_file(std::filesystem::path const& p) {
+  std::ifstream f(p, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(f), {});
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  size_t mutations{};
+  std::vector<std::filesystem::path> inputs;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.starts_with("-mutations=")) {
+      mutations = std::strtoull(arg.c_str() + 11, nullptr, 10);
+    } else if (std::filesystem::is_directory(arg)) {
+      for (auto const& d : std::filesystem::directory_iterator(arg))
+        if (d.is_regular_file()) inputs.push_back(d.path());
+    } else {
+      inputs.emplace_back(arg);
+    }
+  }
+  if (inputs.empty()) {
+    std::fprintf(stderr, "usage: %s [-mutations=N] file|dir...\n", argv[0]);
+    return 1;
+  }
+
+  prng r;
+  size_t execs{}, bytes{};
+  auto start = std::chrono::steady_clock::now();
+  for (auto const& p : inputs) {
+    std::vector<uint8_t> seed = read_file(p);
+    LLVMFuzzerTestOneInput(seed.data(), seed.size());
+    ++execs;
+    bytes += seed.size();
+    for (size_t i = 0; i < mutations; ++i) {
+      std::vector<uint8_t> v = seed;
+      mutate(v, r);
+      LLVMFuzzerTestOneInput(v.data(), v.size());
+      ++execs;
+      bytes += v.size();
+    }
+  }
+  double secs = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  std::printf("%zu inputs, %zu execs in %.3fs: %.0f execs/s, %.2f MB/s\n",
+              inputs.size(), execs, secs, execs / secs, bytes / secs / 1e6);
+  return 0;
+}
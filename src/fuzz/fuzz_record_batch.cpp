@@ -0,0 +1,22 @@
+// a metadata or partition log file, read batch after batch the way
+// initialize() does
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "fuzz.hpp"
+#include "record.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const* data, size_t size) {
+  std::vector<int8_t> in(data, data + size);
+  size_t offset{};
+  while (offset < in.size()) {
+    record_batch first, second;
+    int32_t n;
+    fuzz_round_trip(first, second, in.data() + offset, in.size() - offset, &n);
+    // a torn batch ends the file
+    if (n <= 0) break;
+    offset += n;
+  }
+  return 0;
+}
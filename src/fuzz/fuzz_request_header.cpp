@@ -0,0 +1,19 @@
+// request_header_v2 against the generated request_header<2>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "fuzz.hpp"
+#include "request_header.hpp"
+#include "request_message.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const* data, size_t size) {
+  std::vector<int8_t> in(data, data + size);
+  request_header_v2 first, second, hand;
+  std::vector<int8_t> canonical =
+      fuzz_round_trip(first, second, in.data(), in.size());
+  if (canonical.empty()) return 0;
+  request_header<2> gen;
+  fuzz_differential(canonical, gen, hand);
+  return 0;
+}
@@ -0,0 +1,21 @@
+// Fetch request body, after the header, against the generated
+// fetch_request<16>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "fetch_request.hpp"
+#include "fuzz.hpp"
+#include "request_message.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const* data, size_t size) {
+  std::vector<int8_t> in(data, data + size);
+  request_header_v2 header;
+  request_k1_v16 first(&header), second(&header), hand(&header);
+  std::vector<int8_t> canonical =
+      fuzz_round_trip(first, second, in.data(), in.size());
+  if (canonical.empty()) return 0;
+  fetch_request<16> gen;
+  fuzz_differential(canonical, gen, hand);
+  return 0;
+}
@@ -0,0 +1,21 @@
+// DescribeTopicPartitions request body, after the header, against the generated
+// describe_topic_partitions_request<0>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "describe_topic_partitions_request.hpp"
+#include "fuzz.hpp"
+#include "request_message.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const* data, size_t size) {
+  std::vector<int8_t> in(data, data + size);
+  request_header_v2 header;
+  request_k75_v0 first(&header), second(&header), hand(&header);
+  std::vector<int8_t> canonical =
+      fuzz_round_trip(first, second, in.data(), in.size());
+  if (canonical.empty()) return 0;
+  describe_topic_partitions_request<0> gen;
+  fuzz_differential(canonical, gen, hand);
+  return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef GEN_SUPPORT_H
+#define GEN_SUPPORT_H
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+#include "primitive.hpp"
+
+// helpers shared by the headers kafka_codegen.py generates
+
+int32_t const MAX_UVINT_SIZE = 5;
+
+// tag, size, then v's encoding; the size is only known once v is written, so
+// v goes behind the widest possible size prefix and is slid down afterwards
+inline int32_t write_tagged_field(int8_t* buf, uint32_t tag, sbase& v) {
+  int32_t sz{suvint(tag).serialize(buf)};
+  int8_t* body = buf + sz + MAX_UVINT_SIZE;
+  int32_t n = v.serialize(body);
+  sz += suvint(n).serialize(buf + sz);
+  std::memmove(buf + sz, body, n);
+  return sz + n;
+}
+
+// tags go out in strictly ascending order, so the unknown ones are written
+// in the gaps between the known ones: each call takes the tags in [lo, hi)
+uint64_t const TAGS_END = uint64_t(UINT32_MAX) + 1;
+
+// fields a decoder did not recognise, written back as they came in
+inline int32_t write_unknown_tagged_fields(int8_t* buf, stagged_fields& t,
+                                           uint64_t lo = 0,
+                                           uint64_t hi = TAGS_END) {
+  int32_t sz{};
+  for (stagged_fields::field& f : t.fields) {
+    if (f.tag.val < lo || f.tag.val >= hi) continue;
+    sz += f.tag.serialize(buf + sz);
+    sz += suvint(f.data.size()).serialize(buf + sz);
+    std::copy(f.data.begin(), f.data.end(), buf + sz);
+    sz += f.data.size();
+  }
+  return sz;
+}
+
+// a request's view holds its whole tag section, known tags included; only
+// the ones known(tag) rejects are carried over as unknown
+template <typename Known>
+uint32_t count_unknown_tags(stagged_fields_view const& t, Known known) {
+  uint32_t n{};
+  t.for_each([&](uint32_t tag, std::span<int8_t>) { n += !known(tag); });
+  return n;
+}
+
+template <typename Known>
+int32_t write_unknown_tagged_fields(int8_t* buf, stagged_fields_view const& t,
+                                    Known known, uint64_t lo = 0,
+                                    uint64_t hi = TAGS_END) {
+  int32_t sz{};
+  t.for_each([&](uint32_t tag, std::span<int8_t> data) {
+    if (known(tag) || tag < lo || tag >= hi) return;
+    sz += suvint(tag).serialize(buf + sz);
+    sz += suvint(data.size()).serialize(buf + sz);
+    std::copy(data.begin(), data.end(), buf + sz);
+    sz += data.size();
+  });
+  return sz;
+}
+
+inline void keep_unknown_tagged_field(stagged_fields& t, uint32_t tag,
+                                      int8_t* data, uint32_t len) {
+  stagged_fields::field& f = msg_emplace_back(t.fields);
+  f.tag.val = tag;
+  f.data.assign(data, data + len);
+}
+
+#endif
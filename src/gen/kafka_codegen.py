@@ -0,0 +1,440 @@
+#!/usr/bin/env python3
+"""Generates version-aware message structs from Kafka's JSON message specs.
+
+Every spec in schema/ becomes one header holding a `template <int16_t V>`
+struct built from the primitives in primitive.hpp. Fields that are absent in
+a version, compact vs. classic encodings and tagged fields are all resolved
+with `if constexpr`, so each instantiated version is as lean as a hand-written
+one.
+
+usage: kafka_codegen.py OUT_DIR SPEC.json...
+"""
+
+import json
+import os
+import re
+import sys
+
+MAX_VERSION = 0x7FFF
+
+INT_TYPES = {
+    "int8": "sint8",
+    "int16": "sint16",
+    "int32": "sint32",
+    "int64": "sint64",
+}
+
+
+def snake(name):
+    s = re.sub(r"([A-Z]+)([A-Z][a-z])", r"\1_\2", name)
+    s = re.sub(r"([a-z0-9])([A-Z])", r"\1_\2", s)
+    return s.lower()
+
+
+def load_spec(path):
+    # the upstream specs carry // comments, which json does not allow
+    with open(path) as f:
+        text = "\n".join(
+            line for line in f.read().splitlines()
+            if not line.lstrip().startswith("//"))
+    return json.loads(text)
+
+
+def is_request(spec):
+    """Requests and their header are decoded from frames they borrow from;
+    headers are typed "header" either way, so those go by name."""
+    if spec["type"] == "header":
+        return spec["name"] == "RequestHeader"
+    return spec["type"] == "request"
+
+
+def parse_versions(s):
+    if s is None or s == "none":
+        return None
+    if s.endswith("+"):
+        return int(s[:-1]), MAX_VERSION
+    if "-" in s:
+        lo, hi = s.split("-")
+        return int(lo), int(hi)
+    return int(s), int(s)
+
+
+def version_cond(rng):
+    """C++ constant expression that is true when V falls in rng."""
+    if rng is None:
+        return "false"
+    lo, hi = rng
+    terms = []
+    if lo > 0:
+        terms.append(f"V >= {lo}")
+    if hi < MAX_VERSION:
+        terms.append(f"V <= {hi}")
+    return " && ".join(terms) if terms else "true"
+
+
+class Field:
+    def __init__(self, spec, msg):
+        self.spec = spec
+        self.name = snake(spec["name"])
+        self.type = spec["type"]
+        self.versions = parse_versions(spec.get("versions"))
+        self.nullable = parse_versions(spec.get("nullableVersions")) is not None
+        self.tagged = parse_versions(spec.get("taggedVersions"))
+        self.tag = spec.get("tag")
+        self.default = spec.get("default")
+        self.fields = [Field(f, msg) for f in spec.get("fields", [])]
+        flex = spec.get("flexibleVersions")
+        self.flex = "FLEX" if flex is None else version_cond(
+            parse_versions(flex))
+        self.request = is_request(msg)
+        if self.tagged is not None and self.tag is None:
+            raise ValueError(f"{spec['name']}: taggedVersions without tag")
+
+    @property
+    def is_array(self):
+        return self.type.startswith("[]")
+
+    @property
+    def elem(self):
+        return self.type[2:] if self.is_array else self.type
+
+    @property
+    def is_struct(self):
+        return bool(self.fields)
+
+    @property
+    def struct_name(self):
+        return snake(self.elem) + "_t"
+
+    def scalar_type(self, t):
+        if t in INT_TYPES:
+            return INT_TYPES[t]
+        if t == "bool":
+            return "sbool"
+        if t == "uuid":
+            return "suuid"
+        raise ValueError(f"unsupported type {t}")
+
+    def cpp_type(self):
+        if self.is_array and self.elem in INT_TYPES:
+            elem = self.elem + "_t"
+            return (f"std::conditional_t<{self.flex}, scfixarray<{elem}>, "
+                    f"sfixarray<{elem}>>")
+        if self.is_array:
+            elem = self.struct_name if self.is_struct else self.scalar_type(
+                self.elem)
+            return (f"std::conditional_t<{self.flex}, scarray<{elem}>, "
+                    f"sarray<{elem}>>")
+        if self.type == "string":
+            # requests only live as long as their frame, borrow from it
+            view = "_view" if self.request else ""
+            n = "n" if self.nullable else ""
+            return (f"std::conditional_t<{self.flex}, sc{n}string{view}, "
+                    f"s{n}string{view}>")
+        if self.type in ("bytes", "records"):
+            return ("std::conditional_t<{0}, scarray<sint8>, sarray<sint8>>"
+                    .format(self.flex))
+        if self.is_struct:
+            return self.struct_name
+        return self.scalar_type(self.type)
+
+    def init(self):
+        """Default member initializer, following the spec's default."""
+        d = self.default
+        if self.is_array or self.type in ("bytes", "records"):
+            if self.nullable and d == "null":
+                return ""
+            if not self.is_array:
+                elem = "sint8"
+            elif self.is_struct:
+                elem = self.struct_name
+            elif self.elem in INT_TYPES:
+                elem = self.elem + "_t"
+            else:
+                elem = self.scalar_type(self.elem)
+            return "{std::vector<%s>{}}" % elem
+        if self.type == "string":
+            if d and d != "null":
+                return '{"%s"}' % d
+            return ""
+        if self.type in INT_TYPES:
+            return "{%s}" % (d if d is not None else "0")
+        if self.type == "bool":
+            return "{%s}" % (d if d is not None else "false")
+        return "{}"
+
+    def reset(self):
+        """Expression holding a default-initialized value of the field."""
+        return f"decltype({self.name}){self.init() or '{}'}"
+
+    def is_default(self):
+        """Expression that holds when the field still has its default."""
+        d = self.default
+        if self.is_array or self.type in ("bytes", "records"):
+            if self.nullable and d == "null":
+                return f"{self.name}.is_null"
+            return f"{self.name}.val.empty()"
+        if self.type == "string":
+            if self.nullable and d == "null":
+                return f"{self.name}.is_null"
+            return f'{self.name}.val == "{d or ""}"'
+        if self.type in INT_TYPES:
+            return f"{self.name}.val == {d if d is not None else '0'}"
+        if self.type == "bool":
+            return f"{self.name}.val == {d if d is not None else 'false'}"
+        if self.type == "uuid":
+            return f"{self.name}.id() == uuid128{{}}"
+        if self.nullable and d == "null":
+            return f"{self.name}_is_null"
+        return f"{self.name}.is_default()"
+
+
+class Writer:
+    def __init__(self):
+        self.lines = []
+        self.depth = 0
+
+    def __call__(self, line=""):
+        self.lines.append(("  " * self.depth + line) if line else "")
+
+    def indent(self):
+        self.depth += 1
+
+    def dedent(self):
+        self.depth -= 1
+
+
+def emit_struct(w, name, fields, flexible, request, preamble=None):
+    """Emits one struct; the top-level message passes its constants as
+    preamble and gets a template header, nested structs get is_default().
+
+    Requests skip unknown tags by length and keep the raw tag section as a
+    view into the frame; responses copy the unknown tags they come across."""
+    top_level = preamble is not None
+    if top_level:
+        w("template <int16_t V>")
+    w(f"struct {name} final : sbase {{")
+    w.indent()
+    for line in preamble or []:
+        w(line)
+    for f in fields:
+        if f.is_struct:
+            emit_struct(w, f.struct_name, f.fields, flexible, request)
+            w()
+    for f in fields:
+        w(f"{f.cpp_type()} {f.name}{f.init()};")
+        if f.is_struct and not f.is_array and f.nullable:
+            null = "true" if f.default == "null" else "false"
+            w(f"bool {f.name}_is_null{{{null}}};")
+    regular = [f for f in fields if f.tagged is None]
+    tagged = sorted((f for f in fields if f.tagged is not None),
+                    key=lambda f: f.tag)
+    unknown = "tagged_fields" if request else "unknown_tagged_fields"
+    if flexible and request:
+        w(f"stagged_fields_view {unknown};")
+        w()
+        w("static constexpr bool known_tag(uint32_t%s) {"
+          % (" tag" if tagged else ""))
+        w.indent()
+        if tagged:
+            w("switch (tag) {")
+            for f in tagged:
+                w(f"  case {f.tag}: return {version_cond(f.tagged)};")
+            w("  default: return false;")
+            w("}")
+        else:
+            w("return false;")
+        w.dedent()
+        w("}")
+    elif flexible:
+        w(f"stagged_fields {unknown};")
+    w()
+
+    # serialize
+    w("int32_t serialize(int8_t* buf) override {")
+    w.indent()
+    w("int32_t sz{};")
+    for f in regular:
+        emit_field_io(w, f, "serialize")
+    if flexible:
+        w("if constexpr (FLEX) {")
+        w.indent()
+        if request:
+            w(f"uint32_t n_tags = count_unknown_tags({unknown}, known_tag);")
+        else:
+            w(f"uint32_t n_tags = {unknown}.fields.size();")
+        for f in tagged:
+            w(f"if constexpr ({version_cond(f.tagged)}) "
+              f"n_tags += !({f.is_default()});")
+        w("sz += suvint(n_tags).serialize(buf + sz);")
+
+        # unknown tags fill the gaps so the section stays in tag order
+        def unknown_between(lo, hi):
+            if lo == hi:
+                return
+            args = f"{unknown}, known_tag" if request else unknown
+            if (lo, hi) != (0, "TAGS_END"):
+                args += f", {lo}, {hi}"
+            w(f"sz += write_unknown_tagged_fields(buf + sz, {args});")
+        lo = 0
+        for f in tagged:
+            unknown_between(lo, f.tag)
+            w(f"if constexpr ({version_cond(f.tagged)}) {{")
+            w.indent()
+            w(f"if (!({f.is_default()}))")
+            w(f"  sz += write_tagged_field(buf + sz, {f.tag}, {f.name});")
+            w.dedent()
+            w("}")
+            lo = f.tag
+        unknown_between(lo, "TAGS_END")
+        w.dedent()
+        w("}")
+    w("return sz;")
+    w.dedent()
+    w("}")
+
+    # deserialize
+    w("int32_t deserialize(int8_t* buf) override {")
+    w.indent()
+    w("int32_t sz{};")
+    for f in regular:
+        emit_field_io(w, f, "deserialize")
+    if flexible:
+        w("if constexpr (FLEX) {")
+        w.indent()
+        if request:
+            w("int8_t* tags = buf + sz;")
+        w("suvint n_tags;")
+        w("sz += n_tags.deserialize(buf + sz);")
+        if not request:
+            w(f"{unknown}.fields.clear();")
+        # absent tags mean defaults, whatever a reused object held before
+        for f in tagged:
+            w(f"if constexpr ({version_cond(f.tagged)}) "
+              f"{f.name} = {f.reset()};")
+        w("for (uint32_t i = 0; i < n_tags.val; ++i) {")
+        w.indent()
+        w("suvint tag, len;")
+        w("sz += tag.deserialize(buf + sz);")
+        w("sz += len.deserialize(buf + sz);")
+        w("check_decode(buf + sz, len.val);")
+        w("switch (tag.val) {")
+        w.indent()
+        for f in tagged:
+            w(f"case {f.tag}:")
+            w.indent()
+            w(f"if constexpr ({version_cond(f.tagged)}) {{")
+            w(f"  {f.name}.deserialize(buf + sz);")
+            w("  break;")
+            w("}")
+            w("[[fallthrough]];")
+            w.dedent()
+        w("default:")
+        if request:
+            w("  break;")
+        else:
+            w(f"  keep_unknown_tagged_field({unknown}, tag.val, "
+              "buf + sz, len.val);")
+        w.dedent()
+        w("}")
+        w("sz += len.val;")
+        w.dedent()
+        w("}")
+        if request:
+            w(f"{unknown}.raw = std::span<int8_t>(tags, buf + sz);")
+        w.dedent()
+        w("}")
+    w("return sz;")
+    w.dedent()
+    w("}")
+
+    if not top_level:
+        checks = " &&\n         ".join(f.is_default() for f in fields) \
+            or "true"
+        w("bool is_default() const {")
+        w(f"  return {checks};")
+        w("}")
+    w.dedent()
+    w("};")
+
+
+def emit_field_io(w, f, op):
+    cond = version_cond(f.versions)
+    nullable_struct = f.is_struct and not f.is_array and f.nullable
+    gated = cond != "true"
+    if gated:
+        w(f"if constexpr ({cond}) {{")
+        w.indent()
+    if nullable_struct and op == "serialize":
+        w(f"sz += sint8({f.name}_is_null ? -1 : 1).serialize(buf + sz);")
+        w(f"if (!{f.name}_is_null) sz += {f.name}.serialize(buf + sz);")
+    elif nullable_struct:
+        w("sint8 present;")
+        w("sz += present.deserialize(buf + sz);")
+        w(f"{f.name}_is_null = present.val < 0;")
+        w(f"if (!{f.name}_is_null) sz += {f.name}.deserialize(buf + sz);")
+    else:
+        w(f"sz += {f.name}.{op}(buf + sz);")
+    if gated:
+        w.dedent()
+        w("}")
+
+
+def generate(spec, header_name):
+    lo, hi = parse_versions(spec["validVersions"])
+    flex_rng = parse_versions(spec.get("flexibleVersions"))
+    fields = [Field(f, spec) for f in spec["fields"]]
+    name = snake(spec["name"])
+    guard = header_name.upper().replace(".", "_")
+
+    w = Writer()
+    w(f"// generated by kafka_codegen.py from {spec['name']}.json, do not edit")
+    w(f"#ifndef {guard}")
+    w(f"#define {guard}")
+    w()
+    w("#include <cstdint>")
+    w("#include <span>")
+    w("#include <type_traits>")
+    w("#include <vector>")
+    w()
+    w('#include "gen_support.hpp"')
+    w('#include "primitive.hpp"')
+    w()
+    preamble = [
+        f"static_assert(V >= {lo} && V <= {hi}, "
+        f'"unsupported {spec["name"]} version");',
+    ]
+    if "apiKey" in spec:
+        preamble.append(f"static constexpr int16_t API_KEY = {spec['apiKey']};")
+    preamble += [
+        f"static constexpr int16_t MIN_VERSION = {lo};",
+        f"static constexpr int16_t MAX_VERSION = {hi};",
+        f"static constexpr bool FLEX = {version_cond(flex_rng)};",
+        "",
+    ]
+    emit_struct(w, name, fields, flex_rng is not None,
+                is_request(spec), preamble)
+    w()
+    w("#endif")
+    return "\n".join(w.lines) + "\n"
+
+
+def main():
+    out_dir = sys.argv[1]
+    os.makedirs(out_dir, exist_ok=True)
+    for path in sys.argv[2:]:
+        spec = load_spec(path)
+        header = snake(os.path.splitext(os.path.basename(path))[0]) + ".hpp"
+        text = generate(spec, header)
+        out = os.path.join(out_dir, header)
+        # keep the timestamp when nothing changed so dependants don't rebuild
+        if os.path.exists(out):
+            with open(out) as f:
+                if f.read() == text:
+                    continue
+        with open(out, "w") as f:
+            f.write(text)
+
+
+if __name__ == "__main__":
+    main()
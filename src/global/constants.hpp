@@ -1,7 +1,34 @@
 #ifndef CONSTANT_H
 #define CONSTANT_H
 
+#include <cstdint>
+
 int const THPOOL_SIZE = 10;
+// a request claiming more than this closes its connection, as Kafka's
+// socket.request.max.bytes does
+int const MAX_REQUEST_SIZE = 100 << 20;
+
+// the one broker of the cluster, as Metadata announces it
+int const BROKER_NODE_ID = 1;
+char const BROKER_HOST[] = "localhost";
+int const BROKER_PORT = 9092;
+
+// topic partitions live in <LOG_DIR>/<topic>-<partition>
+char const LOG_DIR[] = "/tmp/kraft-combined-logs";
+char const METADATA_LOG_DIR[] = "/tmp/kraft-combined-logs/__cluster_metadata-0";
+
+// a metadata snapshot is written once this many records were applied since
+// the last one, checked at startup and then every period
+int const SNAPSHOT_MIN_RECORDS = 10000;
+int const SNAPSHOT_PERIOD_SECONDS = 60;
+// older snapshots are removed
+int const SNAPSHOTS_KEPT = 2;
+// the metadata log is checked this often even without inotify events
+int const METADATA_POLL_MS = 1000;
+
+// most partitions in one DescribeTopicPartitions response, whatever the
+// request asks for; the rest come through its cursor
+int const DESCRIBE_TOPIC_PARTITIONS_LIMIT = 2000;
 
 int const API_VERSION_MIN_18 = 0;
 int const API_VERSION_MAX_18 = 4;
@@ -9,9 +36,18 @@ int const API_VERSION_MIN_75 = 0;
 int const API_VERSION_MAX_75 = 0;
 int const API_VERSION_MIN_1 = 16;
 int const API_VERSION_MAX_1 = 16;
+int const API_VERSION_MIN_3 = 9;
+int const API_VERSION_MAX_3 = 12;
+
+// authorized operations for a Metadata request asking for them: there are no
+// ACLs, so everything a topic or the cluster allows
+int const TOPIC_AUTHORIZED_OPERATIONS = 0x0df8;
+int const CLUSTER_AUTHORIZED_OPERATIONS = 0x1fa0;
+// for one that does not
+int const AUTHORIZED_OPERATIONS_OMITTED = INT32_MIN;
 
 int const ERR_UNSUPPORTED_VERSION = 35;
 int const ERR_UNKNOWN_TOPIC_OR_PARTITION = 3;
-int const ERR_UNKNOWN_TOPIC = 100;
+int const ERR_UNKNOWN_TOPIC_ID = 100;
 
 #endif
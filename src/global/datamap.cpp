@@ -3,95 +3,224 @@
 #include <memory.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <cstdio>
 #include <experimental/filesystem>
 #include <filesystem>
 #include <format>
-#include <fstream>
 #include <iostream>
 #include <iterator>
+#include <memory>
+#include <optional>
 #include <ostream>
-#include <regex>
+#include <span>
 #include <string>
+#include <utility>
+#include <vector>
 
-#include "hexutil.hpp"
+#include "constants.hpp"
+#include "log_reader.hpp"
+#include "snapshot.hpp"
 #include "record.hpp"
 
-std::unordered_map<std::string, std::vector<std::shared_ptr<res_partition>>>
-    topic_uuid_to_partitions;
+namespace {
 
-std::unordered_map<std::string, std::unordered_map<int32_t, scarray<sint8>>>
-    topic_uuid_to_partition_to_records;
+std::atomic<std::shared_ptr<metadata_image const>> image{
+    std::make_shared<metadata_image const>()};
 
-std::unordered_map<std::string, std::string> topic_name_to_uuid;
+// the records of every partition log of the topic, all of its segments' batches
+// one after the other
+void load_partition_records(metadata_image &m, uint32_t topic) {
+  partition_table &table = m.partitions;
+  std::string name(table.topic_name(topic));
+  for (uint32_t slot : table.partitions(topic)) {
+    int32_t index = table.partition_index[slot];
+    std::string pathname = std::format("{}/{}-{}", LOG_DIR, name, index);
+    if (!std::filesystem::is_directory(pathname)) continue;
 
-void initialize() {
-  std::string log_fn =
-      "/tmp/kraft-combined-logs/__cluster_metadata-0/"
-      "00000000000000000000.log";
-  int8_t log_fn_read_buf[BUFSIZ];
-  FILE *fs = fopen(log_fn.c_str(), "r");
-  int32_t fsize = fread(log_fn_read_buf, sizeof(int8_t), BUFSIZ, fs);
-  if (fsize == -1) {
-    std::cerr << "file reading error" << std::endl;
+    auto records = std::make_shared<scarray<sint8>>();
+    records->is_null = false;
+    log_reader reader(pathname);
+    reader.read_raw([&](std::span<int8_t const> batch) {
+      std::transform(batch.begin(), batch.end(),
+                     std::back_inserter(records->val),
+                     [](int8_t c) { return sint8(c); });
+    });
+    // no segment at all
+    if (reader.segment.empty()) continue;
+    table.set_records(slot, records);
   }
-  int32_t offset{};
-  while (offset < fsize) {
-    record_batch rb;
-    offset += rb.deserialize(log_fn_read_buf + offset);
-    std::cout << "file offset " << offset << std::endl;
-    for (record &r : rb.records.val) {
-      switch (r.value.type.val) {
-        case 2: {
-          std::shared_ptr<record_value_type2_t> rv =
-              std::dynamic_pointer_cast<record_value_type2_t>(r.value.value);
-          topic_name_to_uuid[rv->topic_name.val] = rv->topic_uuid.str();
-          std::cout << "adding topic " << rv->topic_uuid.str() << ":"
-                    << rv->topic_name.val << std::endl;
-          break;
+}
+
+partition_table::ids ids(scfixarray<int32_t> const &a) {
+  if (a.is_null) return std::nullopt;
+  return std::span<int32_t const>(a.val);
+}
+
+}  // namespace
+
+metadata_tailer metadata_log(METADATA_LOG_DIR);
+
+std::shared_ptr<metadata_image const> current_metadata() {
+  return image.load();
+}
+
+void publish_metadata(std::shared_ptr<metadata_image const> next) {
+  image.store(std::move(next));
+}
+
+void apply_metadata_record(metadata_image &m, record &r) {
+  partition_table &table = m.partitions;
+  switch (r.value.type.val) {
+    case 2: {
+      std::shared_ptr<record_value_type2_t> rv =
+          std::dynamic_pointer_cast<record_value_type2_t>(r.value.value);
+      table.add_topic(rv->topic_name.val, rv->topic_uuid.id());
+      break;
+    }
+    case 3: {
+      std::shared_ptr<record_value_type3_t> rv =
+          std::dynamic_pointer_cast<record_value_type3_t>(r.value.value);
+      std::vector<uuid128> directories;
+      for (suuid const &d : rv->directories_array.val)
+        directories.push_back(d.id());
+      partition_table::partition_state p;
+      p.partition_index = rv->partition_id.val;
+      p.leader_id = rv->leader.val;
+      p.leader_epoch = rv->leader_epoch.val;
+      p.partition_epoch = rv->partition_epoch.val;
+      p.replicas = ids(rv->replica_array);
+      p.isr = ids(rv->in_sync_replica_array);
+      p.adding_replicas = ids(rv->adding_replica_array);
+      p.removing_replicas = ids(rv->removing_replica_array);
+      // no ELR before PartitionRecord v2, and no replica is known offline
+      p.eligible_leader_replicas = std::span<int32_t const>();
+      p.last_known_elr = std::span<int32_t const>();
+      if (!rv->eligible_leader_replicas.is_null)
+        p.eligible_leader_replicas = ids(rv->eligible_leader_replicas);
+      if (!rv->last_known_elr.is_null)
+        p.last_known_elr = ids(rv->last_known_elr);
+      p.offline_replicas = std::span<int32_t const>();
+      if (!rv->directories_array.is_null) p.directories = directories;
+      table.add_partition(rv->topic_uuid.id(), p);
+      break;
+    }
+    case 5: {
+      std::shared_ptr<record_value_type5_t> rv =
+          std::dynamic_pointer_cast<record_value_type5_t>(r.value.value);
+      uuid128 topic = rv->topic_uuid.id();
+      uint32_t t = table.find_topic(topic);
+      uint32_t slot = t == partition_table::NONE
+                          ? partition_table::NONE
+                          : table.find_partition(t, rv->partition_id.val);
+      // the partition went with its topic
+      if (slot == partition_table::NONE) break;
+      partition_table::partition_state p = table.state(slot);
+      // as the controller merges it: a new leader is a new leader epoch,
+      // any change a new partition epoch
+      if (rv->leader.val != record_value_type5_t::NO_LEADER_CHANGE) {
+        p.leader_id = rv->leader.val;
+        ++p.leader_epoch;
+      }
+      ++p.partition_epoch;
+      std::span<int32_t const> old_replicas;
+      if (p.replicas) old_replicas = *p.replicas;
+      if (!rv->isr.is_null) p.isr = ids(rv->isr);
+      if (!rv->replicas.is_null) p.replicas = ids(rv->replicas);
+      if (!rv->removing_replicas.is_null)
+        p.removing_replicas = ids(rv->removing_replicas);
+      if (!rv->adding_replicas.is_null)
+        p.adding_replicas = ids(rv->adding_replicas);
+      if (!rv->eligible_leader_replicas.is_null)
+        p.eligible_leader_replicas = ids(rv->eligible_leader_replicas);
+      if (!rv->last_known_elr.is_null)
+        p.last_known_elr = ids(rv->last_known_elr);
+      // replicas that stay keep their directory, new ones have none yet
+      std::vector<uuid128> directories;
+      if (!rv->directories.is_null) {
+        for (suuid const &d : rv->directories.val)
+          directories.push_back(d.id());
+        p.directories = directories;
+      } else if (!rv->replicas.is_null && p.directories &&
+                 !p.directories->empty()) {
+        for (int32_t replica : rv->replicas.val) {
+          auto at = std::find(old_replicas.begin(), old_replicas.end(), replica);
+          size_t i = at - old_replicas.begin();
+          directories.push_back(i < p.directories->size() ? (*p.directories)[i]
+                                                          : uuid128{});
         }
-        case 3:
-          std::shared_ptr<record_value_type3_t> rv =
-              std::dynamic_pointer_cast<record_value_type3_t>(r.value.value);
-          std::shared_ptr<res_partition> p = std::make_shared<res_partition>();
-          p->error_code.val = 0;
-          p->partition_index.val = rv->paritition_id.val;
-          topic_uuid_to_partitions[rv->topic_uuid.str()].push_back(p);
-          std::cout << "adding partition " << p->partition_index.val << " into "
-                    << rv->topic_uuid.str() << std::endl;
+        p.directories = directories;
       }
+      table.add_partition(topic, p);
+      break;
+    }
+    case 9: {
+      std::shared_ptr<record_value_type9_t> rv =
+          std::dynamic_pointer_cast<record_value_type9_t>(r.value.value);
+      table.remove_topic(rv->topic_uuid.id());
+      break;
     }
   }
+}
 
-  for (auto &topic : topic_name_to_uuid) {
-    auto part_it = topic_uuid_to_partitions.find(topic.second);
-    if (part_it == topic_uuid_to_partitions.end()) continue;
-    for (auto &p : part_it->second) {
-      std::string pathname = std::format("/tmp/kraft-combined-logs/{}-{}",
-                                         topic.first, p->partition_index.val);
-      if (!std::filesystem::is_directory(pathname)) continue;
-
-      std::filesystem::directory_iterator dir(pathname);
-
-      for (std::filesystem::directory_entry const &d : dir) {
-        // only read well-formatted log file name
-        std::regex log_fn_pattern("^\\d{20}.log");
-        if (!std::regex_match(d.path().filename().string(), log_fn_pattern))
-          continue;
-
-        std::fstream fs(d.path());
-        char buf[BUFSIZ];
-        fs.read(buf, BUFSIZ);
-        auto &ve = topic_uuid_to_partition_to_records[topic.second]
-                                                     [p->partition_index.val];
-        ve.is_null = false;
-        std::transform(buf, buf + fs.gcount(), std::back_inserter(ve.val),
-                       [](char c) { return sint8(c); });
-        std::cout << "read from file " << topic.second << ":"
-                  << p->partition_index.val << " -> "
-                  << tohex((int8_t *)buf, fs.gcount()) << std::endl;
-      }
+void apply_metadata_batch(metadata_image &m, record_batch &rb) {
+  int64_t end_offset = m.end_offset;
+  for (record &r : rb.records.val) {
+    int64_t offset = rb.base_offset.val + r.offset_delta.val;
+    // already applied, from a snapshot or an earlier read
+    if (offset < m.end_offset) continue;
+    apply_metadata_record(m, r);
+    m.end_offset = offset + 1;
+  }
+  if (m.end_offset != end_offset) {
+    m.last_batch_offset = rb.base_offset.val;
+    m.last_batch_crc = rb.crc.val;
+  }
+}
+
+size_t replay_metadata_log(log_reader &reader, metadata_image &m) {
+  int64_t snapshot_offset = load_metadata_snapshot(reader.dir, m);
+  m.end_offset = snapshot_offset;
+  // the checkpoint's last batch is read again first: a checkpoint of an
+  // earlier log, or one past the end of this log, finds another batch or none
+  bool checked = snapshot_offset == 0;
+  bool matches = checked;
+  reader.seek(checked ? 0 : m.last_batch_offset);
+  size_t batches = reader.read([&](record_batch &rb) {
+    if (!checked) {
+      checked = true;
+      matches = rb.base_offset.val == m.last_batch_offset &&
+                rb.crc.val == m.last_batch_crc;
     }
+    if (matches) apply_metadata_batch(m, rb);
+  });
+  if (!matches) {
+    std::cerr << "metadata snapshot at offset " << snapshot_offset
+              << " was not taken of this log, replaying all of it"
+              << std::endl;
+    m = metadata_image();
+    metadata_snapshot_offset = 0;
+    reader.seek(0);
+    batches = reader.read(
+        [&](record_batch &rb) { apply_metadata_batch(m, rb); });
+  }
+  m.partitions.freeze();
+  return batches;
+}
+
+void initialize() {
+  auto m = std::make_shared<metadata_image>();
+  size_t batches = replay_metadata_log(metadata_log.reader, *m);
+  std::cout << "replayed " << batches << " metadata batches after offset "
+            << metadata_snapshot_offset.load() << ": "
+            << m->partitions.topic_count() << " topics, "
+            << m->partitions.partition_count() << " partitions" << std::endl;
+
+  for (uint32_t t = 0; t < m->partitions.topic_count(); ++t) {
+    if (m->partitions.topic_named[t]) load_partition_records(*m, t);
   }
+  publish_metadata(m);
+  // a long replay is not repeated on the next start
+  maybe_write_metadata_snapshot(METADATA_LOG_DIR);
 }
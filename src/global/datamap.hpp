@@ -1,26 +1,52 @@
 #ifndef INCLUDE_GLOBAL_DATAMAP_HPP_
 #define INCLUDE_GLOBAL_DATAMAP_HPP_
 
+#include <cstddef>
 #include <cstdint>
 #include <memory>
-#include <string>
-#include <unordered_map>
-#include <vector>
 
-#include "primitive.hpp"
+#include "log_reader.hpp"
+#include "partition_table.hpp"
 #include "record.hpp"
-#include "response_message.hpp"
+#include "tailer.hpp"
 
-extern std::unordered_map<std::string,
-                          std::vector<std::shared_ptr<res_partition>>>
-    topic_uuid_to_partitions;
+// One version of the cluster metadata, never changed once published.
+// Requests take the current version and read it without locks; new metadata
+// records are applied to a copy, which then replaces it for later requests.
+// The copy shares partition log records with the version it was made from,
+// and the table's columns chunk by chunk through cow_vector: what a batch
+// writes to is copied, the rest stays shared, see partition_table.
+struct metadata_image {
+  // offset after the last metadata record applied
+  int64_t end_offset{};
+  // base offset and CRC of the log batch that record came in, which a
+  // checkpoint keeps to be matched against the log it is loaded with
+  int64_t last_batch_offset{-1};
+  int32_t last_batch_crc{};
 
-extern std::unordered_map<std::string,
-                          std::unordered_map<int32_t, scarray<sint8>>>
-    topic_uuid_to_partition_to_records;
+  // frozen whenever published
+  partition_table partitions;
+};
 
-extern std::unordered_map<std::string, std::string> topic_name_to_uuid;
+std::shared_ptr<metadata_image const> current_metadata();
+// only one thread at a time may build and publish the next version
+void publish_metadata(std::shared_ptr<metadata_image const> next);
 
+// follows the metadata log from where initialize() stopped
+extern metadata_tailer metadata_log;
+
+// applies a topic or partition record, other types are ignored
+extern void apply_metadata_record(metadata_image &m, record &r);
+
+// applies the records of a metadata log batch from m.end_offset on
+extern void apply_metadata_batch(metadata_image &m, record_batch &rb);
+
+// loads the newest checkpoint in the reader's directory and replays the log
+// after it, or the whole log when the checkpoint was not taken of this log;
+// returns how many batches were read
+extern size_t replay_metadata_log(log_reader &reader, metadata_image &m);
+
+// loads the snapshot and replays the metadata log after it
 extern void initialize();
 
 #endif  // INCLUDE_GLOBAL_DATAMAP_HPP_
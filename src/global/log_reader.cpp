@@ -0,0 +1,198 @@
+#include "log_reader.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <ostream>
+#include <regex>
+#include <span>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "primitive.hpp"
+
+namespace {
+
+// segment files in offset order; their names are zero-padded base offsets
+std::vector<std::string> list_segments(std::string const &dir) {
+  static std::regex const segment_pattern("^\\d{20}\\.log$");
+  std::vector<std::string> segments;
+  std::error_code ec;
+  for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    if (std::regex_match(it->path().filename().string(), segment_pattern))
+      segments.push_back(it->path().string());
+  }
+  if (ec)
+    std::cerr << "cannot list " << dir << ": " << ec.message() << std::endl;
+  std::sort(segments.begin(), segments.end());
+  return segments;
+}
+
+// the base offset a segment is named after
+int64_t segment_offset(std::string const &path) {
+  return std::stoll(std::filesystem::path(path).filename().string());
+}
+
+}  // namespace
+
+std::string offset_file_name(int64_t offset) {
+  std::string n = std::to_string(offset);
+  return std::string(n.size() < 20 ? 20 - n.size() : 0, '0') + n;
+}
+
+void log_reader::seek(int64_t offset) {
+  std::vector<std::string> segments = list_segments(dir);
+  skip_before = offset;
+  segment.clear();
+  position = 0;
+  for (std::string const &s : segments) {
+    if (segment_offset(s) > offset) break;
+    segment = s;
+  }
+}
+
+bool log_reader::read_file(std::string const &path,
+                           std::function<void(record_batch &)> const &f) {
+  segment = path;
+  position = 0;
+  size_t batches{}, before = skipped;
+  return read_segment(decoding(f), batches) && skipped == before;
+}
+
+size_t log_reader::read(std::function<void(record_batch &)> const &f) {
+  return read_frames(decoding(f));
+}
+
+size_t log_reader::read_raw(
+    std::function<void(std::span<int8_t const>)> const &f) {
+  return read_frames([&](std::span<int8_t> frame) {
+    f(frame);
+    return true;
+  });
+}
+
+log_reader::frame_fn log_reader::decoding(
+    std::function<void(record_batch &)> const &f) {
+  return [this, &f](std::span<int8_t> frame) {
+    record_batch rb;
+    try {
+      decode_bounds bounds(frame.data(), frame.size());
+      rb.deserialize(frame.data());
+    } catch (decode_error const &e) {
+      // the next batch is still where the length says
+      std::cerr << "skipping corrupt batch at " << segment << ":"
+                << position - int64_t(frame.size()) << ": " << e.what()
+                << std::endl;
+      ++skipped;
+      return false;
+    }
+    f(rb);
+    return true;
+  };
+}
+
+size_t log_reader::read_frames(frame_fn const &f) {
+  std::vector<std::string> segments = list_segments(dir);
+  // resumes in the segment last read, or the one after it when it is gone
+  auto it = std::lower_bound(segments.begin(), segments.end(), segment);
+  size_t batches{};
+  for (; it != segments.end(); ++it) {
+    if (*it != segment) {
+      segment = *it;
+      position = 0;
+    }
+    bool last = it + 1 == segments.end();
+    if (!read_segment(f, batches) && !last) {
+      // nothing is appended to a segment once the next one exists
+      ++skipped;
+      std::cerr << "skipping torn batch at the end of " << segment << ":"
+                << position << std::endl;
+    }
+  }
+  return batches;
+}
+
+bool log_reader::read_segment(frame_fn const &f, size_t &batches) {
+  int fd = open(segment.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << "cannot open " << segment << ": " << std::strerror(errno)
+              << std::endl;
+    return true;
+  }
+  posix_fadvise(fd, position, 0, POSIX_FADV_SEQUENTIAL);
+  if (!window.data) window = pooled_buffer(WINDOW_SIZE);
+
+  // window[begin, end) holds the file from position on
+  size_t begin{}, end{};
+  bool eof{};
+  while (true) {
+    size_t avail = end - begin;
+    size_t need = BATCH_FRAME_SIZE;
+    if (avail >= BATCH_FRAME_SIZE) {
+      int32_t len = load_big_endian<int32_t>(window.data + begin + 8);
+      if (len < 0) {
+        // framing is lost, the rest of the segment can't be found
+        std::cerr << "bad batch length " << len << " at " << segment << ":"
+                  << position << std::endl;
+        ++skipped;
+        struct stat st {};
+        if (fstat(fd, &st) == 0) position = st.st_size;
+        break;
+      }
+      need += len;
+    }
+
+    if (avail >= need) {
+      int8_t *frame = window.data + begin;
+      if (need >= LAST_OFFSET_DELTA_AT + sizeof(int32_t) &&
+          load_big_endian<int64_t>(frame) +
+                  load_big_endian<int32_t>(frame + LAST_OFFSET_DELTA_AT) <
+              skip_before) {
+        begin += need;
+        position += need;
+        continue;
+      }
+      // position is already past the batch while f runs
+      begin += need;
+      position += need;
+      if (f(std::span<int8_t>(frame, need))) ++batches;
+      continue;
+    }
+
+    if (eof) {
+      close(fd);
+      return avail == 0;
+    }
+    if (need > window.capacity) {
+      pooled_buffer larger(need);
+      std::memcpy(larger.data, window.data + begin, avail);
+      window = std::move(larger);
+    } else if (begin > 0) {
+      std::memmove(window.data, window.data + begin, avail);
+    }
+    begin = 0;
+    end = avail;
+    ssize_t n = pread(fd, window.data + end, window.capacity - end,
+                      position + avail);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      std::cerr << "cannot read " << segment << ": " << std::strerror(errno)
+                << std::endl;
+      eof = true;
+    } else {
+      eof = n == 0;
+      end += n;
+    }
+  }
+  close(fd);
+  return true;
+}
@@ -0,0 +1,78 @@
+#ifndef INCLUDE_GLOBAL_LOG_READER_HPP_
+#define INCLUDE_GLOBAL_LOG_READER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <utility>
+
+#include "buffer_pool.hpp"
+#include "record.hpp"
+
+// Reads the record batches of a log directory in offset order, across all of
+// its NNNNNNNNNNNNNNNNNNNN.log segments, through a window that only grows to
+// the largest batch; memory stays constant however long the log is. The
+// reader remembers where it stopped, so calling read() again only yields
+// batches appended since. A batch cut short at the end of the last segment is
+// left for a later read, one that does not decode is skipped.
+//
+// seek() starts the reader at an offset without decoding what comes before,
+// e.g. the part of the log a snapshot already covers.
+struct log_reader {
+  // reads go to disk in pieces of this size
+  static constexpr size_t WINDOW_SIZE = size_t(256) << 10;
+  // base offset, batch length
+  static constexpr size_t BATCH_FRAME_SIZE = 12;
+  // where a batch keeps the delta of its last offset
+  static constexpr size_t LAST_OFFSET_DELTA_AT = 23;
+
+  std::string dir;
+  // the segment being read, empty before the first read
+  std::string segment;
+  // of the next batch within segment
+  int64_t position{};
+  // batches ending before this offset are passed over undecoded
+  int64_t skip_before{};
+  // batches given up on as corrupt or torn
+  size_t skipped{};
+  // what was read from disk, taken from the buffer pool on the first read
+  pooled_buffer window;
+
+  // gets every complete batch as it is on disk; false when it is not counted
+  // as read
+  using frame_fn = std::function<bool(std::span<int8_t>)>;
+
+  explicit log_reader(std::string dir) : dir(std::move(dir)) {}
+
+  // calls f on every complete batch from the current position on; returns
+  // how many there were
+  size_t read(std::function<void(record_batch &)> const &f);
+
+  // read() for batches that are passed on undecoded, e.g. a partition log
+  // whose records are served as they are
+  size_t read_raw(std::function<void(std::span<int8_t const>)> const &f);
+
+  // moves to the segment holding offset
+  void seek(int64_t offset);
+
+  // reads a single file from its start; false unless every batch in it was
+  // whole and decoded
+  bool read_file(std::string const &path,
+                 std::function<void(record_batch &)> const &f);
+
+  // every segment from the current one on
+  size_t read_frames(frame_fn const &f);
+
+  // reads segment from position on; false when it ends with a batch cut short
+  bool read_segment(frame_fn const &f, size_t &batches);
+
+  // a frame_fn decoding each batch for f; those that don't decode are skipped
+  frame_fn decoding(std::function<void(record_batch &)> const &f);
+};
+
+// segments and snapshots are named after an offset zero-padded to 20 digits
+std::string offset_file_name(int64_t offset);
+
+#endif  // INCLUDE_GLOBAL_LOG_READER_HPP_
@@ -0,0 +1,356 @@
+#include "partition_table.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+uint64_t hash_uuid(uuid128 const &id) { return hash_bytes(id.bytes, 16); }
+
+uint64_t hash_partition(uint32_t topic, int32_t index) {
+  return mix_hash(uint64_t(topic) << 32 | uint32_t(index));
+}
+
+}  // namespace
+
+uint32_t partition_table::find_topic(uuid128 const &id) const {
+  return topic_by_id.find(hash_uuid(id),
+                          [&](uint32_t t) { return topic_id[t] == id; });
+}
+
+uint32_t partition_table::find_topic(std::string_view name) const {
+  return topic_by_name.find(hash_bytes(name), [&](uint32_t t) {
+    return topic_name(t) == name;
+  });
+}
+
+uint32_t partition_table::find_partition(uint32_t topic, int32_t index) const {
+  return partition_by_key.find(hash_partition(topic, index), [&](uint32_t s) {
+    return partition_topic[s] == topic && partition_index[s] == index;
+  });
+}
+
+std::span<uint32_t const> partition_table::topics_from(
+    std::string_view name) const {
+  auto first = std::lower_bound(
+      by_name->begin(), by_name->end(), name,
+      [&](uint32_t t, std::string_view n) { return topic_name(t) < n; });
+  return std::span(first, by_name->end());
+}
+
+// mix_hash is a bijection, so slots with the same hash are the same slot
+std::shared_ptr<scarray<sint8> const> const *partition_table::find_records(
+    uint32_t slot) const {
+  uint32_t r = records_by_slot.find(mix_hash(slot), [](uint32_t) {
+    return true;
+  });
+  return r == NONE ? nullptr : &records[r];
+}
+
+uint32_t partition_table::find_or_add_topic(uuid128 const &id) {
+  uint32_t t = find_topic(id);
+  if (t != NONE) return t;
+  t = topic_id.size();
+  topic_id.push_back(id);
+  topic_names.emplace_back();
+  topic_named.push_back(false);
+  topic_removed.push_back(false);
+  topic_fragment.emplace_back();
+  topic_by_id.insert(hash_uuid(id), t, [](uint32_t) { return false; });
+  frozen = false;
+  return t;
+}
+
+uint32_t partition_table::add_topic(std::string_view name, uuid128 const &id) {
+  uint32_t t = find_or_add_topic(id);
+  if (!topic_named[t] || topic_name(t) != name) {
+    topic_names.mut(t).assign(name);
+    topic_named[t] = true;
+    topic_fragment.mut(t).reset();
+    names_sorted = false;
+  }
+  topic_by_name.insert(hash_bytes(name), t, [&](uint32_t other) {
+    return topic_name(other) == name;
+  });
+  return t;
+}
+
+uint32_t partition_table::add_partition(uuid128 const &topic,
+                                        partition_state const &p) {
+  // a topic not seen yet is named once its topic record comes along
+  uint32_t t = find_or_add_topic(topic);
+  uint32_t slot = find_partition(t, p.partition_index);
+  if (slot == NONE) {
+    slot = partition_topic.size();
+    partition_topic.push_back(t);
+    partition_index.push_back(p.partition_index);
+    leader_id.emplace_back();
+    leader_epoch.emplace_back();
+    partition_epoch.emplace_back();
+    replicas.emplace_back();
+    isr.emplace_back();
+    adding_replicas.emplace_back();
+    removing_replicas.emplace_back();
+    eligible_leader_replicas.emplace_back();
+    last_known_elr.emplace_back();
+    offline_replicas.emplace_back();
+    directories.emplace_back();
+    partition_by_key.insert(hash_partition(t, p.partition_index), slot,
+                            [](uint32_t) { return false; });
+    frozen = false;
+  }
+  leader_id.mut(slot) = p.leader_id;
+  leader_epoch.mut(slot) = p.leader_epoch;
+  partition_epoch.mut(slot) = p.partition_epoch;
+  // unchanged lists of an update come from state() and point into the pool,
+  // which a new list appended to it may move: all of them are looked up
+  // before anything is appended, and a pooled list that is not one of the
+  // pool's own is copied out
+  std::pair<cow_vector<uint32_t> &, ids> columns[] = {
+      {replicas, p.replicas},
+      {isr, p.isr},
+      {adding_replicas, p.adding_replicas},
+      {removing_replicas, p.removing_replicas},
+      {eligible_leader_replicas, p.eligible_leader_replicas},
+      {last_known_elr, p.last_known_elr},
+      {offline_replicas, p.offline_replicas},
+  };
+  uint32_t found[std::size(columns)];
+  std::vector<int32_t> copies[std::size(columns)];
+  for (size_t i = 0; i < std::size(columns); ++i) {
+    ids &values = columns[i].second;
+    found[i] = values ? lists.find(*values) : NULL_LIST;
+    if (found[i] == NONE && lists.owns(*values)) {
+      copies[i].assign(values->begin(), values->end());
+      values = copies[i];
+    }
+  }
+  for (size_t i = 0; i < std::size(columns); ++i) {
+    auto &[column, values] = columns[i];
+    uint32_t l = found[i] != NONE ? found[i] : lists.intern(values);
+    if (column[slot] != l) column.mut(slot) = l;
+  }
+  uint32_t d = directory_lists.intern(p.directories);
+  if (directories[slot] != d) directories.mut(slot) = d;
+  topic_fragment.mut(t).reset();
+  return slot;
+}
+
+partition_table::partition_state partition_table::state(uint32_t slot) const {
+  auto list_of = [&](uint32_t l) -> ids {
+    if (l == NULL_LIST) return std::nullopt;
+    return list(l);
+  };
+  partition_state p;
+  p.partition_index = partition_index[slot];
+  p.leader_id = leader_id[slot];
+  p.leader_epoch = leader_epoch[slot];
+  p.partition_epoch = partition_epoch[slot];
+  p.replicas = list_of(replicas[slot]);
+  p.isr = list_of(isr[slot]);
+  p.adding_replicas = list_of(adding_replicas[slot]);
+  p.removing_replicas = list_of(removing_replicas[slot]);
+  p.eligible_leader_replicas = list_of(eligible_leader_replicas[slot]);
+  p.last_known_elr = list_of(last_known_elr[slot]);
+  p.offline_replicas = list_of(offline_replicas[slot]);
+  if (directories[slot] != NULL_LIST) {
+    p.directories = directory_lists[directories[slot]];
+  }
+  return p;
+}
+
+void partition_table::fill(res_partition &p, uint32_t slot) const {
+  p.error_code.val = 0;
+  p.partition_index.val = partition_index[slot];
+  p.leader_id.val = leader_id[slot];
+  p.leader_epoch.val = leader_epoch[slot];
+  list_of(p.replica_nodes, replicas[slot]);
+  list_of(p.isr_nodes, isr[slot]);
+  list_of(p.eligible_leader_replicas, eligible_leader_replicas[slot]);
+  list_of(p.last_known_elr, last_known_elr[slot]);
+  list_of(p.offline_replicas, offline_replicas[slot]);
+  p.tagged_fields.fields.clear();
+}
+
+void partition_table::fill(res_k3_partition &p, uint32_t slot) const {
+  p.error_code.val = 0;
+  p.partition_index.val = partition_index[slot];
+  p.leader_id.val = leader_id[slot];
+  p.leader_epoch.val = leader_epoch[slot];
+  list_of(p.replica_nodes, replicas[slot]);
+  list_of(p.isr_nodes, isr[slot]);
+  list_of(p.offline_replicas, offline_replicas[slot]);
+  p.tagged_fields.fields.clear();
+}
+
+void partition_table::encode_topic(uint32_t t) {
+  auto fragment = std::make_shared<topic_bytes>();
+  std::span<uint32_t const> slots = partitions(t);
+
+  // the partitions go in one by one, to know where each of them starts
+  res_topic_info info;
+  info.error_code.val = 0;
+  info.name = scnstring(std::string(topic_name(t)));
+  info.topic_id = suuid(topic_id[t]);
+  info.is_internal.val = false;
+  info.topic_authorized_operations.val = 0;
+  res_partition p;
+  size_t size = 2 + 5 + info.name.val.size() + 16 + 1 + 5 + 4 + 1;
+  for (uint32_t slot : slots) {
+    fill(p, slot);
+    size += p.max_size();
+  }
+  std::vector<int8_t> &describe = fragment->describe;
+  describe.resize(size);
+  size_t n = info.error_code.serialize(describe.data());
+  n += info.name.serialize(describe.data() + n);
+  n += info.topic_id.serialize(describe.data() + n);
+  n += info.is_internal.serialize(describe.data() + n);
+  n += suvint(slots.size() + 1).serialize(describe.data() + n);
+  fragment->partition_at.reserve(slots.size() + 1);
+  for (uint32_t slot : slots) {
+    fragment->partition_at.push_back(n);
+    fill(p, slot);
+    n += p.serialize(describe.data() + n);
+  }
+  fragment->partition_at.push_back(n);
+  n += info.topic_authorized_operations.serialize(describe.data() + n);
+  n += info.tagged_buffer.serialize(describe.data() + n);
+  describe.resize(n);
+
+  // without authorized operations and tagged fields, which go by the request
+  res_k3_topic topic;
+  topic.version = 12;
+  topic.error_code.val = 0;
+  topic.name = info.name;
+  topic.topic_id = info.topic_id;
+  topic.is_internal.val = false;
+  topic.partitions.is_null = false;
+  topic.partitions.val.resize(slots.size());
+  size = 5;
+  for (size_t j = 0; j < slots.size(); ++j) {
+    fill(topic.partitions.val[j], slots[j]);
+    size += topic.partitions.val[j].max_size();
+  }
+  std::vector<int8_t> &out = fragment->metadata;
+  out.resize(2 + 5 + topic.name.val.size() + 16 + 1 + size);
+  n = topic.error_code.serialize(out.data());
+  n += topic.name.serialize(out.data() + n);
+  fragment->metadata_id_at = n;
+  n += topic.topic_id.serialize(out.data() + n);
+  n += topic.is_internal.serialize(out.data() + n);
+  n += topic.partitions.serialize(out.data() + n);
+  out.resize(n);
+
+  topic_fragment.mut(t) = std::move(fragment);
+}
+
+void partition_table::list_of(scfixarray<int32_t> &a, uint32_t l) const {
+  std::span<int32_t const> ids = list(l);
+  a.is_null = l == NULL_LIST;
+  a.val.assign(ids.begin(), ids.end());
+}
+
+bool partition_table::remove_topic(uuid128 const &id) {
+  uint32_t t = find_topic(id);
+  if (t == NONE) return false;
+  topic_by_id.erase(hash_uuid(id), [&](uint32_t other) { return other == t; });
+  if (topic_named[t]) {
+    std::string_view name = topic_name(t);
+    topic_by_name.erase(hash_bytes(name),
+                        [&](uint32_t other) { return other == t; });
+  }
+  topic_named[t] = false;
+  topic_removed[t] = true;
+  topic_fragment.mut(t).reset();
+  names_sorted = false;
+  removals = true;
+  frozen = false;
+  return true;
+}
+
+void partition_table::set_records(uint32_t slot,
+                                  std::shared_ptr<scarray<sint8> const> r) {
+  uint32_t at = records_by_slot.find(mix_hash(slot), [](uint32_t) {
+    return true;
+  });
+  if (at != NONE) {
+    records[at] = std::move(r);
+    return;
+  }
+  records_by_slot.insert(mix_hash(slot), records.size(),
+                         [](uint32_t) { return false; });
+  records.push_back(std::move(r));
+}
+
+void partition_table::freeze() {
+  if (removals) drop_removed();
+  if (!frozen) sort_by_topic();
+  if (!names_sorted) sort_by_name();
+  for (uint32_t t = 0; t < topic_count(); ++t) {
+    if (topic_named[t] && !topic_fragment[t]) encode_topic(t);
+  }
+}
+
+void partition_table::drop_removed() {
+  // one pass however many topics went
+  for (uint32_t s = 0; s < partition_count(); ++s) {
+    uint32_t t = partition_topic[s];
+    if (t == NONE || !topic_removed[t]) continue;
+    partition_by_key.erase(hash_partition(t, partition_index[s]),
+                           [&](uint32_t other) { return other == s; });
+    uint32_t r = records_by_slot.find(mix_hash(s), [](uint32_t) {
+      return true;
+    });
+    if (r != NONE) {
+      records[r].reset();
+      records_by_slot.erase(mix_hash(s), [](uint32_t) { return true; });
+    }
+    partition_topic.mut(s) = NONE;
+  }
+  removals = false;
+}
+
+void partition_table::sort_by_topic() {
+  // counting sort by topic, then each topic's slots by partition index
+  auto order = std::make_shared<topic_order>();
+  std::vector<uint32_t> &first = order->first;
+  std::vector<uint32_t> &slots = order->slots;
+  first.assign(topic_count() + 1, 0);
+  for (uint32_t s = 0; s < partition_count(); ++s) {
+    if (partition_topic[s] != NONE) ++first[partition_topic[s] + 1];
+  }
+  for (size_t t = 0; t < topic_count(); ++t) first[t + 1] += first[t];
+  slots.resize(first.back());
+  std::vector<uint32_t> next(first.begin(), first.end() - 1);
+  for (uint32_t s = 0; s < partition_count(); ++s) {
+    if (partition_topic[s] != NONE) slots[next[partition_topic[s]]++] = s;
+  }
+  for (size_t t = 0; t < topic_count(); ++t) {
+    std::sort(slots.begin() + first[t], slots.begin() + first[t + 1],
+              [&](uint32_t a, uint32_t b) {
+                return partition_index[a] < partition_index[b];
+              });
+  }
+  by_topic = std::move(order);
+  frozen = true;
+}
+
+void partition_table::sort_by_name() {
+  auto order = std::make_shared<std::vector<uint32_t>>();
+  for (uint32_t t = 0; t < topic_count(); ++t) {
+    // a name given again belongs to the topic it finds
+    if (topic_named[t] && find_topic(topic_name(t)) == t) order->push_back(t);
+  }
+  std::sort(order->begin(), order->end(), [&](uint32_t a, uint32_t b) {
+    return topic_name(a) < topic_name(b);
+  });
+  by_name = std::move(order);
+  names_sorted = true;
+}
@@ -0,0 +1,234 @@
+#ifndef INCLUDE_GLOBAL_PARTITION_TABLE_HPP_
+#define INCLUDE_GLOBAL_PARTITION_TABLE_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cow_vector.hpp"
+#include "flat_index.hpp"
+#include "primitive.hpp"
+#include "response_message.hpp"
+#include "uuid.hpp"
+
+// Lists stored once however many partitions have them. List l is
+// values[start[l], start[l + 1]); list 0 is the null one, kept apart from
+// the empty list. The pool grows with the distinct lists, not with the
+// partitions using them, so it is copied whole with the table.
+template <typename T>
+struct interned_lists {
+  static constexpr uint32_t NULL_LIST = 0;
+
+  std::vector<T> values;
+  std::vector<uint32_t> start{0, 0};
+  flat_index by_values;
+
+  std::span<T const> operator[](uint32_t l) const {
+    return std::span(values).subspan(start[l], start[l + 1] - start[l]);
+  }
+
+  // whether the list is one of the pool's, which interning finds without
+  // appending to values, so without moving the others
+  bool owns(std::span<T const> list) const {
+    std::less_equal<T const *> le;
+    return le(values.data(), list.data()) &&
+           le(list.data() + list.size(), values.data() + values.size());
+  }
+
+  // the list with these values, EMPTY when there is none
+  uint32_t find(std::span<T const> list) const {
+    return by_values.find(hash_bytes(list.data(), list.size_bytes()),
+                          [&](uint32_t l) {
+                            std::span<T const> have = (*this)[l];
+                            return std::equal(have.begin(), have.end(),
+                                              list.begin(), list.end());
+                          });
+  }
+
+  // appending a list may move values, so the list must not point into it
+  uint32_t intern(std::optional<std::span<T const>> list) {
+    if (!list) return NULL_LIST;
+    uint32_t l = find(*list);
+    if (l != flat_index::EMPTY) return l;
+    uint64_t h = hash_bytes(list->data(), list->size_bytes());
+    l = start.size() - 1;
+    values.insert(values.end(), list->begin(), list->end());
+    start.push_back(values.size());
+    by_values.insert(h, l, [](uint32_t) { return false; });
+    return l;
+  }
+};
+
+// Topics and partitions of the cluster, column by column. Topics are dense
+// indexes into the topic columns and partitions dense slots into the
+// partition columns, so a million partitions are a few flat arrays rather
+// than a million heap nodes. Replica lists are interned: partitions with the
+// same replicas share one list in a common pool. Topics are found by uuid or
+// name and partitions by (topic, index) through flat_index.
+//
+// Each named topic is also kept encoded as a whole DescribeTopicPartitions
+// res_topic_info, partitions included, and as a Metadata res_k3_topic, so
+// answering is copying bytes out.
+//
+// Rows are added, updated, or removed with their topic. Changes leave the
+// per-topic order and the encoded topics of the topics they touch stale until
+// freeze(), which is done before the table is published and only encodes the
+// topics that changed. A removed topic keeps its row, unnamed, and its
+// partitions their slots, with no topic; they are dropped when the next start
+// loads the table from a snapshot.
+//
+// The table is published as immutable versions, each the last one copied
+// with a metadata batch applied. Columns and indexes are cow_vectors, the
+// encoded topics and the topic order shared pointers, so a copy shares all
+// of that and a change only copies the chunks it writes to.
+struct partition_table {
+  static constexpr uint32_t NONE = flat_index::EMPTY;
+  static constexpr uint32_t NULL_LIST = interned_lists<int32_t>::NULL_LIST;
+
+  using ids = std::optional<std::span<int32_t const>>;
+
+  // a partition as added, nullopt for a null list; lists are copied
+  struct partition_state {
+    int32_t partition_index{};
+    int32_t leader_id{};
+    int32_t leader_epoch{};
+    int32_t partition_epoch{};
+    ids replicas;
+    ids isr;
+    ids adding_replicas;
+    ids removing_replicas;
+    ids eligible_leader_replicas;
+    ids last_known_elr;
+    ids offline_replicas;
+    std::optional<std::span<uuid128 const>> directories;
+  };
+
+  // per topic
+  cow_vector<uuid128> topic_id;
+  // a topic only seen through its partitions has no name
+  cow_vector<std::string> topic_names;
+  std::vector<bool> topic_named;
+  std::vector<bool> topic_removed;
+  // a topic as the requests that find it send it
+  struct topic_bytes {
+    // res_topic_info; partition j of the topic in index order is
+    // describe[partition_at[j], partition_at[j + 1])
+    std::vector<int8_t> describe;
+    std::vector<uint32_t> partition_at;
+    // res_k3_topic up to its partitions, with the topic id at metadata_id_at
+    std::vector<int8_t> metadata;
+    size_t metadata_id_at{};
+  };
+  // null once the topic changed
+  cow_vector<std::shared_ptr<topic_bytes const>> topic_fragment;
+
+  // per partition slot; lists are ids into lists or directory_lists
+  // NONE once the topic is removed
+  cow_vector<uint32_t> partition_topic;
+  cow_vector<int32_t> partition_index;
+  cow_vector<int32_t> leader_id;
+  cow_vector<int32_t> leader_epoch;
+  cow_vector<int32_t> partition_epoch;
+  cow_vector<uint32_t> replicas;
+  cow_vector<uint32_t> isr;
+  cow_vector<uint32_t> adding_replicas;
+  cow_vector<uint32_t> removing_replicas;
+  cow_vector<uint32_t> eligible_leader_replicas;
+  cow_vector<uint32_t> last_known_elr;
+  cow_vector<uint32_t> offline_replicas;
+  cow_vector<uint32_t> directories;
+
+  // slots ordered by topic, then partition index; a topic's partitions are
+  // slots[first[t], first[t + 1]). Rebuilt whole when partitions come or go
+  struct topic_order {
+    std::vector<uint32_t> first{0};
+    std::vector<uint32_t> slots;
+  };
+  std::shared_ptr<topic_order const> by_topic =
+      std::make_shared<topic_order const>();
+  bool frozen{true};
+  // the partitions of removed topics still have their topic
+  bool removals{false};
+  // the topic each name finds, ordered by name
+  std::shared_ptr<std::vector<uint32_t> const> by_name =
+      std::make_shared<std::vector<uint32_t> const>();
+  bool names_sorted{true};
+
+  interned_lists<int32_t> lists;
+  interned_lists<uuid128> directory_lists;
+
+  // what a partition log holds, for the few partitions read at startup
+  std::vector<std::shared_ptr<scarray<sint8> const>> records;
+
+  flat_index topic_by_id;
+  flat_index topic_by_name;
+  flat_index partition_by_key;
+  flat_index records_by_slot;
+
+  size_t topic_count() const { return topic_id.size(); }
+  size_t partition_count() const { return partition_topic.size(); }
+
+  uint32_t find_topic(uuid128 const &id) const;
+  // the topic last given this name
+  uint32_t find_topic(std::string_view name) const;
+  uint32_t find_partition(uint32_t topic, int32_t index) const;
+
+  std::string_view topic_name(uint32_t t) const { return topic_names[t]; }
+  // slots of the topic's partitions in index order
+  std::span<uint32_t const> partitions(uint32_t t) const {
+    std::vector<uint32_t> const &first = by_topic->first;
+    return std::span(by_topic->slots)
+        .subspan(first[t], first[t + 1] - first[t]);
+  }
+  std::span<int32_t const> list(uint32_t l) const { return lists[l]; }
+  // the topics named from name on, in name order
+  std::span<uint32_t const> topics_from(std::string_view name) const;
+  // only for named topics of a frozen table
+  std::span<int8_t const> encoded_topic(uint32_t t) const {
+    return topic_fragment[t]->describe;
+  }
+  topic_bytes const &metadata_topic(uint32_t t) const {
+    return *topic_fragment[t];
+  }
+  // the j-th of the topic's partitions in index order, as encoded_topic()
+  // has it
+  std::span<int8_t const> encoded_partition(uint32_t t, size_t j) const {
+    topic_bytes const &b = *topic_fragment[t];
+    return std::span(b.describe)
+        .subspan(b.partition_at[j], b.partition_at[j + 1] - b.partition_at[j]);
+  }
+  std::shared_ptr<scarray<sint8> const> const *find_records(
+      uint32_t slot) const;
+  // the partition as added, its lists pointing into the table
+  partition_state state(uint32_t slot) const;
+  // the partition as DescribeTopicPartitions sends it
+  void fill(res_partition &p, uint32_t slot) const;
+  // and as Metadata sends it
+  void fill(res_k3_partition &p, uint32_t slot) const;
+
+  uint32_t find_or_add_topic(uuid128 const &id);
+  // names the topic with this uuid, adding it if needed
+  uint32_t add_topic(std::string_view name, uuid128 const &id);
+  // adds the partition, or updates it when the topic already has its index
+  uint32_t add_partition(uuid128 const &topic, partition_state const &p);
+  // false when there is no such topic
+  bool remove_topic(uuid128 const &id);
+  void set_records(uint32_t slot, std::shared_ptr<scarray<sint8> const> r);
+  uint32_t intern_list(ids values) { return lists.intern(values); }
+
+  // brings the per-topic and name orders and the encoded topics up to date
+  void freeze();
+  void encode_topic(uint32_t t);
+  void list_of(scfixarray<int32_t> &a, uint32_t l) const;
+  void drop_removed();
+  void sort_by_topic();
+  void sort_by_name();
+};
+
+#endif  // INCLUDE_GLOBAL_PARTITION_TABLE_HPP_
@@ -0,0 +1,313 @@
+#include "snapshot.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <regex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "constants.hpp"
+#include "datamap.hpp"
+#include "log_reader.hpp"
+#include "record.hpp"
+
+std::atomic<int64_t> metadata_snapshot_offset;
+
+namespace {
+
+size_t const SNAPSHOT_BATCH_RECORDS = 1000;
+// what a record adds to its value: sizes, offset and timestamp deltas, key,
+// headers, frame version, type and version
+size_t const RECORD_OVERHEAD = 64;
+// base offset up to the record count
+size_t const BATCH_HEADER_SIZE = 61;
+
+// a checkpoint starts with a batch of one NoOpRecord, whose headers name the
+// log batch the checkpoint ends with
+int8_t const NO_OP_RECORD = 20;
+char const LOG_BATCH_OFFSET[] = "log-batch-offset";
+char const LOG_BATCH_CRC[] = "log-batch-crc";
+// what that batch takes at most
+int32_t const POSITION_BATCH_MAX_SIZE = 256;
+
+struct checkpoint {
+  int64_t end_offset;
+  std::string path;
+};
+
+// oldest first
+std::vector<checkpoint> list_checkpoints(std::string const &dir) {
+  static std::regex const checkpoint_pattern(
+      "^(\\d{20})-(\\d{10})\\.checkpoint$");
+  std::vector<checkpoint> found;
+  std::error_code ec;
+  for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    std::smatch m;
+    std::string name = it->path().filename().string();
+    if (std::regex_match(name, m, checkpoint_pattern))
+      found.push_back({std::stoll(m[1].str()), it->path().string()});
+  }
+  std::sort(found.begin(), found.end(),
+            [](checkpoint const &a, checkpoint const &b) {
+              return a.end_offset < b.end_offset;
+            });
+  return found;
+}
+
+// there is a single leader epoch, no raft election takes place here
+std::string checkpoint_path(std::string const &dir, int64_t end_offset) {
+  return dir + "/" + offset_file_name(end_offset) + "-0000000000.checkpoint";
+}
+
+record value_record(int8_t type, int8_t version,
+                    std::shared_ptr<record_value_gen_t> value) {
+  record r;
+  r.value.frame_version.val = 1;
+  r.value.type.val = type;
+  r.value.version.val = version;
+  r.value.value = std::move(value);
+  return r;
+}
+
+record position_record(metadata_image const &m) {
+  auto v = std::make_shared<record_value_raw_t>();
+  // no tagged fields
+  v->data.push_back(0);
+  record r = value_record(NO_OP_RECORD, 0, v);
+  for (auto [key, value] :
+       {std::pair(LOG_BATCH_OFFSET, std::to_string(m.last_batch_offset)),
+        std::pair(LOG_BATCH_CRC, std::to_string(m.last_batch_crc))}) {
+    record_header &h = r.headers.val.emplace_back();
+    h.key = record_string_t(key);
+    h.value = record_string_t(value);
+  }
+  return r;
+}
+
+// false when r is not a position record
+bool read_position(record const &r, metadata_image &m) {
+  if (r.value.type.val != NO_OP_RECORD) return false;
+  bool offset{}, crc{};
+  for (record_header const &h : r.headers.val) {
+    std::string const &v = h.value.val;
+    if (h.key.val == LOG_BATCH_OFFSET)
+      offset = std::from_chars(v.data(), v.data() + v.size(),
+                               m.last_batch_offset).ec == std::errc();
+    else if (h.key.val == LOG_BATCH_CRC)
+      crc = std::from_chars(v.data(), v.data() + v.size(), m.last_batch_crc)
+                .ec == std::errc();
+  }
+  return offset && crc;
+}
+
+// whether the checkpoint starts with a position batch, i.e. it was written by
+// write_metadata_snapshot and not by someone else sharing the directory
+bool written_here(std::string const &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  int8_t frame[log_reader::BATCH_FRAME_SIZE + POSITION_BATCH_MAX_SIZE];
+  ssize_t n = pread(fd, frame, sizeof(frame), 0);
+  close(fd);
+  if (n < ssize_t(log_reader::BATCH_FRAME_SIZE)) return false;
+  int32_t len = load_big_endian<int32_t>(frame + 8);
+  if (len < 0 || len > n - ssize_t(log_reader::BATCH_FRAME_SIZE)) return false;
+  record_batch rb;
+  try {
+    decode_bounds bounds(frame, log_reader::BATCH_FRAME_SIZE + len);
+    rb.deserialize(frame);
+  } catch (decode_error const &) {
+    return false;
+  }
+  metadata_image position;
+  return rb.records.val.size() == 1 &&
+         read_position(rb.records.val[0], position);
+}
+
+// record batches appended to a file, offsets counting from 0
+struct batch_file {
+  FILE *f{};
+  int64_t next_offset{};
+  std::vector<record> pending;
+  // what pending can take at most once encoded
+  size_t bound{BATCH_HEADER_SIZE};
+  std::vector<int8_t> buf;
+  bool ok{true};
+
+  void add(record r, size_t max_size) {
+    r.offset_delta.val = pending.size();
+    pending.push_back(std::move(r));
+    bound += RECORD_OVERHEAD + max_size;
+    if (pending.size() == SNAPSHOT_BATCH_RECORDS) flush();
+  }
+
+  void add_topic(partition_table const &table, uint32_t t) {
+    std::string_view name = table.topic_name(t);
+    auto v = std::make_shared<record_value_type2_t>();
+    v->topic_name = scstring(std::string(name));
+    v->topic_uuid = suuid(table.topic_id[t]);
+    add(value_record(2, 0, v), 32 + name.size());
+  }
+
+  void add_partition(partition_table const &table, uint32_t slot) {
+    auto v = std::make_shared<record_value_type3_t>();
+    size_t ids{};
+    // PartitionRecord has no null lists
+    auto list_of = [&](scfixarray<int32_t> &a, uint32_t l) {
+      std::span<int32_t const> list = table.list(l);
+      a.val.assign(list.begin(), list.end());
+      a.is_null = false;
+      ids += list.size();
+    };
+    v->partition_id.val = table.partition_index[slot];
+    v->topic_uuid = suuid(table.topic_id[table.partition_topic[slot]]);
+    list_of(v->replica_array, table.replicas[slot]);
+    list_of(v->in_sync_replica_array, table.isr[slot]);
+    list_of(v->removing_replica_array, table.removing_replicas[slot]);
+    list_of(v->adding_replica_array, table.adding_replicas[slot]);
+    v->leader.val = table.leader_id[slot];
+    v->leader_epoch.val = table.leader_epoch[slot];
+    v->partition_epoch.val = table.partition_epoch[slot];
+    v->directories_array.is_null = false;
+    for (uuid128 const &d : table.directory_lists[table.directories[slot]])
+      v->directories_array.val.emplace_back(d);
+    size_t directories = v->directories_array.val.size();
+    // the ELR lists are tagged fields from v2, only written when not empty
+    std::span<int32_t const> elr = table.list(table.eligible_leader_replicas[slot]);
+    std::span<int32_t const> last_elr = table.list(table.last_known_elr[slot]);
+    record r = value_record(3, elr.empty() && last_elr.empty() ? 1 : 2, v);
+    for (auto [tag, list] : {std::pair(1, elr), std::pair(2, last_elr)}) {
+      if (list.empty()) continue;
+      scfixarray<int32_t> a(std::vector<int32_t>(list.begin(), list.end()));
+      r.value.tagged_fields.fields.push_back(
+          encode_tag(tag, a, suvint::MAX_SIZE + 4 * list.size()));
+      ids += list.size();
+    }
+    add(std::move(r), 64 + 4 * ids + 16 * directories + 2 * 16);
+  }
+
+  void flush() {
+    if (pending.empty()) return;
+    record_batch rb;
+    rb.base_offset.val = next_offset;
+    rb.magic_byte.val = 2;
+    rb.last_offset_data.val = pending.size() - 1;
+    rb.producer_id.val = -1;
+    rb.producer_epoch.val = -1;
+    rb.base_sequence.val = -1;
+    rb.records.is_null = false;
+    for (record &r : pending) rb.records.val.push_back(std::move(r));
+    buf.resize(bound);
+    int32_t n = rb.serialize(buf.data());
+    sint32(n - log_reader::BATCH_FRAME_SIZE).serialize(buf.data() + 8);
+    ok = ok && std::fwrite(buf.data(), 1, n, f) == size_t(n);
+    next_offset += pending.size();
+    pending.clear();
+    bound = BATCH_HEADER_SIZE;
+  }
+};
+
+// makes a rename in dir survive a crash
+void sync_dir(std::string const &dir) {
+  int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) return;
+  fsync(fd);
+  close(fd);
+}
+
+}  // namespace
+
+bool write_metadata_snapshot(std::string const &dir, metadata_image const &m) {
+  int64_t end_offset = m.end_offset;
+  std::string path = checkpoint_path(dir, end_offset);
+  std::string part = path + ".part";
+  FILE *f = std::fopen(part.c_str(), "wb");
+  if (!f) {
+    std::cerr << "cannot create " << part << std::endl;
+    return false;
+  }
+
+  batch_file out;
+  out.f = f;
+  out.add(position_record(m), 96);
+  out.flush();
+  partition_table const &table = m.partitions;
+  // a name given to several topics goes last to the one it finds, so that it
+  // finds the same one after loading
+  for (int pass = 0; pass < 2; ++pass) {
+    for (uint32_t t = 0; t < table.topic_count(); ++t) {
+      if (!table.topic_named[t]) continue;
+      bool found = table.find_topic(table.topic_name(t)) == t;
+      if (found == (pass == 1)) out.add_topic(table, t);
+    }
+  }
+  // partitions whose topic record was never seen are kept as they are
+  for (uint32_t slot = 0; slot < table.partition_count(); ++slot) {
+    if (table.partition_topic[slot] != partition_table::NONE)
+      out.add_partition(table, slot);
+  }
+  out.flush();
+
+  bool ok = out.ok && std::fflush(f) == 0 && fsync(fileno(f)) == 0;
+  ok = std::fclose(f) == 0 && ok;
+  if (!ok || std::rename(part.c_str(), path.c_str()) != 0) {
+    std::cerr << "cannot write " << path << std::endl;
+    std::remove(part.c_str());
+    return false;
+  }
+  sync_dir(dir);
+  metadata_snapshot_offset = end_offset;
+  std::cout << "wrote metadata snapshot " << path << std::endl;
+
+  // checkpoints others left in the directory are theirs to remove
+  std::vector<checkpoint> ours = list_checkpoints(dir);
+  std::erase_if(ours,
+                [](checkpoint const &c) { return !written_here(c.path); });
+  for (size_t i = 0; i + SNAPSHOTS_KEPT < ours.size(); ++i)
+    std::remove(ours[i].path.c_str());
+  return true;
+}
+
+bool maybe_write_metadata_snapshot(std::string const &dir) {
+  std::shared_ptr<metadata_image const> m = current_metadata();
+  if (m->end_offset - metadata_snapshot_offset < SNAPSHOT_MIN_RECORDS)
+    return false;
+  return write_metadata_snapshot(dir, *m);
+}
+
+int64_t load_metadata_snapshot(std::string const &dir, metadata_image &m) {
+  std::vector<checkpoint> all = list_checkpoints(dir);
+  for (auto it = all.rbegin(); it != all.rend(); ++it) {
+    m = metadata_image();
+    log_reader reader(dir);
+    bool ok = reader.read_file(it->path, [&](record_batch &rb) {
+      for (record &r : rb.records.val) {
+        if (!read_position(r, m)) apply_metadata_record(m, r);
+      }
+    });
+    m.partitions.freeze();
+    if (ok) {
+      std::cout << "loaded metadata snapshot " << it->path << std::endl;
+      metadata_snapshot_offset = it->end_offset;
+      return it->end_offset;
+    }
+    std::cerr << "ignoring unreadable snapshot " << it->path << std::endl;
+  }
+  m = metadata_image();
+  metadata_snapshot_offset = 0;
+  return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef INCLUDE_GLOBAL_SNAPSHOT_HPP_
+#define INCLUDE_GLOBAL_SNAPSHOT_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "datamap.hpp"
+
+// Checkpoints of the metadata state, written as KRaft names them,
+// <end offset>-<epoch>.checkpoint, next to the log segments. A checkpoint
+// holds record batches with one topic record per topic and one partition
+// record per partition, the state after applying every record before its end
+// offset, so startup only replays the log from there on. Checkpoints are
+// written to a temporary file and renamed, a reader never sees half of one.
+//
+// The first batch of a checkpoint names the log batch it ends with, by base
+// offset and CRC, so replay_metadata_log() can tell a checkpoint of this log
+// from one left by an earlier log. Only checkpoints starting that way are
+// removed once newer ones are written.
+
+// end offset of the snapshot last loaded or written, 0 when none was; written
+// by the snapshot thread, read by others
+extern std::atomic<int64_t> metadata_snapshot_offset;
+
+// checkpoints m at its end offset; false when it could not be written
+bool write_metadata_snapshot(std::string const &dir, metadata_image const &m);
+
+// checkpoints the current metadata once SNAPSHOT_MIN_RECORDS were applied
+// since the last checkpoint
+bool maybe_write_metadata_snapshot(std::string const &dir);
+
+// loads the newest checkpoint that reads back whole into m and returns its
+// end offset; 0 with m left empty when there is none. Whether it matches the
+// log is left to the caller
+int64_t load_metadata_snapshot(std::string const &dir, metadata_image &m);
+
+#endif  // INCLUDE_GLOBAL_SNAPSHOT_HPP_
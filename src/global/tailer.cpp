@@ -0,0 +1,53 @@
+#include "tailer.hpp"
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+
+#include "constants.hpp"
+#include "datamap.hpp"
+
+size_t metadata_tailer::poll() {
+  // copied once there is something to apply, published once all of it is
+  std::shared_ptr<metadata_image> next;
+  size_t batches = reader.read([&](record_batch &rb) {
+    if (!next) next = std::make_shared<metadata_image>(*current_metadata());
+    apply_metadata_batch(*next, rb);
+  });
+  if (next) {
+    next->partitions.freeze();
+    publish_metadata(next);
+  }
+  return batches;
+}
+
+void metadata_tailer::run() {
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd >= 0 &&
+      inotify_add_watch(fd, reader.dir.c_str(),
+                        IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE |
+                            IN_MOVED_TO) < 0) {
+    close(fd);
+    fd = -1;
+  }
+  if (fd < 0)
+    std::cerr << "no inotify on " << reader.dir << ", polling every "
+              << METADATA_POLL_MS << "ms" << std::endl;
+
+  alignas(inotify_event) char events[4096];
+  while (!stopping) {
+    pollfd p{fd, POLLIN, 0};
+    ::poll(&p, fd < 0 ? 0 : 1, METADATA_POLL_MS);
+    // the events only say something changed, poll() finds out what
+    if (fd >= 0)
+      while (read(fd, events, sizeof(events)) > 0) {
+      }
+    poll();
+  }
+  if (fd >= 0) close(fd);
+}
@@ -0,0 +1,31 @@
+#ifndef INCLUDE_GLOBAL_TAILER_HPP_
+#define INCLUDE_GLOBAL_TAILER_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+#include "log_reader.hpp"
+
+// Follows the metadata log after startup: batches appended to it, or to
+// segments created later, are applied to the metadata in datamap.hpp as they
+// land. run() wakes up on inotify events for the log directory and in any
+// case every METADATA_POLL_MS, which also covers file systems without
+// inotify. What one poll() finds is applied to a single copy of the current
+// metadata_image, published when done; the copy shares whatever the batches
+// leave alone with the current version, see partition_table.
+struct metadata_tailer {
+  log_reader reader;
+  std::atomic<bool> stopping{false};
+
+  explicit metadata_tailer(std::string dir) : reader(std::move(dir)) {}
+
+  // applies what was appended since the last call; returns how many batches
+  size_t poll();
+
+  // polls until stop()
+  void run();
+  void stop() { stopping = true; }
+};
+
+#endif  // INCLUDE_GLOBAL_TAILER_HPP_
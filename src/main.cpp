@@ -2,9 +2,14 @@
 #include <netdb.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
@@ -12,68 +17,87 @@
 #include <iostream>
 #include <ostream>
 #include <thread>
-
-#include "api/api_all.hpp"
+#include <vector>
+
+#include "api/api_registry.hpp"
+#include "api/message_pool.hpp"
+#include "api/response_cache.hpp"
+#include "arena.hpp"
+#include "buffer_pool.hpp"
+#include "chunk_writer.hpp"
 #include "constants.hpp"
 #include "datamap.hpp"
 #include "primitive.hpp"
 #include "request_message.hpp"
 #include "response_message.hpp"
+#include "snapshot.hpp"
+
+// sends everything in w, however many writev calls that takes
+bool send_chunks(int fd, chunk_writer const &w, std::vector<iovec> &iov) {
+  w.iovecs(iov);
+  size_t first{};
+  while (first < iov.size()) {
+    int n = std::min<size_t>(iov.size() - first, IOV_MAX);
+    ssize_t sent = writev(fd, iov.data() + first, n);
+    if (sent < 0) return false;
+    // drop what went out, including the sent part of a partial iovec
+    while (first < iov.size() && size_t(sent) >= iov[first].iov_len) {
+      sent -= iov[first++].iov_len;
+    }
+    if (sent > 0) {
+      iov[first].iov_base = static_cast<int8_t *>(iov[first].iov_base) + sent;
+      iov[first].iov_len -= sent;
+    }
+  }
+  return true;
+}
+
+// reads exactly n bytes; false when the client goes away first
+bool recv_all(int fd, int8_t *buf, size_t n) {
+  while (n > 0) {
+    ssize_t got = recv(fd, buf, n, 0);
+    if (got < 0 && errno == EINTR) continue;
+    if (got <= 0) return false;
+    buf += got;
+    n -= got;
+  }
+  return true;
+}
 
 void process_connection(int client_fd, std::atomic<int> *pool) {
-  int8_t in[BUFSIZ], out[BUFSIZ];
-  int32_t len_in, len_out;
-  while ((len_in = recv(client_fd, in, BUFSIZ, 0)) > 0) {
-    int32_t offset{};
-    while (offset < len_in) {
-      int32_t orig_offset{offset};
-      sint32 msg_len;
-      offset += msg_len.deserialize(in + offset);
-
-      request_header_v2 req_header;
-      offset += req_header.deserialize(in + offset);
-
-      switch (req_header.request_api_key.val) {
-        case 1: {
-          response_header_v1 res_header;
-          res_header.correlation_id = req_header.correlation_id;
-          request_k1_v16 req(&req_header);
-          response_k1_v16 res(&res_header);
-          offset += req.deserialize(in + offset);
-          api_fetch_k1_v16(&req, &res);
-          len_out = write_message(out, &res);
-          break;
-        }
-        case 18: {
-          response_header_v0 res_header;
-          res_header.correlation_id = req_header.correlation_id;
-          request_k18_v4 req(&req_header);
-          response_k18_v4 res(&res_header);
-          offset += req.deserialize(in + offset);
-          // std::cout << "read " << offset << " characters" << std::endl;
-          api_api_version_k18_v4(&req, &res);
-          len_out = write_message(out, &res);
-          break;
-        }
-        case 75: {
-          response_header_v1 res_header;
-          res_header.correlation_id = req_header.correlation_id;
-          request_k75_v0 req(&req_header);
-          response_k75_v0 res(&res_header);
-          offset += req.deserialize(in + offset);
-          api_describe_topic_partitions(&req, &res);
-          len_out = write_message(out, &res);
-          break;
-        }
-        default:
-          std::cout << "no api match" << std::endl;
+  int8_t size[sizeof(int32_t)];
+  // before the arena, so the pooled messages never allocate from it
+  message_pool msgs;
+  msg_arena arena;
+  // responses of any size, in chunks kept for the next request
+  chunk_writer out;
+  std::vector<iovec> iov;
+  try {
+    // a request at a time: its size, then a buffer holding all of it
+    while (recv_all(client_fd, size, sizeof(size))) {
+      int32_t len = load_big_endian<int32_t>(size);
+      if (len < 0) throw decode_error("negative message size");
+      if (len > MAX_REQUEST_SIZE) throw decode_error("message too large");
+      pooled_buffer in_buf(len);
+      int8_t *in = in_buf.data;
+      if (!recv_all(client_fd, in, len)) break;
+
+      msg_arena_scope request_scope(arena);
+      out.clear();
+      // nothing is read past the end of the request, see decode_bounds
+      decode_bounds frame(in, len);
+      int32_t offset = msgs.req_header.deserialize(in);
+      if (serve_request(msgs, in + offset, out) < 0) {
+        std::cout << "no api match" << std::endl;
       }
 
-      send(client_fd, out, len_out, 0);
-      offset = orig_offset + sizeof(int32_t) + msg_len.val;
-      std::cout << "done sending " << len_in << std::endl
-                << "offset " << offset << " len " << len_in << std::endl;
+      if (!send_chunks(client_fd, out, iov)) break;
+      std::cout << "done sending " << len << std::endl;
     }
+  } catch (decode_error const &e) {
+    // the stream can't be resynchronised after a bad frame
+    std::cerr << "closing connection on malformed request: " << e.what()
+              << std::endl;
   }
 
   close(client_fd);
@@ -85,7 +109,23 @@ int main(int argc, char *argv[]) {
   std::cout << std::unitbuf;
   std::cerr << std::unitbuf;
 
+  // slabs on huge pages, worth it once there are many connections
+  buffer_pool_use_huge_pages(std::getenv("KRAPKA_HUGE_PAGES") != nullptr);
+
   initialize();
+  rebuild_response_cache();
+
+  // checkpoints what was applied since the last snapshot, and logs what the
+  // buffer pool holds
+  std::thread([] {
+    while (true) {
+      std::this_thread::sleep_for(std::chrono::seconds(SNAPSHOT_PERIOD_SECONDS));
+      maybe_write_metadata_snapshot(METADATA_LOG_DIR);
+      std::cout << format_buffer_pool_stats(current_buffer_pool_stats());
+    }
+  }).detach();
+  // topics created from now on show up without a restart
+  std::thread([] { metadata_log.run(); }).detach();
 
   int server_fd = socket(AF_INET, SOCK_STREAM, 0);
   if (server_fd < 0) {
@@ -106,12 +146,12 @@ int main(int argc, char *argv[]) {
   struct sockaddr_in server_addr{};
   server_addr.sin_family = AF_INET;
   server_addr.sin_addr.s_addr = INADDR_ANY;
-  server_addr.sin_port = htons(9092);
+  server_addr.sin_port = htons(BROKER_PORT);
 
   if (bind(server_fd, reinterpret_cast<struct sockaddr *>(&server_addr),
            sizeof(server_addr)) != 0) {
     close(server_fd);
-    std::cerr << "Failed to bind to port 9092" << std::endl;
+    std::cerr << "Failed to bind to port " << BROKER_PORT << std::endl;
     return 1;
   }
 
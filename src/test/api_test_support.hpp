@@ -0,0 +1,138 @@
+#ifndef API_TEST_SUPPORT_H
+#define API_TEST_SUPPORT_H
+
+#include <sys/uio.h>
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "api_registry.hpp"
+#include "arena.hpp"
+#include "chunk_writer.hpp"
+#include "datamap.hpp"
+#include "message_pool.hpp"
+#include "partition_table.hpp"
+#include "primitive.hpp"
+#include "request_message.hpp"
+#include "uuid.hpp"
+
+// What the tests of the request handlers share: a connection serving
+// requests as the broker does, a published topic to ask about, and requests
+// built from their fields.
+
+int const BS = 4096;
+
+// one connection as process_connection sees it: pooled messages built
+// before the request arena, responses into a reused chunk chain
+struct connection {
+  message_pool msgs;
+  msg_arena arena;
+  chunk_writer out;
+
+  int32_t serve(int8_t* in) {
+    msg_arena_scope request_scope(arena);
+    out.clear();
+    int32_t offset = sizeof(int32_t);
+    offset += msgs.req_header.deserialize(in + offset);
+    return serve_request(msgs, in + offset, out);
+  }
+
+  // the response as one contiguous frame
+  std::vector<int8_t> frame() const {
+    std::vector<iovec> iov;
+    out.iovecs(iov);
+    std::vector<int8_t> f;
+    for (iovec const& v : iov) {
+      auto p = static_cast<int8_t const*>(v.iov_base);
+      f.insert(f.end(), p, p + v.iov_len);
+    }
+    return f;
+  }
+};
+
+inline uuid128 const FOO = [] {
+  uuid128 id;
+  uuid128::parse("00000000-0000-4000-8000-000000000091", id);
+  return id;
+}();
+
+// publishes topic foo with partitions 0 and 1, 200 bytes of records in 0
+inline void load_topics() {
+  auto m = std::make_shared<metadata_image>();
+  partition_table& table = m->partitions;
+  table.add_topic("foo", FOO);
+  std::vector<int32_t> replicas{1, 2, 3};
+  std::vector<int32_t> isr{1, 2};
+  std::vector<int32_t> none;
+  partition_table::partition_state p;
+  p.leader_id = 1;
+  p.leader_epoch = 0;
+  p.replicas = replicas;
+  p.isr = isr;
+  p.eligible_leader_replicas = none;
+  p.last_known_elr = none;
+  p.offline_replicas = none;
+  for (int32_t i = 0; i < 2; ++i) {
+    p.partition_index = i;
+    table.add_partition(FOO, p);
+  }
+  auto records = std::make_shared<scarray<sint8>>();
+  records->is_null = false;
+  records->val.assign(200, sint8(7));
+  table.set_records(table.find_partition(0, 0), records);
+  table.freeze();
+  publish_metadata(m);
+}
+
+// DescribeTopicPartitions for the topics, all of them when there are none
+inline int32_t describe_request(int8_t* in,
+                                std::vector<std::string_view> topics,
+                                int32_t limit,
+                                std::string_view cursor_topic = {},
+                                int32_t cursor_partition = -1) {
+  request_header_v2 header;
+  header.request_api_key.val = 75;
+  header.request_api_version.val = 0;
+  header.correlation_id.val = 8;
+  header.client_id = snstring_view("test");
+  request_k75_v0 req(&header);
+  req.topics.is_null = false;
+  for (std::string_view name : topics) {
+    req.topics.emplace_back().name = scstring_view(name);
+  }
+  req.response_partition_limit.val = limit;
+  req.cursor.is_null = cursor_partition < 0;
+  req.cursor.topic_name = scstring_view(cursor_topic);
+  req.cursor.partition_index.val = cursor_partition;
+  int32_t len = header.serialize(in + sizeof(int32_t));
+  len += req.serialize(in + sizeof(int32_t) + len);
+  sint32(len).serialize(in);
+  return len;
+}
+
+// Metadata for the topics by name, then by id; all of them when all is set
+inline int32_t metadata_request(int8_t* in, int16_t version,
+                                std::vector<std::string_view> names,
+                                std::vector<uuid128> ids = {},
+                                bool all = false) {
+  request_header_v2 header;
+  header.request_api_key.val = 3;
+  header.request_api_version.val = version;
+  header.correlation_id.val = 10;
+  header.client_id = snstring_view("test");
+  request_k3 req(&header);
+  req.topics.is_null = all;
+  for (std::string_view name : names) {
+    req.topics.emplace_back().name = scnstring_view(name);
+  }
+  for (uuid128 const& id : ids) req.topics.emplace_back().topic_id = suuid(id);
+  req.include_topic_authorized_operations.val = true;
+  int32_t len = header.serialize(in + sizeof(int32_t));
+  len += req.serialize(in + sizeof(int32_t) + len);
+  sint32(len).serialize(in);
+  return len;
+}
+
+#endif
@@ -0,0 +1,158 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "api_test_support.hpp"
+#include "buffer_pool.hpp"
+#include "hexutil.hpp"
+#include "primitive.hpp"
+#include "request_message.hpp"
+#include "response_cache.hpp"
+#include "uuid.hpp"
+
+// every global allocation of this binary is counted per thread, so a hot
+// path can be checked for touching the heap at all
+namespace {
+thread_local size_t allocations;
+}
+
+void* operator new(size_t n) {
+  ++allocations;
+  if (void* p = std::malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// allocations made on this thread since construction
+struct alloc_counter {
+  size_t start{allocations};
+  size_t count() const { return allocations - start; }
+};
+
+int const WARM_UP = 2;
+int const ROUNDS = 100;
+
+// allocations of the connection's steady state, after the pool has grown to
+// fit
+size_t steady_allocations(connection& c, int8_t* in) {
+  for (int i = 0; i < WARM_UP; ++i) c.serve(in);
+  alloc_counter counter;
+  for (int i = 0; i < ROUNDS; ++i) c.serve(in);
+  return counter.count();
+}
+
+TEST_CASE("Testing allocation counter", "[alloc]") {
+  alloc_counter counter;
+  auto p = std::make_unique<int64_t>(1);
+  std::vector<int8_t> v(100);
+  REQUIRE(counter.count() == 2);
+}
+
+TEST_CASE("Testing ApiVersions does not allocate", "[alloc][k18]") {
+  rebuild_response_cache();
+  int8_t in[BS];
+  REQUIRE(tobuf("0x00000019" "001200040000000700047465737400"
+                "056b636c6904312e3000",
+                in, BS) != -1);
+  connection c;
+  REQUIRE(steady_allocations(c, in) == 0);
+  REQUIRE(c.serve(in) > 0);
+}
+
+TEST_CASE("Testing DescribeTopicPartitions does not allocate",
+          "[alloc][k75]") {
+  load_topics();
+  int8_t in[BS];
+  // foo and an unknown topic
+  REQUIRE(tobuf("0x00000021" "004b00000000000800047465737400"
+                "0304666f6f00056e6f70650000000064ff00",
+                in, BS) != -1);
+  connection c;
+  REQUIRE(steady_allocations(c, in) == 0);
+  REQUIRE(c.serve(in) > 0);
+}
+
+TEST_CASE("Testing DescribeTopicPartitions pages do not allocate",
+          "[alloc][k75]") {
+  load_topics();
+  int8_t in[BS];
+  connection c;
+
+  // a page ending inside a topic, then all topics
+  describe_request(in, {"nope", "foo"}, 1);
+  REQUIRE(steady_allocations(c, in) == 0);
+  describe_request(in, {"nope", "foo"}, 1, "foo", 1);
+  REQUIRE(steady_allocations(c, in) == 0);
+  describe_request(in, {}, 100);
+  REQUIRE(steady_allocations(c, in) == 0);
+}
+
+TEST_CASE("Testing Metadata does not allocate", "[alloc][k3]") {
+  load_topics();
+  int8_t in[BS];
+  connection c;
+
+  // by name and by id, known and unknown, then all topics
+  metadata_request(in, 12, {"foo", "nope"}, {uuid128{}, FOO});
+  REQUIRE(steady_allocations(c, in) == 0);
+  metadata_request(in, 12, {}, {}, true);
+  REQUIRE(steady_allocations(c, in) == 0);
+}
+
+TEST_CASE("Testing Fetch of known partitions does not allocate",
+          "[alloc][k1]") {
+  load_topics();
+  int8_t in[BS];
+  int32_t len;
+  {
+    request_header_v2 header;
+    header.request_api_key.val = 1;
+    header.request_api_version.val = 16;
+    header.correlation_id.val = 9;
+    header.client_id = snstring_view("test");
+    request_k1_v16 req(&header);
+    req.max_wait_ms.val = 500;
+    req.min_bytes.val = 1;
+    req.max_bytes.val = 1 << 20;
+    req.isolation_level.val = 0;
+    req.session_id.val = 0;
+    req.session_epoch.val = -1;
+    req.topics.is_null = false;
+    k1_topic& t = req.topics.emplace_back();
+    t.topic_id = suuid(FOO);
+    t.partitions.is_null = false;
+    for (int32_t i = 0; i < 2; ++i) {
+      k1_partition& p = t.partitions.emplace_back();
+      p.partition.val = i;
+      p.current_leader_epoch.val = 0;
+      p.fetch_offset.val = 0;
+      p.last_fetched_epoch.val = -1;
+      p.log_start_offset.val = 0;
+      p.partition_max_bytes.val = 1 << 20;
+    }
+    req.rack_id = scstring_view("");
+    len = header.serialize(in + sizeof(int32_t));
+    len += req.serialize(in + sizeof(int32_t) + len);
+    sint32(len).serialize(in);
+  }
+  connection c;
+  REQUIRE(steady_allocations(c, in) == 0);
+
+  // partition 0 carries its 200 bytes of records
+  REQUIRE(c.serve(in) > 200);
+}
+
+TEST_CASE("Testing buffer pool does not allocate", "[alloc][pool]") {
+  for (int i = 0; i < WARM_UP; ++i) pooled_buffer b(BS);
+  alloc_counter counter;
+  for (int i = 0; i < ROUNDS; ++i) {
+    pooled_buffer a(BS), b(BS);
+    REQUIRE(a.data != b.data);
+  }
+  REQUIRE(counter.count() == 0);
+}
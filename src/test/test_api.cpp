@@ -0,0 +1,212 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "api_registry.hpp"
+#include "api_test_support.hpp"
+#include "api_versions_response.hpp"
+#include "constants.hpp"
+#include "describe_topic_partitions_response.hpp"
+#include "fetch_response.hpp"
+#include "hexutil.hpp"
+#include "primitive.hpp"
+#include "response_cache.hpp"
+#include "response_header.hpp"
+#include "response_message.hpp"
+#include "uuid.hpp"
+
+TEST_CASE("Testing API registry", "[registry]") {
+  std::span<api_entry const> apis = api_entries();
+  for (size_t i = 0; i < apis.size(); ++i) {
+    api_entry const& api = apis[i];
+    REQUIRE(find_api(api.api_key) == &api);
+    REQUIRE(api.min_version <= api.max_version);
+    if (i > 0) REQUIRE(apis[i - 1].api_key < api.api_key);
+  }
+  REQUIRE(find_api(2) == nullptr);
+  REQUIRE(find_api(-1) == nullptr);
+  REQUIRE(find_api(API_KEY_LIMIT) == nullptr);
+
+  // responses of flexible versions take header v1, but ApiVersions v0
+  auto header_version = [](int16_t api_key) {
+    switch (api_key) {
+      case 1:
+        return fetch_response<API_VERSION_MAX_1>::FLEX;
+      case 3:
+        return std::is_same_v<decltype(response_k3::header),
+                              response_header_v1*>;
+      case 75:
+        return describe_topic_partitions_response<API_VERSION_MAX_75>::FLEX;
+    }
+    return false;
+  };
+  for (api_entry const& api : apis) {
+    REQUIRE(api.response_header_version == header_version(api.api_key));
+  }
+
+  // ApiVersions advertises what is there and nothing else
+  rebuild_response_cache();
+  int8_t in[BS];
+  REQUIRE(tobuf("0x00000019" "001200040000000700047465737400"
+                "056b636c6904312e3000",
+                in, BS) != -1);
+  connection c;
+  int32_t len = c.serve(in);
+  std::vector<int8_t> out = c.frame();
+  response_header<0> h;
+  api_versions_response<4> res;
+  int32_t sz = h.deserialize(out.data() + sizeof(int32_t));
+  sz += res.deserialize(out.data() + sizeof(int32_t) + sz);
+  REQUIRE(sizeof(int32_t) + sz == size_t(len));
+  REQUIRE(h.correlation_id.val == 7);
+  REQUIRE(res.api_keys.val.size() == apis.size());
+  for (size_t i = 0; i < apis.size(); ++i) {
+    REQUIRE(res.api_keys.val[i].api_key.val == apis[i].api_key);
+    REQUIRE(res.api_keys.val[i].min_version.val == apis[i].min_version);
+    REQUIRE(res.api_keys.val[i].max_version.val == apis[i].max_version);
+  }
+
+  // an api key nobody serves gets nothing
+  in[5] = 2;
+  REQUIRE(c.serve(in) == -1);
+}
+
+describe_topic_partitions_response<0> describe(connection& c, int8_t* in) {
+  int32_t len = c.serve(in);
+  std::vector<int8_t> out = c.frame();
+  REQUIRE(out.size() == size_t(len));
+  response_header<1> h;
+  describe_topic_partitions_response<0> res;
+  int32_t sz = h.deserialize(out.data() + sizeof(int32_t));
+  sz += res.deserialize(out.data() + sizeof(int32_t) + sz);
+  REQUIRE(sizeof(int32_t) + sz == size_t(len));
+  return res;
+}
+
+TEST_CASE("Testing DescribeTopicPartitions", "[k75]") {
+  load_topics();
+  int8_t in[BS];
+  connection c;
+
+  // foo and an unknown topic
+  REQUIRE(tobuf("0x00000021" "004b00000000000800047465737400"
+                "0304666f6f00056e6f70650000000064ff00",
+                in, BS) != -1);
+  auto res = describe(c, in);
+  REQUIRE(res.topics.val.size() == 2);
+  REQUIRE(res.topics.val[0].partitions.val.size() == 2);
+  REQUIRE(res.topics.val[0].partitions.val[1].replica_nodes.val.size() == 3);
+  REQUIRE(res.topics.val[0].partitions.val[1].leader_id.val == 1);
+  REQUIRE(res.topics.val[1].error_code.val == ERR_UNKNOWN_TOPIC_OR_PARTITION);
+}
+
+TEST_CASE("Testing DescribeTopicPartitions pages", "[k75]") {
+  load_topics();
+  int8_t in[BS];
+  connection c;
+
+  // in name order, up to the limit
+  describe_request(in, {"nope", "foo"}, 1);
+  auto res = describe(c, in);
+  REQUIRE(res.topics.val.size() == 1);
+  REQUIRE(res.topics.val[0].name.val == "foo");
+  REQUIRE(res.topics.val[0].partitions.val.size() == 1);
+  REQUIRE(res.topics.val[0].partitions.val[0].partition_index.val == 0);
+  REQUIRE_FALSE(res.next_cursor_is_null);
+  REQUIRE(res.next_cursor.topic_name.val == "foo");
+  REQUIRE(res.next_cursor.partition_index.val == 1);
+
+  // the rest of the topic, then the next one starts the next page
+  describe_request(in, {"nope", "foo"}, 1, "foo", 1);
+  res = describe(c, in);
+  REQUIRE(res.topics.val.size() == 1);
+  REQUIRE(res.topics.val[0].partitions.val.size() == 1);
+  REQUIRE(res.topics.val[0].partitions.val[0].partition_index.val == 1);
+  REQUIRE(res.next_cursor.topic_name.val == "nope");
+  REQUIRE(res.next_cursor.partition_index.val == 0);
+
+  describe_request(in, {"nope", "foo"}, 1, "nope", 0);
+  res = describe(c, in);
+  REQUIRE(res.topics.val.size() == 1);
+  REQUIRE(res.topics.val[0].error_code.val == ERR_UNKNOWN_TOPIC_OR_PARTITION);
+  REQUIRE(res.next_cursor_is_null);
+
+  // no topics asks for all of them
+  describe_request(in, {}, 100);
+  res = describe(c, in);
+  REQUIRE(res.topics.val.size() == 1);
+  REQUIRE(res.topics.val[0].partitions.val.size() == 2);
+  REQUIRE(res.next_cursor_is_null);
+}
+
+struct metadata_answer {
+  response_header_v1 header;
+  response_k3 res{&header};
+};
+
+std::unique_ptr<metadata_answer> metadata(connection& c, int8_t* in,
+                                          int16_t version) {
+  int32_t len = c.serve(in);
+  std::vector<int8_t> out = c.frame();
+  REQUIRE(out.size() == size_t(len));
+  auto answer = std::make_unique<metadata_answer>();
+  answer->res.version = version;
+  int32_t sz = answer->res.deserialize(out.data() + sizeof(int32_t));
+  REQUIRE(sizeof(int32_t) + sz == size_t(len));
+  return answer;
+}
+
+TEST_CASE("Testing Metadata", "[k3]") {
+  load_topics();
+  int8_t in[BS];
+  connection c;
+
+  metadata_request(in, 12, {"foo", "nope"}, {uuid128{}});
+  auto answer = metadata(c, in, 12);
+  response_k3& res = answer->res;
+  REQUIRE(res.brokers.val.size() == 1);
+  REQUIRE(res.brokers.val[0].node_id.val == BROKER_NODE_ID);
+  REQUIRE(res.brokers.val[0].port.val == BROKER_PORT);
+  REQUIRE(res.controller_id.val == BROKER_NODE_ID);
+  REQUIRE(res.topics.val.size() == 3);
+  auto const& foo = res.topics.val[0];
+  REQUIRE(foo.error_code.val == 0);
+  REQUIRE(foo.name.val == "foo");
+  REQUIRE(foo.topic_id.str() == "00000000-0000-4000-8000-000000000091");
+  REQUIRE(foo.partitions.val.size() == 2);
+  REQUIRE(foo.partitions.val[1].partition_index.val == 1);
+  REQUIRE(foo.partitions.val[1].replica_nodes.val.size() == 3);
+  REQUIRE(foo.partitions.val[1].isr_nodes.val.size() == 2);
+  REQUIRE(foo.topic_authorized_operations.val == TOPIC_AUTHORIZED_OPERATIONS);
+  REQUIRE(res.topics.val[1].error_code.val == ERR_UNKNOWN_TOPIC_OR_PARTITION);
+  REQUIRE(res.topics.val[1].name.val == "nope");
+  REQUIRE(res.topics.val[2].error_code.val == ERR_UNKNOWN_TOPIC_ID);
+  REQUIRE(res.topics.val[2].name.is_null);
+
+  // by id; before v10 the encoded topic goes without it
+  metadata_request(in, 10, {}, {FOO});
+  answer = metadata(c, in, 10);
+  REQUIRE(answer->res.topics.val.size() == 1);
+  REQUIRE(answer->res.topics.val[0].name.val == "foo");
+  REQUIRE(answer->res.cluster_authorized_operations.val ==
+          AUTHORIZED_OPERATIONS_OMITTED);
+  metadata_request(in, 9, {"foo"});
+  answer = metadata(c, in, 9);
+  REQUIRE(answer->res.topics.val.size() == 1);
+  REQUIRE(answer->res.topics.val[0].partitions.val.size() == 2);
+
+  // before v9 nothing is decoded or answered, the connection is closed
+  metadata_request(in, 8, {"foo"});
+  REQUIRE_THROWS_AS(c.serve(in), decode_error);
+
+  // a null topic array asks for all of them
+  metadata_request(in, 12, {}, {}, true);
+  answer = metadata(c, in, 12);
+  REQUIRE(answer->res.topics.val.size() == 1);
+  REQUIRE(answer->res.topics.val[0].name.val == "foo");
+  REQUIRE(answer->res.topics.val[0].partitions.val.size() == 2);
+}
@@ -0,0 +1,248 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "api_versions_request.hpp"
+#include "api_versions_response.hpp"
+#include "describe_topic_partitions_request.hpp"
+#include "describe_topic_partitions_response.hpp"
+#include "fetch_request.hpp"
+#include "fetch_response.hpp"
+#include "hexutil.hpp"
+#include "request_header.hpp"
+#include "request_message.hpp"
+#include "response_header.hpp"
+
+int const BS = 1024;
+
+// encodes a default message of every version, decodes it back and checks the
+// second encoding is byte-identical
+template <template <int16_t> class M, int16_t... Vs>
+bool round_trips(std::integer_sequence<int16_t, Vs...>) {
+  auto one = [](auto msg, auto copy) {
+    int8_t a[BS], b[BS];
+    int32_t n = msg.serialize(a);
+    return copy.deserialize(a) == n && copy.serialize(b) == n &&
+           tohex(a, n) == tohex(b, n);
+  };
+  return (one(M<Vs>(), M<Vs>()) && ...);
+}
+
+TEST_CASE("Testing every generated version", "[gen]") {
+  REQUIRE(round_trips<request_header>(std::make_integer_sequence<int16_t, 3>()));
+  REQUIRE(round_trips<response_header>(std::make_integer_sequence<int16_t, 2>()));
+  REQUIRE(round_trips<api_versions_request>(
+      std::make_integer_sequence<int16_t, 5>()));
+  REQUIRE(round_trips<api_versions_response>(
+      std::make_integer_sequence<int16_t, 5>()));
+  REQUIRE(round_trips<fetch_request>(std::make_integer_sequence<int16_t, 17>()));
+  REQUIRE(
+      round_trips<fetch_response>(std::make_integer_sequence<int16_t, 17>()));
+  REQUIRE(round_trips<describe_topic_partitions_request>(
+      std::make_integer_sequence<int16_t, 1>()));
+  REQUIRE(round_trips<describe_topic_partitions_response>(
+      std::make_integer_sequence<int16_t, 1>()));
+}
+
+TEST_CASE("Testing generated request header", "[gen][header]") {
+  int8_t in[BS], out[BS];
+  int32_t sz;
+
+  // client id keeps its int16 length even in the flexible v2 header
+  REQUIRE(tobuf("0x0012000400000007000474657374" "00", in, BS) != -1);
+  request_header<2> h2;
+  REQUIRE(h2.deserialize(in) == 15);
+  REQUIRE(h2.request_api_key.val == 18);
+  REQUIRE(h2.request_api_version.val == 4);
+  REQUIRE(h2.correlation_id.val == 7);
+  REQUIRE(!h2.client_id.is_null);
+  REQUIRE(h2.client_id.val == "test");
+  sz = h2.serialize(out);
+  REQUIRE(tohex(out, sz) == "0x001200040000000700047465737400");
+
+  // requests skip tags they don't know but still write them back
+  REQUIRE(tobuf("0x0012000400000007000474657374" "012a0201ff", in, BS) != -1);
+  REQUIRE(h2.deserialize(in) == 19);
+  REQUIRE(h2.tagged_fields.find(42).size() == 2);
+  sz = h2.serialize(out);
+  REQUIRE(tohex(out, sz) == "0x0012000400000007000474657374012a0201ff");
+
+  // v1 has no tagged fields, v0 has no client id
+  request_header<1> h1;
+  REQUIRE(h1.deserialize(in) == 14);
+  request_header<0> h0;
+  REQUIRE(h0.deserialize(in) == 8);
+
+  // the response header is a response: it keeps a copy of unknown tags, not
+  // a view into the frame
+  REQUIRE(tobuf("0x00000007" "012a0201ff", in, BS) != -1);
+  response_header<1> r1;
+  REQUIRE(r1.deserialize(in) == 9);
+  REQUIRE(r1.unknown_tagged_fields.fields.size() == 1);
+  REQUIRE(r1.unknown_tagged_fields.fields[0].tag.val == 42);
+  in[7] = 0;
+  sz = r1.serialize(out);
+  REQUIRE(tohex(out, sz) == "0x00000007012a0201ff");
+}
+
+TEST_CASE("Testing generated ApiVersions", "[gen][k18]") {
+  int8_t in[BS], out[BS];
+  int32_t sz;
+
+  api_versions_response<0> r0;
+  r0.api_keys.val.emplace_back().api_key.val = 18;
+  r0.api_keys.val.back().max_version.val = 4;
+  sz = r0.serialize(out);
+  REQUIRE(tohex(out, sz) == "0x00000000000100120000" "0004");
+
+  // v3: compact array, throttle time, tagged fields only when non-default
+  api_versions_response<3> r3;
+  r3.api_keys.val.emplace_back().api_key.val = 18;
+  r3.api_keys.val.back().max_version.val = 4;
+  sz = r3.serialize(out);
+  REQUIRE(tohex(out, sz) == "0x000002001200000004" "00" "00000000" "00");
+
+  r3.finalized_features_epoch.val = 5;
+  r3.zk_migration_ready.val = true;
+  sz = r3.serialize(out);
+  REQUIRE(tohex(out, sz) ==
+          "0x000002001200000004" "00" "00000000" "02" "01080000000000000005"
+          "030101");
+
+  api_versions_response<3> d3;
+  REQUIRE(d3.deserialize(out) == sz);
+  REQUIRE(d3.finalized_features_epoch.val == 5);
+  REQUIRE(d3.zk_migration_ready.val);
+  REQUIRE(d3.unknown_tagged_fields.fields.empty());
+  REQUIRE(d3.api_keys.val.size() == 1);
+  REQUIRE(d3.api_keys.val[0].max_version.val == 4);
+
+  // tags the schema does not know survive a decode/encode round trip
+  REQUIRE(tobuf("0x00000100000000" "01" "2a0201ff", in, BS) != -1);
+  REQUIRE(d3.deserialize(in) == 12);
+  REQUIRE(d3.finalized_features_epoch.val == -1);
+  REQUIRE(d3.unknown_tagged_fields.fields.size() == 1);
+  REQUIRE(d3.unknown_tagged_fields.fields[0].tag.val == 42);
+  sz = d3.serialize(out);
+  REQUIRE(tohex(out, sz) == "0x00000100000000012a0201ff");
+
+  // known and unknown tags go out merged in ascending order, the unknown
+  // ones written in the gaps between the known
+  d3.zk_migration_ready.val = true;
+  sz = d3.serialize(out);
+  REQUIRE(tohex(out, sz) == "0x0000010000000002" "030101" "2a0201ff");
+  d3.unknown_tagged_fields.fields.clear();
+  keep_unknown_tagged_field(d3.unknown_tagged_fields, 1, in, 0);
+  keep_unknown_tagged_field(d3.unknown_tagged_fields, 5, in, 0);
+  keep_unknown_tagged_field(d3.unknown_tagged_fields, 9, in, 0);
+  sz = write_unknown_tagged_fields(out, d3.unknown_tagged_fields, 2, 9);
+  REQUIRE(tohex(out, sz) == "0x0500");
+
+  api_versions_request<4> q4;
+  REQUIRE(tobuf("0x056b636c6904312e3000", in, BS) != -1);
+  REQUIRE(q4.deserialize(in) == 10);
+  REQUIRE(q4.client_software_name.val == "kcli");
+  REQUIRE(q4.client_software_version.val == "1.0");
+}
+
+TEST_CASE("Testing generated Fetch against the hand-written v16",
+          "[gen][k1]") {
+  int8_t in[BS], out[BS];
+  int32_t sz;
+
+  request_header_v2 header;
+  request_k1_v16 req(&header);
+  req.max_wait_ms.val = 500;
+  req.min_bytes.val = 1;
+  req.max_bytes.val = 1000;
+  req.isolation_level.val = 0;
+  req.session_id.val = 0;
+  req.session_epoch.val = -1;
+  req.topics.is_null = false;
+  k1_topic& t = req.topics.emplace_back();
+  t.topic_id = suuid("00000000-0000-4000-8000-000000000091");
+  t.partitions.is_null = false;
+  k1_partition& p = t.partitions.emplace_back();
+  p.partition.val = 3;
+  p.current_leader_epoch.val = -1;
+  p.fetch_offset.val = 42;
+  p.last_fetched_epoch.val = -1;
+  p.log_start_offset.val = -1;
+  p.partition_max_bytes.val = 1 << 20;
+  req.rack_id = scstring_view("r1");
+  int32_t len = req.serialize(in);
+
+  fetch_request<16> gen;
+  REQUIRE(gen.deserialize(in) == len);
+  REQUIRE(gen.max_wait_ms.val == 500);
+  REQUIRE(gen.topics.val.size() == 1);
+  REQUIRE(gen.topics.val[0].topic_id.str() ==
+          "00000000-0000-4000-8000-000000000091");
+  REQUIRE(gen.topics.val[0].partitions.val[0].fetch_offset.val == 42);
+  REQUIRE(gen.rack_id.val == "r1");
+  REQUIRE(gen.cluster_id.is_null);
+  sz = gen.serialize(out);
+  REQUIRE(tohex(out, sz) == tohex(in, len));
+
+  // a known tag is decoded, not carried over twice next to an unknown one
+  sz = gen.serialize(out);
+  out[sz - 1] = 2;
+  REQUIRE(tobuf("0x00020263" "2a0100", out + sz, BS - sz) != -1);
+  sz += 7;
+  fetch_request<16> tagged;
+  REQUIRE(tagged.deserialize(out) == sz);
+  REQUIRE(tagged.cluster_id.val == "c");
+  int8_t again[BS];
+  REQUIRE(tagged.serialize(again) == sz);
+  REQUIRE(tohex(again, sz) == tohex(out, sz));
+
+  // v11 is not flexible: topic names instead of ids, classic arrays
+  fetch_request<11> v11;
+  v11.topics.val.emplace_back().topic = sstring_view("foo");
+  sz = v11.serialize(out);
+  fetch_request<11> d11;
+  REQUIRE(d11.deserialize(out) == sz);
+  REQUIRE(d11.replica_id.val == -1);
+  REQUIRE(d11.max_bytes.val == 0x7fffffff);
+  REQUIRE(d11.topics.val.size() == 1);
+  REQUIRE(d11.topics.val[0].topic.val == "foo");
+
+  // tagged struct fields are only written once they leave their defaults
+  fetch_response<16> res;
+  auto& pd = res.responses.val.emplace_back().partitions.val.emplace_back();
+  fetch_response<16> d16;
+  sz = res.serialize(out);
+  REQUIRE(d16.deserialize(out) == sz);
+  REQUIRE(d16.responses.val[0].partitions.val[0].current_leader.leader_id.val ==
+          -1);
+  pd.current_leader.leader_id.val = 2;
+  pd.current_leader.leader_epoch.val = 7;
+  int32_t sz_tagged = res.serialize(out);
+  // tag, size, two int32s and the struct's own empty tag section
+  REQUIRE(sz_tagged == sz + 11);
+  REQUIRE(d16.deserialize(out) == sz_tagged);
+  auto& dpd = d16.responses.val[0].partitions.val[0];
+  REQUIRE(dpd.current_leader.leader_id.val == 2);
+  REQUIRE(dpd.current_leader.leader_epoch.val == 7);
+  REQUIRE(dpd.diverging_epoch.is_default());
+}
+
+TEST_CASE("Testing generated DescribeTopicPartitions request", "[gen][k75]") {
+  int8_t in[BS], out[BS];
+  int32_t sz;
+
+  REQUIRE(tobuf("0x0204666f6f0000000064ff00", in, BS) != -1);
+  describe_topic_partitions_request<0> q;
+  REQUIRE(q.deserialize(in) == 12);
+  REQUIRE(q.topics.val.size() == 1);
+  REQUIRE(q.topics.val[0].name.val == "foo");
+  REQUIRE(q.response_partition_limit.val == 100);
+  REQUIRE(q.cursor_is_null);
+
+  q.cursor_is_null = false;
+  q.cursor.topic_name = scstring_view("foo");
+  q.cursor.partition_index.val = 2;
+  sz = q.serialize(out);
+  REQUIRE(tohex(out, sz) == "0x0204666f6f0000000064" "0104666f6f0000000200" "00");
+}
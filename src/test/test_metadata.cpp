@@ -0,0 +1,916 @@
+#include <unistd.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "constants.hpp"
+#include "cow_vector.hpp"
+#include "datamap.hpp"
+#include "flat_index.hpp"
+#include "log_reader.hpp"
+#include "partition_table.hpp"
+#include "primitive.hpp"
+#include "record.hpp"
+#include "snapshot.hpp"
+#include "tailer.hpp"
+#include "uuid.hpp"
+
+namespace fs = std::filesystem;
+
+uuid128 const FOO = [] {
+  uuid128 id;
+  uuid128::parse("00000000-0000-4000-8000-000000000091", id);
+  return id;
+}();
+
+record topic_record(std::string name, uuid128 id) {
+  auto v = std::make_shared<record_value_type2_t>();
+  v->topic_name = scstring(name);
+  v->topic_uuid = suuid(id);
+  record r;
+  r.value.frame_version.val = 1;
+  r.value.type.val = 2;
+  r.value.value = v;
+  return r;
+}
+
+record partition_record(int32_t index, uuid128 topic) {
+  auto v = std::make_shared<record_value_type3_t>();
+  v->partition_id.val = index;
+  v->topic_uuid = suuid(topic);
+  v->leader.val = 1;
+  record r;
+  r.value.frame_version.val = 1;
+  r.value.type.val = 3;
+  r.value.version.val = 1;
+  r.value.value = v;
+  return r;
+}
+
+// a partition change record changing nothing yet
+record change_record(int32_t index, uuid128 topic) {
+  auto v = std::make_shared<record_value_type5_t>();
+  v->partition_id.val = index;
+  v->topic_uuid = suuid(topic);
+  record r;
+  r.value.frame_version.val = 1;
+  r.value.type.val = 5;
+  r.value.version.val = 2;
+  r.value.value = v;
+  return r;
+}
+
+record remove_topic_record(uuid128 topic) {
+  auto v = std::make_shared<record_value_type9_t>();
+  v->topic_uuid = suuid(topic);
+  record r;
+  r.value.frame_version.val = 1;
+  r.value.type.val = 9;
+  r.value.value = v;
+  return r;
+}
+
+// a record of a type the broker skips, n bytes long
+record padding_record(size_t n) {
+  auto v = std::make_shared<record_value_raw_t>();
+  v->data.assign(n, 0x5a);
+  record r;
+  r.value.frame_version.val = 1;
+  r.value.type.val = 99;
+  r.value.value = v;
+  return r;
+}
+
+// one batch as it sits in a log segment
+std::vector<int8_t> batch(int64_t base_offset, std::vector<record> records) {
+  record_batch rb;
+  rb.base_offset.val = base_offset;
+  rb.magic_byte.val = 2;
+  rb.last_offset_data.val = records.size() - 1;
+  for (size_t i = 0; i < records.size(); ++i) records[i].offset_delta.val = i;
+  rb.records = sarray<record>(records);
+  std::vector<int8_t> out(1 << 20);
+  int32_t n = rb.serialize(out.data());
+  sint32(n - log_reader::BATCH_FRAME_SIZE).serialize(out.data() + 8);
+  out.resize(n);
+  return out;
+}
+
+// a directory of its own, removed with everything in it
+struct scratch_dir {
+  fs::path path;
+  explicit scratch_dir(std::string name)
+      : path(fs::temp_directory_path() /
+             std::format("krapka-{}-{}", name, getpid())) {
+    fs::remove_all(path);
+    fs::create_directories(path);
+  }
+  ~scratch_dir() { fs::remove_all(path); }
+
+  void append(int64_t segment, std::vector<int8_t> const &bytes) {
+    std::ofstream f(path / (offset_file_name(segment) + ".log"),
+                    std::ios::binary | std::ios::app);
+    f.write(reinterpret_cast<char const *>(bytes.data()), bytes.size());
+  }
+};
+
+void reset_metadata() {
+  publish_metadata(std::make_shared<metadata_image const>());
+  metadata_snapshot_offset = 0;
+}
+
+// partition indexes of the topic in order, or {-1} when there is no such topic
+std::vector<int32_t> partition_indexes(metadata_image const &m,
+                                       uuid128 const &id) {
+  partition_table const &table = m.partitions;
+  uint32_t t = table.find_topic(id);
+  if (t == partition_table::NONE) return {-1};
+  std::vector<int32_t> out;
+  for (uint32_t slot : table.partitions(t))
+    out.push_back(table.partition_index[slot]);
+  return out;
+}
+
+uuid128 topic_named(metadata_image const &m, std::string const &name) {
+  uint32_t t = m.partitions.find_topic(std::string_view(name));
+  return t == partition_table::NONE ? uuid128{} : m.partitions.topic_id[t];
+}
+
+// base offsets in the order the reader hands them out
+struct offsets {
+  std::vector<int64_t> seen;
+  void operator()(record_batch &rb) { seen.push_back(rb.base_offset.val); }
+};
+
+TEST_CASE("Testing log reader across segments", "[log]") {
+  scratch_dir dir("segments");
+  dir.append(0, batch(0, {topic_record("foo", FOO)}));
+  dir.append(0, batch(1, {partition_record(0, FOO)}));
+  dir.append(2, batch(2, {partition_record(1, FOO)}));
+  dir.append(3, batch(3, {partition_record(2, FOO)}));
+  // not a segment
+  std::ofstream(dir.path / "00000000000000000004.index") << "index";
+
+  log_reader reader(dir.path.string());
+  offsets o;
+  REQUIRE(reader.read(std::ref(o)) == 4);
+  REQUIRE(o.seen == std::vector<int64_t>{0, 1, 2, 3});
+  // nothing new
+  REQUIRE(reader.read(std::ref(o)) == 0);
+
+  log_reader missing((dir.path / "missing").string());
+  REQUIRE(missing.read(std::ref(o)) == 0);
+}
+
+TEST_CASE("Testing log reader hands out batches undecoded", "[log]") {
+  scratch_dir dir("raw");
+  // more than BUFSIZ, and over two segments
+  std::vector<int8_t> first = batch(0, {padding_record(10000)});
+  std::vector<int8_t> second = batch(1, {padding_record(300)});
+  std::vector<int8_t> bad = batch(2, {partition_record(0, FOO)});
+  // a record count far beyond the batch; it is still passed on as it is
+  sint32(1 << 30).serialize(bad.data() + 57);
+  dir.append(0, first);
+  dir.append(1, second);
+  dir.append(1, bad);
+
+  log_reader reader(dir.path.string());
+  std::vector<int8_t> all;
+  REQUIRE(reader.read_raw([&](std::span<int8_t const> b) {
+    all.insert(all.end(), b.begin(), b.end());
+  }) == 3);
+  std::vector<int8_t> expected = first;
+  expected.insert(expected.end(), second.begin(), second.end());
+  expected.insert(expected.end(), bad.begin(), bad.end());
+  REQUIRE(all == expected);
+  REQUIRE(reader.skipped == 0);
+}
+
+TEST_CASE("Testing log reader resumes where it stopped", "[log]") {
+  scratch_dir dir("resume");
+  std::vector<int8_t> second = batch(1, {partition_record(0, FOO)});
+  std::vector<int8_t> head(second.begin(), second.begin() + 20);
+  std::vector<int8_t> tail(second.begin() + 20, second.end());
+  dir.append(0, batch(0, {topic_record("foo", FOO)}));
+  dir.append(0, head);
+
+  log_reader reader(dir.path.string());
+  offsets o;
+  // the torn batch waits for the rest of it
+  REQUIRE(reader.read(std::ref(o)) == 1);
+  dir.append(0, tail);
+  REQUIRE(reader.read(std::ref(o)) == 1);
+  dir.append(2, batch(2, {partition_record(1, FOO)}));
+  REQUIRE(reader.read(std::ref(o)) == 1);
+  REQUIRE(o.seen == std::vector<int64_t>{0, 1, 2});
+  REQUIRE(reader.position == int64_t(fs::file_size(reader.segment)));
+}
+
+TEST_CASE("Testing log reader skips what it can't decode", "[log]") {
+  scratch_dir dir("corrupt");
+  std::vector<int8_t> bad = batch(1, {partition_record(0, FOO)});
+  // a record count far beyond the batch
+  sint32(1 << 30).serialize(bad.data() + 57);
+  dir.append(0, batch(0, {topic_record("foo", FOO)}));
+  dir.append(0, bad);
+  dir.append(0, batch(2, {partition_record(1, FOO)}));
+  // a torn batch in a segment that has a successor is given up on
+  dir.append(0, std::vector<int8_t>(bad.begin(), bad.begin() + 30));
+  dir.append(3, batch(3, {partition_record(2, FOO)}));
+
+  log_reader reader(dir.path.string());
+  offsets o;
+  REQUIRE(reader.read(std::ref(o)) == 3);
+  REQUIRE(o.seen == std::vector<int64_t>{0, 2, 3});
+}
+
+TEST_CASE("Testing log reader with batches larger than its window", "[log]") {
+  scratch_dir dir("large");
+  size_t const size = log_reader::WINDOW_SIZE + 1000;
+  dir.append(0, batch(0, {topic_record("foo", FOO)}));
+  dir.append(0, batch(1, {padding_record(size)}));
+  dir.append(0, batch(2, {partition_record(0, FOO)}));
+
+  log_reader reader(dir.path.string());
+  offsets o;
+  REQUIRE(reader.read(std::ref(o)) == 3);
+  REQUIRE(o.seen == std::vector<int64_t>{0, 1, 2});
+  REQUIRE(reader.window.capacity > size);
+}
+
+TEST_CASE("Testing metadata replay", "[log][metadata]") {
+  scratch_dir dir("replay");
+  uuid128 bar;
+  uuid128::parse("00000000-0000-4000-8000-000000000092", bar);
+  dir.append(0, batch(0, {topic_record("foo", FOO), partition_record(0, FOO),
+                          partition_record(1, FOO)}));
+  dir.append(3, batch(3, {padding_record(10), topic_record("bar", bar),
+                          partition_record(0, bar)}));
+
+  metadata_image m;
+  auto apply = [&](record_batch &rb) { apply_metadata_batch(m, rb); };
+  log_reader reader(dir.path.string());
+  REQUIRE(reader.read(apply) == 2);
+  m.partitions.freeze();
+  REQUIRE(topic_named(m, "foo") == FOO);
+  REQUIRE(topic_named(m, "bar") == bar);
+  REQUIRE(partition_indexes(m, FOO) == std::vector<int32_t>{0, 1});
+  REQUIRE(partition_indexes(m, bar) == std::vector<int32_t>{0});
+  REQUIRE(m.end_offset == 6);
+
+  // records already applied are not applied twice
+  log_reader again(dir.path.string());
+  REQUIRE(again.read(apply) == 2);
+  REQUIRE(m.partitions.partition_count() == 3);
+}
+
+TEST_CASE("Testing metadata snapshots", "[log][metadata][snapshot]") {
+  reset_metadata();
+  scratch_dir dir("snapshot");
+  uuid128 bar;
+  uuid128::parse("00000000-0000-4000-8000-000000000092", bar);
+  dir.append(0, batch(0, {topic_record("foo", FOO), partition_record(0, FOO),
+                          partition_record(1, FOO)}));
+  dir.append(3, batch(3, {topic_record("bar", bar), partition_record(0, bar)}));
+  auto m = std::make_shared<metadata_image>();
+  log_reader(dir.path.string()).read([&](record_batch &rb) {
+    apply_metadata_batch(*m, rb);
+  });
+  m->partitions.freeze();
+  publish_metadata(m);
+
+  // nothing to do before SNAPSHOT_MIN_RECORDS
+  REQUIRE_FALSE(maybe_write_metadata_snapshot(dir.path.string()));
+  REQUIRE(write_metadata_snapshot(dir.path.string(), *m));
+  fs::path first = dir.path / "00000000000000000005-0000000000.checkpoint";
+  REQUIRE(fs::exists(first));
+  REQUIRE(metadata_snapshot_offset.load() == 5);
+
+  dir.append(3, batch(5, {partition_record(2, FOO)}));
+  metadata_image loaded;
+  REQUIRE(load_metadata_snapshot(dir.path.string(), loaded) == 5);
+  REQUIRE(loaded.partitions.topic_count() == 2);
+  REQUIRE(topic_named(loaded, "bar") == bar);
+  REQUIRE(partition_indexes(loaded, FOO) == std::vector<int32_t>{0, 1});
+  REQUIRE(partition_indexes(loaded, bar) == std::vector<int32_t>{0});
+
+  // the log tail only, the first segment is not even opened
+  loaded.end_offset = 5;
+  log_reader tail(dir.path.string());
+  tail.seek(5);
+  offsets o;
+  REQUIRE(tail.read([&](record_batch &rb) {
+    o(rb);
+    apply_metadata_batch(loaded, rb);
+  }) == 1);
+  REQUIRE(o.seen == std::vector<int64_t>{5});
+  loaded.partitions.freeze();
+  REQUIRE(partition_indexes(loaded, FOO) == std::vector<int32_t>{0, 1, 2});
+  REQUIRE(loaded.end_offset == 6);
+
+  // a damaged snapshot falls back to the one before it
+  REQUIRE(write_metadata_snapshot(dir.path.string(), loaded));
+  fs::path second = dir.path / "00000000000000000006-0000000000.checkpoint";
+  fs::resize_file(second, fs::file_size(second) - 3);
+  metadata_image fallback;
+  REQUIRE(load_metadata_snapshot(dir.path.string(), fallback) == 5);
+  REQUIRE(partition_indexes(fallback, FOO) == std::vector<int32_t>{0, 1});
+
+  // only the newest are kept
+  loaded.end_offset = 7;
+  REQUIRE(write_metadata_snapshot(dir.path.string(), loaded));
+  REQUIRE_FALSE(fs::exists(first));
+  REQUIRE(fs::exists(second));
+
+  scratch_dir empty("no-snapshot");
+  metadata_image none;
+  REQUIRE(load_metadata_snapshot(empty.path.string(), none) == 0);
+  REQUIRE(none.partitions.topic_count() == 0);
+}
+
+TEST_CASE("Testing snapshots of another log", "[log][metadata][snapshot]") {
+  reset_metadata();
+  scratch_dir dir("other-log");
+  uuid128 bar;
+  uuid128::parse("00000000-0000-4000-8000-000000000092", bar);
+  std::vector<int8_t> first = batch(0, {topic_record("foo", FOO)});
+  std::vector<int8_t> second = batch(1, {partition_record(0, FOO)});
+  dir.append(0, first);
+  dir.append(0, second);
+  metadata_image m;
+  log_reader whole(dir.path.string());
+  REQUIRE(replay_metadata_log(whole, m) == 2);
+  REQUIRE(m.last_batch_offset == 1);
+  REQUIRE(m.last_batch_crc == load_big_endian<int32_t>(second.data() + 17));
+  REQUIRE(write_metadata_snapshot(dir.path.string(), m));
+
+  // the checkpoint covers the log, only the batch it ends with is read again
+  dir.append(0, batch(2, {partition_record(1, FOO)}));
+  metadata_image resumed;
+  log_reader reader(dir.path.string());
+  REQUIRE(replay_metadata_log(reader, resumed) == 2);
+  REQUIRE(metadata_snapshot_offset.load() == 2);
+  REQUIRE(partition_indexes(resumed, FOO) == std::vector<int32_t>{0, 1});
+  REQUIRE(resumed.end_offset == 3);
+
+  // the same offsets with other batches: the checkpoint is not used
+  fs::remove(dir.path / (offset_file_name(0) + ".log"));
+  dir.append(0, first);
+  dir.append(0, batch(1, {topic_record("bar", bar)}));
+  metadata_image rewritten;
+  log_reader again(dir.path.string());
+  REQUIRE(replay_metadata_log(again, rewritten) == 2);
+  REQUIRE(metadata_snapshot_offset.load() == 0);
+  REQUIRE(topic_named(rewritten, "bar") == bar);
+  REQUIRE(partition_indexes(rewritten, FOO).empty());
+  REQUIRE(rewritten.end_offset == 2);
+
+  // nor is one past the end of the log
+  fs::remove(dir.path / (offset_file_name(0) + ".log"));
+  dir.append(0, first);
+  metadata_image shorter;
+  log_reader short_reader(dir.path.string());
+  REQUIRE(replay_metadata_log(short_reader, shorter) == 1);
+  REQUIRE(metadata_snapshot_offset.load() == 0);
+  REQUIRE(partition_indexes(shorter, FOO).empty());
+  REQUIRE(shorter.end_offset == 1);
+
+  // checkpoints the broker did not write are left alone
+  fs::path foreign = dir.path / "00000000000000000001-0000000000.checkpoint";
+  std::ofstream(foreign, std::ios::binary)
+      .write(reinterpret_cast<char const *>(first.data()), first.size());
+  for (int64_t end = 3; end < 3 + SNAPSHOTS_KEPT + 1; ++end) {
+    shorter.end_offset = end;
+    REQUIRE(write_metadata_snapshot(dir.path.string(), shorter));
+  }
+  REQUIRE(fs::exists(foreign));
+  size_t checkpoints{};
+  for (auto const &e : fs::directory_iterator(dir.path))
+    checkpoints += e.path().extension() == ".checkpoint";
+  REQUIRE(checkpoints == SNAPSHOTS_KEPT + 1);
+}
+
+TEST_CASE("Testing metadata tailer", "[log][metadata][tailer]") {
+  reset_metadata();
+  scratch_dir dir("tailer");
+  uuid128 bar;
+  uuid128::parse("00000000-0000-4000-8000-000000000092", bar);
+  dir.append(0, batch(0, {topic_record("foo", FOO), partition_record(0, FOO)}));
+
+  metadata_tailer tailer(dir.path.string());
+  REQUIRE(tailer.poll() == 1);
+  std::shared_ptr<metadata_image const> before = current_metadata();
+  REQUIRE(tailer.poll() == 0);
+  REQUIRE(current_metadata() == before);
+  dir.append(0, batch(2, {partition_record(1, FOO)}));
+  dir.append(3, batch(3, {topic_record("bar", bar)}));
+  REQUIRE(tailer.poll() == 2);
+  std::shared_ptr<metadata_image const> after = current_metadata();
+  REQUIRE(partition_indexes(*after, FOO) == std::vector<int32_t>{0, 1});
+  REQUIRE(topic_named(*after, "bar") == bar);
+  // a version once taken does not change
+  REQUIRE(partition_indexes(*before, FOO) == std::vector<int32_t>{0});
+  REQUIRE(topic_named(*before, "bar") == uuid128{});
+
+  // in the background, seeing a topic created after it started
+  std::thread follow([&] { tailer.run(); });
+  uuid128 baz;
+  uuid128::parse("00000000-0000-4000-8000-000000000093", baz);
+  dir.append(3, batch(4, {topic_record("baz", baz), partition_record(0, baz)}));
+  bool seen{};
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!seen && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    seen = partition_indexes(*current_metadata(), baz) ==
+           std::vector<int32_t>{0};
+  }
+  tailer.stop();
+  follow.join();
+  REQUIRE(seen);
+  REQUIRE(topic_named(*current_metadata(), "baz") == baz);
+  REQUIRE(current_metadata()->end_offset == 6);
+}
+
+TEST_CASE("Testing partition table", "[metadata][partitions]") {
+  uuid128 bar;
+  uuid128::parse("00000000-0000-4000-8000-000000000092", bar);
+  std::vector<int32_t> replicas{1, 2, 3};
+  std::vector<int32_t> same_replicas{1, 2, 3};
+  std::vector<int32_t> isr{1, 2};
+
+  partition_table table;
+  partition_table::partition_state p;
+  p.replicas = replicas;
+  p.isr = isr;
+  // partitions before their topic, out of order
+  for (int32_t i : {2, 0, 1}) {
+    p.partition_index = i;
+    table.add_partition(FOO, p);
+  }
+  REQUIRE(table.topic_count() == 1);
+  REQUIRE_FALSE(table.topic_named[0]);
+  REQUIRE(table.find_topic(std::string_view("")) == partition_table::NONE);
+  REQUIRE(table.add_topic("foo", FOO) == 0);
+  REQUIRE(table.add_topic("bar", bar) == 1);
+  p.partition_index = 0;
+  p.replicas = same_replicas;
+  p.leader_id = 3;
+  uint32_t bar0 = table.add_partition(bar, p);
+  table.freeze();
+
+  REQUIRE(table.find_topic(FOO) == 0);
+  REQUIRE(table.find_topic(std::string_view("bar")) == 1);
+  REQUIRE(table.topic_name(1) == "bar");
+  std::span<uint32_t const> slots = table.partitions(0);
+  REQUIRE(std::vector<uint32_t>(slots.begin(), slots.end()) ==
+          std::vector<uint32_t>{1, 2, 0});
+  REQUIRE(table.find_partition(1, 0) == bar0);
+  REQUIRE(table.find_partition(1, 1) == partition_table::NONE);
+
+  // equal lists are stored once, null stays apart from empty
+  REQUIRE(table.replicas[bar0] == table.replicas[0]);
+  REQUIRE(table.isr[bar0] != table.replicas[bar0]);
+  REQUIRE(table.offline_replicas[bar0] == partition_table::NULL_LIST);
+  std::vector<int32_t> none;
+  REQUIRE(table.intern_list(none) != partition_table::NULL_LIST);
+  REQUIRE(table.list(table.replicas[bar0]).size() == 3);
+
+  // a partition added again is updated in place
+  p.leader_id = 4;
+  p.leader_epoch = 1;
+  p.replicas = std::nullopt;
+  REQUIRE(table.add_partition(bar, p) == bar0);
+  REQUIRE(table.partition_count() == 4);
+  REQUIRE(table.leader_id[bar0] == 4);
+  REQUIRE(table.replicas[bar0] == partition_table::NULL_LIST);
+
+  // a name taken over by another topic finds the newer one
+  uuid128 baz;
+  uuid128::parse("00000000-0000-4000-8000-000000000093", baz);
+  REQUIRE(table.add_topic("foo", baz) == 2);
+  REQUIRE(table.find_topic(std::string_view("foo")) == 2);
+  table.add_topic("renamed", baz);
+  REQUIRE(table.find_topic(std::string_view("foo")) == partition_table::NONE);
+  REQUIRE(table.find_topic(std::string_view("renamed")) == 2);
+
+  auto records = std::make_shared<scarray<sint8>>();
+  table.set_records(bar0, records);
+  REQUIRE(*table.find_records(bar0) == records);
+  REQUIRE(table.find_records(0) == nullptr);
+}
+
+TEST_CASE("Testing partition state", "[metadata][partitions]") {
+  scratch_dir dir("partition-state");
+  uuid128 directory;
+  uuid128::parse("00000000-0000-4000-8000-0000000000d1", directory);
+  record r = partition_record(3, FOO);
+  auto v = std::dynamic_pointer_cast<record_value_type3_t>(r.value.value);
+  v->replica_array = scfixarray<int32_t>({1, 2, 3});
+  v->in_sync_replica_array = scfixarray<int32_t>({2, 3});
+  v->adding_replica_array = scfixarray<int32_t>({3});
+  v->removing_replica_array = scfixarray<int32_t>({1});
+  v->leader.val = 2;
+  v->leader_epoch.val = 5;
+  v->partition_epoch.val = 7;
+  v->directories_array.is_null = false;
+  v->directories_array.val.emplace_back(directory);
+
+  // only named topics are encoded
+  metadata_image m;
+  record t = topic_record("foo", FOO);
+  apply_metadata_record(m, t);
+  apply_metadata_record(m, r);
+  m.partitions.freeze();
+  auto check = [&](partition_table const &table) {
+    uint32_t slot = table.find_partition(table.find_topic(FOO), 3);
+    REQUIRE(slot != partition_table::NONE);
+    REQUIRE(table.leader_id[slot] == 2);
+    REQUIRE(table.leader_epoch[slot] == 5);
+    REQUIRE(table.partition_epoch[slot] == 7);
+    REQUIRE(table.list(table.isr[slot]).size() == 2);
+    REQUIRE(table.list(table.adding_replicas[slot])[0] == 3);
+    REQUIRE(table.list(table.removing_replicas[slot])[0] == 1);
+    REQUIRE(table.directory_lists[table.directories[slot]][0] == directory);
+
+    // what DescribeTopicPartitions sends for it
+    std::span<int8_t const> bytes =
+        table.encoded_partition(table.find_topic(FOO), 0);
+    std::vector<int8_t> buf(bytes.begin(), bytes.end());
+    res_partition p;
+    REQUIRE(size_t(p.deserialize(buf.data())) == buf.size());
+    REQUIRE(p.error_code.val == 0);
+    REQUIRE(p.partition_index.val == 3);
+    REQUIRE(p.leader_id.val == 2);
+    REQUIRE(p.leader_epoch.val == 5);
+    REQUIRE(p.replica_nodes.val.size() == 3);
+    REQUIRE(p.isr_nodes.val[0] == 2);
+    REQUIRE_FALSE(p.eligible_leader_replicas.is_null);
+    REQUIRE(p.eligible_leader_replicas.val.empty());
+    REQUIRE_FALSE(p.offline_replicas.is_null);
+  };
+  check(m.partitions);
+
+  // an update is encoded again, once the table is frozen
+  v->leader.val = 3;
+  apply_metadata_record(m, r);
+  m.partitions.freeze();
+  std::span<int8_t const> bytes = m.partitions.encoded_partition(0, 0);
+  std::vector<int8_t> buf(bytes.begin(), bytes.end());
+  res_partition updated;
+  updated.deserialize(buf.data());
+  REQUIRE(updated.leader_id.val == 3);
+  v->leader.val = 2;
+  apply_metadata_record(m, r);
+
+  // and all of it survives a snapshot
+  m.end_offset = 1;
+  REQUIRE(write_metadata_snapshot(dir.path.string(), m));
+  metadata_image loaded;
+  REQUIRE(load_metadata_snapshot(dir.path.string(), loaded) == 1);
+  check(loaded.partitions);
+}
+
+TEST_CASE("Testing encoded topics", "[metadata][partitions]") {
+  uuid128 bar;
+  uuid128::parse("00000000-0000-4000-8000-000000000092", bar);
+  auto apply = [](metadata_image &m, record r) { apply_metadata_record(m, r); };
+  metadata_image m;
+  apply(m, topic_record("foo", FOO));
+  apply(m, partition_record(1, FOO));
+  apply(m, partition_record(0, FOO));
+  apply(m, topic_record("bar", bar));
+  apply(m, partition_record(0, bar));
+  m.partitions.freeze();
+
+  auto decode = [](std::span<int8_t const> bytes) {
+    std::vector<int8_t> buf(bytes.begin(), bytes.end());
+    res_topic_info info;
+    REQUIRE(size_t(info.deserialize(buf.data())) == buf.size());
+    return info;
+  };
+  // by name, for paging through all of them
+  std::span<uint32_t const> all = m.partitions.topics_from("");
+  REQUIRE(std::vector<uint32_t>(all.begin(), all.end()) ==
+          std::vector<uint32_t>{1, 0});
+  REQUIRE(m.partitions.topics_from("c").size() == 1);
+  REQUIRE(m.partitions.topics_from("g").empty());
+
+  res_topic_info foo = decode(m.partitions.encoded_topic(0));
+  REQUIRE(foo.error_code.val == 0);
+  REQUIRE(foo.name.val == "foo");
+  REQUIRE(foo.topic_id.id() == FOO);
+  REQUIRE(foo.partitions.val.size() == 2);
+  REQUIRE(foo.partitions.val[0].partition_index.val == 0);
+  REQUIRE(foo.partitions.val[1].leader_id.val == 1);
+
+  // and for Metadata, the topic id where the versions that send it want it
+  partition_table::topic_bytes const& bytes = m.partitions.metadata_topic(0);
+  REQUIRE(bytes.metadata_id_at == 2 + 4);
+  REQUIRE(std::memcmp(bytes.metadata.data() + bytes.metadata_id_at, FOO.bytes,
+                      sizeof(FOO.bytes)) == 0);
+
+  // a change re-encodes the topics it touches and shares the others
+  metadata_image next = m;
+  apply(next, partition_record(2, FOO));
+  next.partitions.freeze();
+  REQUIRE(next.partitions.topic_fragment[0] != m.partitions.topic_fragment[0]);
+  REQUIRE(next.partitions.topic_fragment[1] == m.partitions.topic_fragment[1]);
+  REQUIRE(decode(next.partitions.encoded_topic(0)).partitions.val.size() == 3);
+  REQUIRE(decode(m.partitions.encoded_topic(0)).partitions.val.size() == 2);
+}
+
+TEST_CASE("Testing flat index removal", "[metadata][index]") {
+  // every key in one probe run, so removals have entries to shift back
+  flat_index index;
+  auto same = [](uint32_t want) {
+    return [want](uint32_t v) { return v == want; };
+  };
+  for (uint32_t v = 0; v < 10; ++v) index.insert(v < 5 ? 3 : 19, v, same(v));
+  for (uint32_t v = 0; v < 10; v += 2) index.erase(v < 5 ? 3 : 19, same(v));
+  REQUIRE(index.used == 5);
+  for (uint32_t v = 0; v < 10; ++v) {
+    uint32_t want = v % 2 ? v : flat_index::EMPTY;
+    REQUIRE(index.find(v < 5 ? 3 : 19, same(v)) == want);
+  }
+  index.erase(7, same(1));
+  REQUIRE(index.used == 5);
+}
+
+TEST_CASE("Testing copied tables share what is unchanged",
+          "[metadata][partitions]") {
+  cow_vector<int32_t> a;
+  for (int32_t i = 0; i < int32_t(2 * a.CHUNK + 1); ++i) a.push_back(i);
+  cow_vector<int32_t> b = a;
+  b.mut(a.CHUNK) = -1;
+  REQUIRE(a[a.CHUNK] == int32_t(a.CHUNK));
+  REQUIRE(b[a.CHUNK] == -1);
+  // only the chunk written to was copied
+  REQUIRE(a.chunks[0] == b.chunks[0]);
+  REQUIRE(a.chunks[1] != b.chunks[1]);
+  REQUIRE(a.chunks[2] == b.chunks[2]);
+  b.resize(a.CHUNK);
+  REQUIRE(b.chunks.size() == 1);
+  REQUIRE(a.size() == 2 * a.CHUNK + 1);
+
+  // the next version of the metadata only encodes the topic that changed
+  uuid128 bar;
+  uuid128::parse("00000000-0000-4000-8000-000000000092", bar);
+  metadata_image m;
+  for (auto [name, id] : {std::pair{"foo", FOO}, std::pair{"bar", bar}}) {
+    record t = topic_record(name, id);
+    record p = partition_record(0, id);
+    apply_metadata_record(m, t);
+    apply_metadata_record(m, p);
+  }
+  m.partitions.freeze();
+  metadata_image next = m;
+  record c = change_record(0, bar);
+  std::dynamic_pointer_cast<record_value_type5_t>(c.value.value)->leader.val = 7;
+  apply_metadata_record(next, c);
+  next.partitions.freeze();
+  partition_table const &before = m.partitions, &after = next.partitions;
+  uint32_t foo_t = before.find_topic(FOO), bar_t = before.find_topic(bar);
+  REQUIRE(&before.metadata_topic(foo_t) == &after.metadata_topic(foo_t));
+  REQUIRE(&before.metadata_topic(bar_t) != &after.metadata_topic(bar_t));
+  REQUIRE(before.by_topic == after.by_topic);
+  uint32_t slot = before.find_partition(bar_t, 0);
+  REQUIRE(before.leader_id[slot] == 1);
+  REQUIRE(after.leader_id[slot] == 7);
+  res_partition p;
+  std::span<int8_t const> bytes = after.encoded_partition(bar_t, 0);
+  std::vector<int8_t> buf(bytes.begin(), bytes.end());
+  p.deserialize(buf.data());
+  REQUIRE(p.leader_id.val == 7);
+}
+
+TEST_CASE("Testing partition changes", "[metadata][partitions]") {
+  scratch_dir dir("partition-changes");
+  uuid128 d1, d2, d3;
+  uuid128::parse("00000000-0000-4000-8000-0000000000d1", d1);
+  uuid128::parse("00000000-0000-4000-8000-0000000000d2", d2);
+  uuid128::parse("00000000-0000-4000-8000-0000000000d3", d3);
+  auto apply = [](metadata_image &m, record r) { apply_metadata_record(m, r); };
+  metadata_image m;
+  apply(m, topic_record("foo", FOO));
+  record r = partition_record(0, FOO);
+  auto v = std::dynamic_pointer_cast<record_value_type3_t>(r.value.value);
+  v->replica_array = scfixarray<int32_t>({1, 2, 3});
+  v->in_sync_replica_array = scfixarray<int32_t>({1, 2, 3});
+  v->leader_epoch.val = 4;
+  v->partition_epoch.val = 6;
+  v->directories_array.is_null = false;
+  for (uuid128 const &d : {d1, d2, d3}) v->directories_array.val.emplace_back(d);
+  apply(m, r);
+
+  // a new leader is a new leader epoch; lists not in the record stay
+  record c = change_record(0, FOO);
+  auto change = std::dynamic_pointer_cast<record_value_type5_t>(c.value.value);
+  change->leader.val = 2;
+  change->isr = scfixarray<int32_t>({2, 3});
+  change->eligible_leader_replicas = scfixarray<int32_t>({1});
+  apply(m, c);
+  partition_table const &table = m.partitions;
+  uint32_t slot = table.find_partition(table.find_topic(FOO), 0);
+  REQUIRE(table.leader_id[slot] == 2);
+  REQUIRE(table.leader_epoch[slot] == 5);
+  REQUIRE(table.partition_epoch[slot] == 7);
+  REQUIRE(table.list(table.replicas[slot]).size() == 3);
+  REQUIRE(table.list(table.isr[slot]).size() == 2);
+  REQUIRE(table.list(table.eligible_leader_replicas[slot])[0] == 1);
+
+  // replicas that stay keep their directory
+  change = std::make_shared<record_value_type5_t>();
+  change->partition_id.val = 0;
+  change->topic_uuid = suuid(FOO);
+  change->replicas = scfixarray<int32_t>({3, 4});
+  c.value.value = change;
+  apply(m, c);
+  REQUIRE(table.leader_id[slot] == 2);
+  REQUIRE(table.leader_epoch[slot] == 5);
+  REQUIRE(table.partition_epoch[slot] == 8);
+  REQUIRE(table.list(table.isr[slot]).size() == 2);
+  std::span<uuid128 const> dirs =
+      table.directory_lists[table.directories[slot]];
+  REQUIRE(dirs.size() == 2);
+  REQUIRE(dirs[0] == d3);
+  REQUIRE(dirs[1] == uuid128{});
+
+  // a partition that is not there is left alone
+  change->partition_id.val = 9;
+  apply(m, c);
+  REQUIRE(table.partition_count() == 1);
+
+  // what DescribeTopicPartitions sends for it
+  m.partitions.freeze();
+  std::span<int8_t const> bytes =
+      table.encoded_partition(table.find_topic(FOO), 0);
+  std::vector<int8_t> buf(bytes.begin(), bytes.end());
+  res_partition p;
+  p.deserialize(buf.data());
+  REQUIRE(p.leader_epoch.val == 5);
+  REQUIRE(p.replica_nodes.val.size() == 2);
+  REQUIRE(p.eligible_leader_replicas.val.size() == 1);
+
+  // the ELR goes through a snapshot as PartitionRecord's tagged fields
+  m.end_offset = 3;
+  REQUIRE(write_metadata_snapshot(dir.path.string(), m));
+  metadata_image loaded;
+  REQUIRE(load_metadata_snapshot(dir.path.string(), loaded) == 3);
+  partition_table const &again = loaded.partitions;
+  uint32_t s = again.find_partition(again.find_topic(FOO), 0);
+  REQUIRE(again.leader_epoch[s] == 5);
+  REQUIRE(again.list(again.eligible_leader_replicas[s])[0] == 1);
+  REQUIRE(again.list(again.last_known_elr[s]).empty());
+}
+
+TEST_CASE("Testing updates that move the list pool", "[metadata][partitions]") {
+  partition_table table;
+  table.add_topic("foo", FOO);
+  std::vector<int32_t> replicas{1, 2, 3}, isr{1, 2}, elr{3};
+  partition_table::partition_state p;
+  p.replicas = replicas;
+  p.isr = isr;
+  p.eligible_leader_replicas = elr;
+  uint32_t slot = table.add_partition(FOO, p);
+
+  // new replicas with the ISR and ELR as they were, with no room left in the
+  // pool for the new list
+  for (int repeat = 0; repeat < 2; ++repeat) {
+    table.lists.values.shrink_to_fit();
+    p = table.state(slot);
+    std::vector<int32_t> moved{4, 5, 6, 7, 8, 9, 10, 11, repeat};
+    p.replicas = moved;
+    table.add_partition(FOO, p);
+    REQUIRE(table.list(table.replicas[slot]).size() == moved.size());
+    REQUIRE(table.list(table.replicas[slot]).back() == repeat);
+    REQUIRE(table.list(table.isr[slot]).size() == 2);
+    REQUIRE(table.list(table.isr[slot])[1] == 2);
+    REQUIRE(table.list(table.eligible_leader_replicas[slot])[0] == 3);
+  }
+
+  // part of a pooled list is not one of the pool's lists
+  table.lists.values.shrink_to_fit();
+  p = table.state(slot);
+  p.offline_replicas = p.replicas->subspan(1, 2);
+  p.replicas = std::span(isr).first(1);
+  table.add_partition(FOO, p);
+  REQUIRE(table.list(table.offline_replicas[slot]).size() == 2);
+  REQUIRE(table.list(table.offline_replicas[slot])[0] == 5);
+  REQUIRE(table.list(table.replicas[slot])[0] == 1);
+}
+
+TEST_CASE("Testing partition change tags", "[metadata][partitions]") {
+  uuid128 d1, d4;
+  uuid128::parse("00000000-0000-4000-8000-0000000000d1", d1);
+  uuid128::parse("00000000-0000-4000-8000-0000000000d4", d4);
+  metadata_image m;
+  record t = topic_record("foo", FOO);
+  record p = partition_record(0, FOO);
+  apply_metadata_record(m, t);
+  apply_metadata_record(m, p);
+
+  // ELR, last known ELR and directories as KRaft tags them: 6, 7 and 8
+  record c = change_record(0, FOO);
+  scfixarray<int32_t> replicas({1, 4});
+  scfixarray<int32_t> elr({4});
+  scfixarray<int32_t> last_known({1});
+  scarray<suuid> dirs;
+  dirs.is_null = false;
+  for (uuid128 const &d : {d1, d4}) dirs.val.emplace_back(d);
+  auto &tags = c.value.tagged_fields.fields;
+  tags.push_back(encode_tag(2, replicas, 16));
+  tags.push_back(encode_tag(6, elr, 16));
+  tags.push_back(encode_tag(7, last_known, 16));
+  tags.push_back(encode_tag(8, dirs, 64));
+  std::vector<int8_t> buf(256);
+  int32_t n = c.value.serialize(buf.data());
+
+  record decoded;
+  REQUIRE(decoded.value.deserialize(buf.data()) == n);
+  auto change =
+      std::dynamic_pointer_cast<record_value_type5_t>(decoded.value.value);
+  REQUIRE(change);
+  REQUIRE(change->eligible_leader_replicas.val.size() == 1);
+  REQUIRE(change->eligible_leader_replicas.val[0] == 4);
+  REQUIRE(change->last_known_elr.val.size() == 1);
+  REQUIRE(change->last_known_elr.val[0] == 1);
+  REQUIRE(change->directories.val.size() == 2);
+  REQUIRE(change->isr.is_null);
+
+  apply_metadata_record(m, decoded);
+  partition_table const &table = m.partitions;
+  uint32_t slot = table.find_partition(table.find_topic(FOO), 0);
+  REQUIRE(table.list(table.replicas[slot]).size() == 2);
+  REQUIRE(table.list(table.eligible_leader_replicas[slot])[0] == 4);
+  REQUIRE(table.list(table.last_known_elr[slot])[0] == 1);
+  std::span<uuid128 const> d = table.directory_lists[table.directories[slot]];
+  REQUIRE(d.size() == 2);
+  REQUIRE(d[0] == d1);
+  REQUIRE(d[1] == d4);
+}
+
+TEST_CASE("Testing topic removal", "[metadata][partitions]") {
+  scratch_dir dir("topic-removal");
+  uuid128 bar, foo2;
+  uuid128::parse("00000000-0000-4000-8000-000000000092", bar);
+  uuid128::parse("00000000-0000-4000-8000-000000000093", foo2);
+  auto apply = [](metadata_image &m, record r) { apply_metadata_record(m, r); };
+  metadata_image m;
+  apply(m, topic_record("foo", FOO));
+  apply(m, partition_record(0, FOO));
+  apply(m, partition_record(1, FOO));
+  apply(m, topic_record("bar", bar));
+  apply(m, partition_record(0, bar));
+  partition_table &table = m.partitions;
+  table.set_records(table.find_partition(0, 1),
+                    std::make_shared<scarray<sint8>>());
+  table.freeze();
+
+  metadata_image before = m;
+  apply(m, remove_topic_record(FOO));
+  apply(m, change_record(0, FOO));
+  table.freeze();
+  REQUIRE(table.find_topic(FOO) == partition_table::NONE);
+  REQUIRE(table.find_topic("foo") == partition_table::NONE);
+  REQUIRE(table.find_partition(0, 1) == partition_table::NONE);
+  REQUIRE(table.find_records(1) == nullptr);
+  REQUIRE(table.partitions(0).empty());
+  std::span<uint32_t const> all = table.topics_from("");
+  REQUIRE(std::vector<uint32_t>(all.begin(), all.end()) ==
+          std::vector<uint32_t>{1});
+  REQUIRE(table.partitions(1).size() == 1);
+  // the version published before still has it
+  REQUIRE(before.partitions.find_topic("foo") == 0);
+  REQUIRE(before.partitions.partitions(0).size() == 2);
+
+  // the name can be given to a new topic
+  apply(m, topic_record("foo", foo2));
+  apply(m, partition_record(0, foo2));
+  table.freeze();
+  uint32_t t = table.find_topic("foo");
+  REQUIRE(t == table.find_topic(foo2));
+  REQUIRE(table.partitions(t).size() == 1);
+
+  // and the snapshot has no trace of the old one
+  m.end_offset = 10;
+  REQUIRE(write_metadata_snapshot(dir.path.string(), m));
+  metadata_image loaded;
+  REQUIRE(load_metadata_snapshot(dir.path.string(), loaded) == 10);
+  REQUIRE(loaded.partitions.topic_count() == 2);
+  REQUIRE(loaded.partitions.partition_count() == 2);
+  REQUIRE(loaded.partitions.find_topic(FOO) == partition_table::NONE);
+  REQUIRE(partition_indexes(loaded, foo2) == std::vector<int32_t>{0});
+}
@@ -1,4 +1,5 @@
 #include <netinet/in.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <algorithm>
@@ -8,13 +9,42 @@
 #include <cstdint>
 #include <cstdio>
 #include <ostream>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
+#include "buffer_pool.hpp"
 #include "hexutil.hpp"
 #include "primitive.hpp"
+#include "record.hpp"
+#include "response_message.hpp"
+#include "uuid.hpp"
 
 int const BS = 1024;
 
+TEST_CASE("Testing hex codec", "[hex]") {
+  int8_t bytes[4] = {0x00, 0x7f, -1, -0x80};
+  char text[8];
+  REQUIRE(hex_encode(bytes, text) == 8);
+  REQUIRE(std::string(text, 8) == "007fff80");
+  REQUIRE(hex_encode(bytes, std::span<char>(text, 7)) == -1);
+  REQUIRE(tohex(bytes, 4) == "0x007fff80");
+  REQUIRE(tohex(bytes, 0) == "0x");
+
+  int8_t out[4];
+  REQUIRE(hex_decode("007FfF80", out) == 4);
+  REQUIRE(std::equal(out, out + 4, bytes));
+  REQUIRE(tobuf("0x007fff80", out, 4) == 4);
+  REQUIRE(tobuf("007fff80", out, 4) == 4);
+  REQUIRE(std::equal(out, out + 4, bytes));
+
+  REQUIRE(hex_decode("0g", out) == -1);
+  REQUIRE(hex_decode("0 ", out) == -1);
+  REQUIRE(hex_decode("abc", out) == -1);
+  REQUIRE(hex_decode("0011223344", out) == -1);
+  REQUIRE(hex_decode("", out) == 0);
+}
+
 TEST_CASE("Testing boolean", "[bool][fixed]") {
   int8_t in[BS], out[BS];
   int32_t sz;
@@ -111,7 +141,7 @@ TEST_CASE("Testing int64", "[int32]") {
   REQUIRE(sz == 8);
   REQUIRE(si.val == -1);
 
-  REQUIRE(tobuf("0x7ffffffffffffff", in, BS) != -1);
+  REQUIRE(tobuf("0x7fffffffffffffff", in, BS) != -1);
   sz = si.deserialize(in);
   REQUIRE(sz == 8);
   REQUIRE(si.val == INT64_MAX);
@@ -205,6 +235,17 @@ TEST_CASE("Testing svint", "[svint]") {
   sz = si.deserialize(in);
   REQUIRE(sz == 2);
   REQUIRE(si.val == 150);
+
+  // svlong zigzags on the sign, not on the low bit
+  sz = svlong(-2).serialize(out);
+  REQUIRE(tohex(out, sz) == "0x03");
+  sz = svlong(3).serialize(out);
+  REQUIRE(tohex(out, sz) == "0x06");
+  sz = svlong(INT64_MIN).serialize(out);
+  REQUIRE(tohex(out, sz) == "0xffffffffffffffffff01");
+  svlong sl;
+  REQUIRE(sl.deserialize(out) == 10);
+  REQUIRE(sl.val == INT64_MIN);
 }
 
 TEST_CASE("Testing UUID", "[uuid]") {
@@ -226,6 +267,34 @@ TEST_CASE("Testing UUID", "[uuid]") {
   REQUIRE(tohex(si.val, 16) == "0x550e8400e29b41d4a716446655440000");
 }
 
+TEST_CASE("Testing UUID value type", "[uuid]") {
+  uuid128 u;
+  REQUIRE(uuid128::parse("550e8400-e29b-41d4-a716-446655440000", u));
+  REQUIRE(u.str() == "550e8400-e29b-41d4-a716-446655440000");
+  REQUIRE(suuid(u).str() == "550e8400-e29b-41d4-a716-446655440000");
+  REQUIRE(suuid("550e8400-e29b-41d4-a716-446655440000").id() == u);
+
+  // upper case is accepted, output is always lower case
+  uuid128 up;
+  REQUIRE(uuid128::parse("550E8400-E29B-41D4-A716-446655440000", up));
+  REQUIRE(up == u);
+
+  uuid128 bad = u;
+  REQUIRE(!uuid128::parse("550e8400e29b41d4a716446655440000", bad));
+  REQUIRE(!uuid128::parse("550e8400-e29b-41d4-a716-44665544000g", bad));
+  REQUIRE(!uuid128::parse("550e8400-e29b-41d4-a716_446655440000", bad));
+  REQUIRE(bad == u);
+
+  uuid128 zero;
+  REQUIRE(zero.str() == "00000000-0000-0000-0000-000000000000");
+  REQUIRE(zero < u);
+  REQUIRE(zero != u);
+  REQUIRE(std::hash<uuid128>{}(u) == std::hash<uuid128>{}(up));
+  REQUIRE(std::hash<uuid128>{}(u) != std::hash<uuid128>{}(zero));
+  REQUIRE(std::is_trivially_copyable_v<uuid128>);
+  REQUIRE(sizeof(uuid128) == 16);
+}
+
 TEST_CASE("Testing string", "[string]") {
   int8_t in[BS], out[BS];
   int32_t sz;
@@ -352,6 +421,41 @@ TEST_CASE("Testing compact array", "[array]") {
   REQUIRE(sa.val.size() == 0);
 }
 
+TEST_CASE("Testing fixed-width arrays", "[array][fixed]") {
+  int8_t in[BS], out[BS];
+  int32_t sz;
+
+  sz = sfixarray<int16_t>({1, 12, 24, 126}).serialize(out);
+  REQUIRE(tohex(out, sz) == "0x000000040001000c0018007e");
+  sz = sfixarray<int16_t>().serialize(out);
+  REQUIRE(tohex(out, sz) == "0xffffffff");
+  sz = scfixarray<int32_t>().serialize(out);
+  REQUIRE(tohex(out, sz) == "0x00");
+
+  // same bytes as the element-wise array, also at an unaligned offset
+  scarray<sint32> slow({sint32(1), sint32(-2), sint32(0x01020304)});
+  scfixarray<int32_t> fast({1, -2, 0x01020304});
+  sz = slow.serialize(in);
+  REQUIRE(fast.serialize(out + 1) == sz);
+  REQUIRE(tohex(in, sz) == tohex(out + 1, sz));
+
+  REQUIRE(tobuf("0x00" "03" "0102030405060708" "fffffffffffffffe", in, BS) !=
+          -1);
+  scfixarray<int64_t> a;
+  REQUIRE(a.deserialize(in + 1) == 17);
+  REQUIRE(!a.is_null);
+  REQUIRE(a.val.size() == 2);
+  REQUIRE(a.val[0] == 0x0102030405060708);
+  REQUIRE(a.val[1] == -2);
+  sz = a.serialize(out);
+  REQUIRE(tohex(out, sz) == "0x030102030405060708fffffffffffffffe");
+
+  REQUIRE(tobuf("0x00", in, BS) != -1);
+  REQUIRE(a.deserialize(in) == 1);
+  REQUIRE(a.is_null);
+  REQUIRE(a.val.empty());
+}
+
 TEST_CASE("Testing tagged buffer", "[tags]") {
   typedef stagged_fields::field field;
   int8_t in[BS], out[BS];
@@ -384,3 +488,501 @@ TEST_CASE("Testing tagged buffer", "[tags]") {
                        t.fields[i].data.begin()));
   }
 }
+
+TEST_CASE("Testing skipped tagged fields", "[tags][view]") {
+  int8_t in[BS], out[BS];
+  int32_t sz;
+
+  stagged_fields_view t;
+  sz = t.serialize(out);
+  REQUIRE(tohex(out, sz) == "0x00");
+
+  REQUIRE(tobuf("0x02010668656c6c6f210205776f726c64ff", in, BS) != -1);
+  REQUIRE(t.deserialize(in) == 16);
+  REQUIRE(t.raw.data() == in);
+  REQUIRE(t.raw.size() == 16);
+  std::span<int8_t> world = t.find(2);
+  REQUIRE(std::string(world.begin(), world.end()) == "world");
+  REQUIRE(t.find(3).empty());
+  int n{};
+  t.for_each([&](uint32_t tag, std::span<int8_t> data) {
+    REQUIRE(tag == uint32_t(++n));
+    REQUIRE(data.size() == (tag == 1 ? 6 : 5));
+  });
+  REQUIRE(n == 2);
+  sz = t.serialize(out);
+  REQUIRE(tohex(out, sz) == "0x02010668656c6c6f210205776f726c64");
+}
+
+TEST_CASE("Testing skipped subtree", "[skip]") {
+  int8_t in[BS], out[BS];
+  int32_t sz;
+
+  sskip<scarray<sint32>> s;
+  sz = s.serialize(out);
+  REQUIRE(tohex(out, sz) == "0x00");
+
+  REQUIRE(tobuf("0x03000000010000000200", in, BS) != -1);
+  {
+    msg_arena arena;
+    msg_arena_scope scope(arena);
+    REQUIRE(s.deserialize(in) == 9);
+  }
+  // the scratch object outlives the arena, so it never allocates from it
+  REQUIRE(resource_of(sskip<scarray<sint32>>::scratch().val) ==
+          std::pmr::get_default_resource());
+  REQUIRE(s.raw.size() == 9);
+  scarray<sint32> a = s.decode();
+  REQUIRE(a.val.size() == 2);
+  REQUIRE(a.val[1].val == 2);
+  sz = s.serialize(out);
+  REQUIRE(tohex(out, sz) == "0x030000000100000002");
+}
+
+TEST_CASE("Testing string views", "[string][view]") {
+  int8_t in[BS], out[BS];
+  int32_t sz;
+
+  sz = sstring_view("hello").serialize(out);
+  REQUIRE(sz == 7);
+  REQUIRE(tohex(out, sz) == "0x000568656c6c6f");
+
+  sz = scstring_view("hello").serialize(out);
+  REQUIRE(sz == 6);
+  REQUIRE(tohex(out, sz) == "0x0668656c6c6f");
+
+  sz = snstring_view().serialize(out);
+  REQUIRE(sz == 2);
+  REQUIRE(tohex(out, sz) == "0xffff");
+
+  sz = scnstring_view().serialize(out);
+  REQUIRE(sz == 1);
+  REQUIRE(tohex(out, sz) == "0x00");
+
+  // views point straight into the decoded buffer
+  sstring_view sv;
+  REQUIRE(tobuf("0x000568656c6c6f", in, BS) != -1);
+  sz = sv.deserialize(in);
+  REQUIRE(sz == 7);
+  REQUIRE(sv.val == "hello");
+  REQUIRE(sv.val.data() == reinterpret_cast<char*>(in) + 2);
+
+  scstring_view csv;
+  REQUIRE(tobuf("0x0668656c6c6f", in, BS) != -1);
+  sz = csv.deserialize(in);
+  REQUIRE(sz == 6);
+  REQUIRE(csv.val == "hello");
+  REQUIRE(csv.val.data() == reinterpret_cast<char*>(in) + 1);
+
+  snstring_view nsv;
+  REQUIRE(tobuf("0xffff", in, BS) != -1);
+  sz = nsv.deserialize(in);
+  REQUIRE(sz == 2);
+  REQUIRE(nsv.is_null);
+  REQUIRE(tobuf("0x000568656c6c6f", in, BS) != -1);
+  sz = nsv.deserialize(in);
+  REQUIRE(sz == 7);
+  REQUIRE(!nsv.is_null);
+  REQUIRE(nsv.val == "hello");
+
+  scnstring_view cnsv;
+  REQUIRE(tobuf("0x00", in, BS) != -1);
+  sz = cnsv.deserialize(in);
+  REQUIRE(sz == 1);
+  REQUIRE(cnsv.is_null);
+  REQUIRE(tobuf("0x0668656c6c6f", in, BS) != -1);
+  sz = cnsv.deserialize(in);
+  REQUIRE(sz == 6);
+  REQUIRE(!cnsv.is_null);
+  REQUIRE(cnsv.val == "hello");
+}
+
+TEST_CASE("Testing message arena", "[arena]") {
+  int8_t in[BS];
+  REQUIRE(tobuf("0x0302000104000200030004", in, BS) != -1);
+
+  scarray<scarray<sint16>> kept;
+  REQUIRE(resource_of(kept.val) == std::pmr::get_default_resource());
+
+  msg_arena arena;
+  {
+    msg_arena_scope scope(arena);
+    scarray<scarray<sint16>> sa;
+    REQUIRE(sa.deserialize(in) == 11);
+    REQUIRE(sa.val.size() == 2);
+    REQUIRE(resource_of(sa.val) == arena.resource());
+    REQUIRE(resource_of(sa.val[1].val) == arena.resource());
+    REQUIRE(sa.val[1].val[2].val == 4);
+
+    // copying out of the arena lands in the destination's resource
+    kept = sa;
+    REQUIRE(resource_of(kept.val) == std::pmr::get_default_resource());
+    REQUIRE(resource_of(kept.val[1].val) == std::pmr::get_default_resource());
+
+    // and so do elements the long-lived container creates itself
+    scarray<sint16>& e = kept.emplace_back();
+    REQUIRE(resource_of(e.val) == std::pmr::get_default_resource());
+  }
+  REQUIRE(resource_of(scarray<sint16>().val) ==
+          std::pmr::get_default_resource());
+  REQUIRE(kept.val.size() == 3);
+  REQUIRE(kept.val[1].val[2].val == 4);
+}
+
+TEST_CASE("Testing message reuse", "[arena][reuse]") {
+  int8_t in[BS];
+
+  // decoding into a used array keeps its elements and their storage
+  scarray<scarray<sint16>> sa;
+  REQUIRE(tobuf("0x030300010002020003", in, BS) != -1);
+  REQUIRE(sa.deserialize(in) == 9);
+  sint16 const* first = sa.val[0].val.data();
+  REQUIRE(tobuf("0x020300040005", in, BS) != -1);
+  REQUIRE(sa.deserialize(in) == 6);
+  REQUIRE(sa.val.size() == 1);
+  REQUIRE(sa.val[0].val.data() == first);
+  REQUIRE(sa.val[0].val[0].val == 4);
+  REQUIRE(sa.val[0].val[1].val == 5);
+
+  // a null array leaves no stale elements behind
+  REQUIRE(tobuf("0x00", in, BS) != -1);
+  REQUIRE(sa.deserialize(in) == 1);
+  REQUIRE(sa.is_null);
+  REQUIRE(sa.val.empty());
+
+  // elements added while an arena is active still come from the heap when
+  // the array was built outside of it
+  scarray<scarray<sint16>> pooled;
+  {
+    msg_arena arena;
+    msg_arena_scope scope(arena);
+    REQUIRE(tobuf("0x02020007", in, BS) != -1);
+    REQUIRE(pooled.deserialize(in) == 4);
+    REQUIRE(resource_of(pooled.val[0].val) ==
+            std::pmr::get_default_resource());
+  }
+  REQUIRE(pooled.val[0].val[0].val == 7);
+}
+
+TEST_CASE("Testing malformed input", "[decode_error]") {
+  int8_t in[BS];
+
+  // without bounds decoders trust the input, within them they check it
+  REQUIRE(tobuf("0x000000", in, BS) != -1);
+  sint32 i32;
+  {
+    decode_bounds bounds(in, 3);
+    REQUIRE_THROWS_AS(i32.deserialize(in), decode_error);
+  }
+  {
+    decode_bounds bounds(in, 0);
+    sbool b;
+    REQUIRE_THROWS_AS(b.deserialize(in), decode_error);
+  }
+  REQUIRE(i32.deserialize(in) == 4);
+
+  // a length running past the end
+  REQUIRE(tobuf("0x0005666f6f", in, BS) != -1);
+  {
+    decode_bounds bounds(in, 5);
+    sstring s;
+    REQUIRE_THROWS_AS(s.deserialize(in), decode_error);
+    REQUIRE(tobuf("0x0003666f6f", in, BS) != -1);
+    REQUIRE(s.deserialize(in) == 5);
+    REQUIRE(s.val == "foo");
+  }
+
+  // negative lengths, and null where it is not allowed
+  REQUIRE(tobuf("0xfffe", in, BS) != -1);
+  {
+    decode_bounds bounds(in, 2);
+    snstring ns;
+    REQUIRE_THROWS_AS(ns.deserialize(in), decode_error);
+    REQUIRE(tobuf("0xffff", in, BS) != -1);
+    sstring s;
+    REQUIRE_THROWS_AS(s.deserialize(in), decode_error);
+    REQUIRE(ns.deserialize(in) == 2);
+    REQUIRE(ns.is_null);
+  }
+  REQUIRE(tobuf("0x00", in, BS) != -1);
+  {
+    decode_bounds bounds(in, 1);
+    scstring cs;
+    REQUIRE_THROWS_AS(cs.deserialize(in), decode_error);
+    scnstring cns;
+    REQUIRE(cns.deserialize(in) == 1);
+    REQUIRE(cns.is_null);
+  }
+  REQUIRE(tobuf("0xfffffffe", in, BS) != -1);
+  {
+    decode_bounds bounds(in, 4);
+    sarray<sint8> a;
+    REQUIRE_THROWS_AS(a.deserialize(in), decode_error);
+  }
+
+  // array counts are checked against what is left before anything is built
+  REQUIRE(tobuf("0xff0f", in, BS) != -1);
+  {
+    decode_bounds bounds(in, 2);
+    scarray<sint8> ca;
+    REQUIRE_THROWS_AS(ca.deserialize(in), decode_error);
+    REQUIRE(ca.val.capacity() == 0);
+    scfixarray<int32_t> fa;
+    REQUIRE_THROWS_AS(fa.deserialize(in), decode_error);
+  }
+
+  // varints longer than their type allows
+  REQUIRE(tobuf("0xffffffffff01", in, BS) != -1);
+  suvint uv;
+  REQUIRE_THROWS_AS(uv.deserialize(in), decode_error);
+  REQUIRE(tobuf("0xffffffffffffffffffff01", in, BS) != -1);
+  suvlong ul;
+  REQUIRE_THROWS_AS(ul.deserialize(in), decode_error);
+
+  // a tagged field longer than the input
+  REQUIRE(tobuf("0x012a05ff", in, BS) != -1);
+  {
+    decode_bounds bounds(in, 4);
+    stagged_fields t;
+    REQUIRE_THROWS_AS(t.deserialize(in), decode_error);
+    stagged_fields_view v;
+    REQUIRE_THROWS_AS(v.deserialize(in), decode_error);
+  }
+}
+
+TEST_CASE("Testing record framing", "[record]") {
+  int8_t in[BS], out[BS];
+  int32_t sz;
+
+  // sizes are computed on encode, headers are counted by a signed varint
+  record r;
+  r.attributes.val = 0;
+  r.timestamp_delta.val = 0;
+  r.offset_delta.val = 1;
+  r.value.frame_version.val = 1;
+  r.value.type.val = 2;
+  r.value.version.val = 0;
+  auto topic = std::make_shared<record_value_type2_t>();
+  topic->topic_name = scstring("foo");
+  topic->topic_uuid = suuid("00000000-0000-4000-8000-000000000091");
+  r.value.value = topic;
+  r.headers.val.emplace_back().key = record_string_t("k");
+  sz = r.serialize(out);
+  REQUIRE(tohex(out, sz) ==
+          "0x4200000201" "30" "010200" "04666f6f"
+          "00000000000040008000000000000091" "00" "02" "026b" "01");
+
+  // a partition change is all tagged fields after the partition: isr {1} and
+  // leader 1 here
+  REQUIRE(tobuf("0x4a" "010500" "00000002" "00000000000040008000000000000091"
+                "02" "00050200000001" "010400000001",
+                in, BS) != -1);
+  {
+    record_value_t change;
+    decode_bounds bounds(in, 38);
+    REQUIRE(change.deserialize(in) == 38);
+    auto c = std::dynamic_pointer_cast<record_value_type5_t>(change.value);
+    REQUIRE(c);
+    REQUIRE(c->partition_id.val == 2);
+    REQUIRE(c->isr.val == std::pmr::vector<int32_t>{1});
+    REQUIRE(c->leader.val == 1);
+    REQUIRE(c->replicas.is_null);
+    REQUIRE(c->directories.is_null);
+    sz = change.serialize(out);
+    REQUIRE(tohex(out, sz) == tohex(in, 38));
+  }
+  REQUIRE(tobuf("0x28" "010900" "00000000000040008000000000000091" "00", in,
+                BS) != -1);
+  {
+    record_value_t removal;
+    decode_bounds bounds(in, 21);
+    REQUIRE(removal.deserialize(in) == 21);
+    auto rm = std::dynamic_pointer_cast<record_value_type9_t>(removal.value);
+    REQUIRE(rm);
+    REQUIRE(rm->topic_uuid.str() == "00000000-0000-4000-8000-000000000091");
+  }
+
+  // unknown record types come back unchanged
+  REQUIRE(tobuf("0x0e" "016300" "02aabb00", in, BS) != -1);
+  record_value_t v;
+  {
+    decode_bounds bounds(in, 8);
+    REQUIRE(v.deserialize(in) == 8);
+  }
+  REQUIRE(v.type.val == 0x63);
+  sz = v.serialize(out);
+  REQUIRE(tohex(out, sz) == "0x0e01630002aabb00");
+
+  // and a value may not claim more than is there
+  REQUIRE(tobuf("0x2001630002aabb", in, BS) != -1);
+  {
+    decode_bounds bounds(in, 7);
+    REQUIRE_THROWS_AS(v.deserialize(in), decode_error);
+  }
+}
+
+// everything written to w, as one buffer
+std::vector<int8_t> gather(chunk_writer const& w) {
+  std::vector<iovec> iov;
+  w.iovecs(iov);
+  std::vector<int8_t> out;
+  for (iovec const& v : iov) {
+    auto p = static_cast<int8_t const*>(v.iov_base);
+    out.insert(out.end(), p, p + v.iov_len);
+  }
+  return out;
+}
+
+TEST_CASE("Testing chunk writer", "[chunks]") {
+  chunk_writer w;
+  std::vector<int8_t> bytes(chunk_writer::CHUNK_SIZE + 100);
+  for (size_t i = 0; i < bytes.size(); ++i) bytes[i] = i * 7;
+
+  // writes run over chunk boundaries
+  w.write(bytes.data(), 10);
+  chunk_writer::position at = w.tell();
+  w.write(bytes.data(), bytes.size());
+  REQUIRE(w.size() == bytes.size() + 10);
+  REQUIRE(w.chunks.size() == 2);
+
+  // reserve never splits, it leaves the rest of a chunk unused instead
+  int8_t* p = w.reserve(chunk_writer::CHUNK_SIZE - 50);
+  REQUIRE(w.current == 2);
+  p[0] = 42;
+  w.commit(1);
+  std::vector<iovec> iov;
+  w.iovecs(iov);
+  REQUIRE(iov.size() == 3);
+  REQUIRE(iov[1].iov_len == 110);
+
+  // patches land on bytes already written, across chunks too
+  int8_t mark[] = {1, 2, 3, 4};
+  w.patch({0, chunk_writer::CHUNK_SIZE - 2}, mark, 4);
+  w.patch(at, mark, 1);
+  std::vector<int8_t> out = gather(w);
+  REQUIRE(out.size() == w.size());
+  REQUIRE(out[10] == 1);
+  REQUIRE(out[11] == bytes[1]);
+  REQUIRE(out[chunk_writer::CHUNK_SIZE - 2] == 1);
+  REQUIRE(out[chunk_writer::CHUNK_SIZE + 1] == 4);
+  REQUIRE(out.back() == 42);
+
+  // chunks stay around for the next message
+  w.clear();
+  REQUIRE(w.size() == 0);
+  w.write(mark, 4);
+  REQUIRE(w.chunks.size() == 3);
+  REQUIRE(gather(w) == std::vector<int8_t>(mark, mark + 4));
+}
+
+TEST_CASE("Testing streamed responses", "[chunks]") {
+  // a DescribeTopicPartitions answer far beyond one chunk, with a long name
+  // and replica lists that straddle chunk boundaries
+  response_header_v1 header;
+  header.correlation_id.val = 7;
+  response_k75_v0 res(&header);
+  res.throttle_time_ms.val = 0;
+  res.topics.is_null = false;
+  res_topic_info& t = res.topics.emplace_back();
+  t.error_code.val = 0;
+  t.name = scnstring(std::string(5000, 'x'));
+  t.topic_id = suuid("00000000-0000-4000-8000-000000000091");
+  t.is_internal.val = false;
+  t.topic_authorized_operations.val = 0;
+  t.partitions.is_null = false;
+  for (int32_t i = 0; i < 1000; ++i) {
+    res_partition& p = t.partitions.emplace_back();
+    p.error_code.val = 0;
+    p.partition_index.val = i;
+    p.leader_id.val = 1;
+    p.leader_epoch.val = 0;
+    p.replica_nodes = scfixarray<int32_t>({1, 2, 3});
+    p.isr_nodes = scfixarray<int32_t>({1, 2, 3});
+    p.eligible_leader_replicas.is_null = false;
+    p.last_known_elr.is_null = false;
+    p.offline_replicas.is_null = false;
+  }
+
+  chunk_writer w;
+  int32_t len = stream_message(w, &res);
+  REQUIRE(len > 8 * 1024);
+  REQUIRE(w.chunks.size() > 2);
+
+  std::vector<int8_t> flat(len);
+  REQUIRE(write_message(flat.data(), &res) == len);
+  REQUIRE(gather(w) == flat);
+
+  // bytes of a fetch go over in bulk
+  response_header_v1 h1;
+  h1.correlation_id.val = 8;
+  response_k1_v16 fetch(&h1);
+  fetch.throttle_time_ms.val = 0;
+  fetch.error_code.val = 0;
+  fetch.session_id.val = 0;
+  fetch.responses.is_null = false;
+  k1_response& r = fetch.responses.emplace_back();
+  r.topic_id = suuid("00000000-0000-4000-8000-000000000091");
+  r.partitions.is_null = false;
+  res_k1_partition& p = r.partitions.emplace_back();
+  p.partition_index.val = 0;
+  p.error_code.val = 0;
+  p.high_watermark.val = 0;
+  p.last_stable_offset.val = 0;
+  p.log_start_offset.val = 0;
+  p.preferred_read_replica.val = -1;
+  p.records.is_null = false;
+  for (int i = 0; i < 10000; ++i) p.records.emplace_back().val = i;
+  w.clear();
+  len = stream_message(w, &fetch);
+  flat.resize(len);
+  REQUIRE(write_message(flat.data(), &fetch) == len);
+  REQUIRE(gather(w) == flat);
+}
+
+TEST_CASE("Testing buffer pool", "[pool]") {
+  REQUIRE(pooled_buffer(1).capacity == BUFFER_POOL_MIN_SIZE);
+  REQUIRE(pooled_buffer(300).capacity == 512);
+  REQUIRE(pooled_buffer(BUFSIZ).capacity == size_t(BUFSIZ));
+
+  // the last buffer given back is the next one handed out
+  int8_t* first;
+  {
+    pooled_buffer b(1000);
+    first = b.data;
+  }
+  pooled_buffer again(1000);
+  REQUIRE(again.data == first);
+
+  // a size class nothing else uses: one slab serves both threads, as the
+  // first hands its cache back when it exits
+  size_t const size = 64 << 10;
+  int const c = 16 - BUFFER_POOL_MIN_SHIFT;
+  buffer_pool_class_stats before = current_buffer_pool_stats().classes[c];
+  REQUIRE(before.size == size);
+  auto use = [size] { pooled_buffer a(size), b(size); };
+  std::thread(use).join();
+  std::thread(use).join();
+  buffer_pool_class_stats after = current_buffer_pool_stats().classes[c];
+  REQUIRE(after.misses - before.misses == 1);
+  REQUIRE(after.hits - before.hits == 3);
+  REQUIRE(after.in_use == before.in_use);
+  REQUIRE(after.reserved - before.reserved ==
+          BUFFER_POOL_SLAB_SIZE / size);
+
+  // a buffer outliving its thread's cache, as a global's does at exit, is
+  // given back to the central lists
+  std::thread([size] {
+    thread_local pooled_buffer late;
+    late = pooled_buffer(size);
+  }).join();
+  REQUIRE(current_buffer_pool_stats().classes[c].in_use == before.in_use);
+
+  // too big for a class, mapped on its own
+  uint64_t oversize = current_buffer_pool_stats().oversize;
+  {
+    pooled_buffer big(BUFFER_POOL_MAX_SIZE + 1);
+    REQUIRE(big.capacity > BUFFER_POOL_MAX_SIZE);
+    big.data[big.capacity - 1] = 1;
+  }
+  REQUIRE(current_buffer_pool_stats().oversize == oversize + 1);
+}
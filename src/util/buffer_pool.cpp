@@ -0,0 +1,236 @@
+#include "buffer_pool.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <format>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+
+// what a thread keeps per class before spilling half of it back
+size_t const THREAD_CACHE_BYTES = size_t(256) << 10;
+
+size_t class_size(int c) { return BUFFER_POOL_MIN_SIZE << c; }
+
+int size_class(size_t n) {
+  if (n <= BUFFER_POOL_MIN_SIZE) return 0;
+  return std::bit_width(n - 1) - BUFFER_POOL_MIN_SHIFT;
+}
+
+size_t cache_limit(int c) {
+  return std::max<size_t>(1, THREAD_CACHE_BYTES / class_size(c));
+}
+
+struct class_counters {
+  std::atomic<uint64_t> reserved;
+  std::atomic<int64_t> in_use;
+  std::atomic<uint64_t> hits;
+  std::atomic<uint64_t> misses;
+};
+
+struct central_pool {
+  std::mutex mu;
+  std::vector<int8_t *> free[BUFFER_POOL_CLASSES];
+  class_counters counters[BUFFER_POOL_CLASSES];
+  std::atomic<uint64_t> slabs;
+  std::atomic<uint64_t> huge_page_slabs;
+  std::atomic<uint64_t> oversize;
+  std::atomic<bool> huge_pages;
+};
+
+// never destroyed: thread caches hand their buffers back from thread_local
+// destructors, which may run after static destruction has begun
+central_pool &central() {
+  static central_pool *pool = new central_pool;
+  return *pool;
+}
+
+size_t page_size() {
+  static size_t const size = sysconf(_SC_PAGESIZE);
+  return size;
+}
+
+void *map_anonymous(size_t n, int extra_flags) {
+  return mmap(nullptr, n, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | extra_flags, -1, 0);
+}
+
+// a slab aligned to its own size, so transparent huge pages can back it
+int8_t *map_aligned_slab() {
+  size_t n = BUFFER_POOL_SLAB_SIZE;
+  void *p = map_anonymous(2 * n, 0);
+  if (p == MAP_FAILED) throw std::bad_alloc();
+  uintptr_t beg = reinterpret_cast<uintptr_t>(p);
+  uintptr_t aligned = (beg + n - 1) & ~(n - 1);
+  if (aligned > beg) munmap(p, aligned - beg);
+  munmap(reinterpret_cast<void *>(aligned + n), beg + n - aligned);
+  return reinterpret_cast<int8_t *>(aligned);
+}
+
+int8_t *map_slab() {
+  central_pool &pool = central();
+  ++pool.slabs;
+  if (!pool.huge_pages.load(std::memory_order_relaxed)) {
+    void *p = map_anonymous(BUFFER_POOL_SLAB_SIZE, 0);
+    if (p == MAP_FAILED) throw std::bad_alloc();
+    return static_cast<int8_t *>(p);
+  }
+  // fails unless huge pages were reserved with vm.nr_hugepages
+  void *p = map_anonymous(BUFFER_POOL_SLAB_SIZE, MAP_HUGETLB);
+  if (p != MAP_FAILED) {
+    ++pool.huge_page_slabs;
+    return static_cast<int8_t *>(p);
+  }
+  int8_t *slab = map_aligned_slab();
+  if (madvise(slab, BUFFER_POOL_SLAB_SIZE, MADV_HUGEPAGE) == 0)
+    ++pool.huge_page_slabs;
+  return slab;
+}
+
+// moves up to n buffers of class c to out, carving a slab when the central
+// list runs dry; false when it did
+bool take_from_central(int c, size_t n, std::vector<int8_t *> &out) {
+  central_pool &pool = central();
+  std::lock_guard lock(pool.mu);
+  std::vector<int8_t *> &free = pool.free[c];
+  bool hit = !free.empty();
+  if (!hit) {
+    int8_t *slab = map_slab();
+    size_t size = class_size(c), count = BUFFER_POOL_SLAB_SIZE / size;
+    // handed out from the front of the slab first
+    for (size_t i = count; i > 0; --i) free.push_back(slab + (i - 1) * size);
+    pool.counters[c].reserved += count;
+  }
+  for (; n > 0 && !free.empty(); --n) {
+    out.push_back(free.back());
+    free.pop_back();
+  }
+  return hit;
+}
+
+void give_to_central(int c, std::vector<int8_t *> &from, size_t n) {
+  central_pool &pool = central();
+  std::lock_guard lock(pool.mu);
+  for (; n > 0; --n) {
+    pool.free[c].push_back(from.back());
+    from.pop_back();
+  }
+}
+
+// set once the thread's cache is destroyed; what objects destroyed after it
+// acquire or release goes through the central lists
+thread_local bool cache_gone;
+
+struct thread_cache {
+  std::vector<int8_t *> free[BUFFER_POOL_CLASSES];
+
+  thread_cache() {
+    for (int c = 0; c < BUFFER_POOL_CLASSES; ++c)
+      free[c].reserve(cache_limit(c));
+  }
+  ~thread_cache() {
+    for (int c = 0; c < BUFFER_POOL_CLASSES; ++c)
+      if (!free[c].empty()) give_to_central(c, free[c], free[c].size());
+    cache_gone = true;
+  }
+
+  int8_t *acquire(int c) {
+    class_counters &counters = central().counters[c];
+    std::vector<int8_t *> &list = free[c];
+    bool hit = !list.empty() ||
+               take_from_central(c, (cache_limit(c) + 1) / 2, list);
+    (hit ? counters.hits : counters.misses)
+        .fetch_add(1, std::memory_order_relaxed);
+    counters.in_use.fetch_add(1, std::memory_order_relaxed);
+    int8_t *p = list.back();
+    list.pop_back();
+    return p;
+  }
+
+  void release(int c, int8_t *p) {
+    std::vector<int8_t *> &list = free[c];
+    if (list.size() >= cache_limit(c))
+      give_to_central(c, list, (list.size() + 1) / 2);
+    list.push_back(p);
+    central().counters[c].in_use.fetch_sub(1, std::memory_order_relaxed);
+  }
+};
+
+thread_cache &local_cache() {
+  thread_local thread_cache cache;
+  return cache;
+}
+
+}  // namespace
+
+int8_t *pool_acquire(size_t n, size_t &capacity) {
+  if (n > BUFFER_POOL_MAX_SIZE) {
+    capacity = (n + page_size() - 1) & ~(page_size() - 1);
+    void *p = map_anonymous(capacity, 0);
+    if (p == MAP_FAILED) throw std::bad_alloc();
+    central().oversize.fetch_add(1, std::memory_order_relaxed);
+    return static_cast<int8_t *>(p);
+  }
+  int c = size_class(n);
+  capacity = class_size(c);
+  if (cache_gone) {
+    std::vector<int8_t *> one;
+    take_from_central(c, 1, one);
+    central().counters[c].in_use.fetch_add(1, std::memory_order_relaxed);
+    return one.back();
+  }
+  return local_cache().acquire(c);
+}
+
+void pool_release(int8_t *p, size_t capacity) {
+  if (capacity > BUFFER_POOL_MAX_SIZE) {
+    munmap(p, capacity);
+    return;
+  }
+  int c = size_class(capacity);
+  if (cache_gone) {
+    std::vector<int8_t *> one{p};
+    give_to_central(c, one, 1);
+    central().counters[c].in_use.fetch_sub(1, std::memory_order_relaxed);
+    return;
+  }
+  local_cache().release(c, p);
+}
+
+void buffer_pool_use_huge_pages(bool on) {
+  central().huge_pages.store(on, std::memory_order_relaxed);
+}
+
+buffer_pool_stats current_buffer_pool_stats() {
+  central_pool &pool = central();
+  buffer_pool_stats s{};
+  for (int c = 0; c < BUFFER_POOL_CLASSES; ++c) {
+    class_counters &k = pool.counters[c];
+    s.classes[c] = {class_size(c), k.reserved.load(), k.in_use.load(),
+                    k.hits.load(), k.misses.load()};
+  }
+  s.slabs = pool.slabs.load();
+  s.huge_page_slabs = pool.huge_page_slabs.load();
+  s.oversize = pool.oversize.load();
+  return s;
+}
+
+std::string format_buffer_pool_stats(buffer_pool_stats const &s) {
+  std::string out =
+      std::format("buffer pool: {} slabs ({} huge), {} oversize\n", s.slabs,
+                  s.huge_page_slabs, s.oversize);
+  for (buffer_pool_class_stats const &c : s.classes) {
+    if (c.reserved == 0) continue;
+    out += std::format("  {}B: {} in use of {}, {} hits, {} misses\n",
+                       c.size, c.in_use, c.reserved, c.hits, c.misses);
+  }
+  return out;
+}
@@ -0,0 +1,88 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Broker-wide pool of I/O buffers: receive frames, response chunks and disk
+// read buffers. Sizes are rounded up to a power of two between MIN_SIZE and
+// MAX_SIZE; each class is carved out of 2 MiB slabs that are never given back,
+// so buffers are recycled instead of going through malloc. Every thread keeps
+// a small cache per class and only takes the central lock to refill or spill
+// it in batches. Anything above MAX_SIZE is mapped and unmapped on its own.
+
+int const BUFFER_POOL_MIN_SHIFT = 8;
+int const BUFFER_POOL_MAX_SHIFT = 20;
+int const BUFFER_POOL_CLASSES =
+    BUFFER_POOL_MAX_SHIFT - BUFFER_POOL_MIN_SHIFT + 1;
+size_t const BUFFER_POOL_MIN_SIZE = size_t(1) << BUFFER_POOL_MIN_SHIFT;
+size_t const BUFFER_POOL_MAX_SIZE = size_t(1) << BUFFER_POOL_MAX_SHIFT;
+size_t const BUFFER_POOL_SLAB_SIZE = size_t(2) << 20;
+
+// a buffer of at least n bytes; capacity is set to what it really holds
+int8_t *pool_acquire(size_t n, size_t &capacity);
+// gives back a buffer from pool_acquire along with the capacity it came with
+void pool_release(int8_t *p, size_t capacity);
+
+// slabs mapped from now on ask for huge pages: MAP_HUGETLB when the system
+// has them reserved, transparent huge pages otherwise
+void buffer_pool_use_huge_pages(bool on);
+
+struct buffer_pool_class_stats {
+  size_t size;
+  // buffers carved from slabs, and how many of them are handed out
+  uint64_t reserved;
+  int64_t in_use;
+  // acquires served from a free list, and those that needed a new slab
+  uint64_t hits;
+  uint64_t misses;
+};
+
+struct buffer_pool_stats {
+  std::array<buffer_pool_class_stats, BUFFER_POOL_CLASSES> classes;
+  uint64_t slabs;
+  uint64_t huge_page_slabs;
+  // buffers above MAX_SIZE, mapped on their own
+  uint64_t oversize;
+};
+
+buffer_pool_stats current_buffer_pool_stats();
+// one line per class in use, for the log
+std::string format_buffer_pool_stats(buffer_pool_stats const &s);
+
+// owns one pooled buffer
+struct pooled_buffer {
+  int8_t *data{};
+  size_t capacity{};
+
+  pooled_buffer() = default;
+  explicit pooled_buffer(size_t n) { data = pool_acquire(n, capacity); }
+  pooled_buffer(pooled_buffer &&o) noexcept
+      : data(o.data), capacity(o.capacity) {
+    o.data = nullptr;
+    o.capacity = 0;
+  }
+  pooled_buffer &operator=(pooled_buffer &&o) noexcept {
+    if (this != &o) {
+      reset();
+      data = o.data;
+      capacity = o.capacity;
+      o.data = nullptr;
+      o.capacity = 0;
+    }
+    return *this;
+  }
+  pooled_buffer(pooled_buffer const &) = delete;
+  pooled_buffer &operator=(pooled_buffer const &) = delete;
+  ~pooled_buffer() { reset(); }
+
+  void reset() {
+    if (data) pool_release(data, capacity);
+    data = nullptr;
+    capacity = 0;
+  }
+};
+
+#endif
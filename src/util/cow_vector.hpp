@@ -0,0 +1,79 @@
+#ifndef COW_VECTOR_H
+#define COW_VECTOR_H
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// A vector whose copies share its elements in chunks of CHUNK: copying it
+// copies a pointer per chunk, and the first write to a chunk another copy
+// still holds copies that chunk alone. Meant for tables published as
+// immutable versions, where the next version is a copy of the last one with
+// a few rows changed. Elements are only contiguous within a chunk, so there
+// are no spans over it.
+//
+// Copies may be read from other threads while this one is written to; a
+// chunk is written in place only when no other copy holds it.
+template <typename T>
+struct cow_vector {
+  static constexpr size_t CHUNK_SHIFT = 12;
+  static constexpr size_t CHUNK = size_t(1) << CHUNK_SHIFT;
+
+  std::vector<std::shared_ptr<std::vector<T>>> chunks;
+  size_t count{};
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  T const &operator[](size_t i) const {
+    return (*chunks[i >> CHUNK_SHIFT])[i & (CHUNK - 1)];
+  }
+  T const &back() const { return (*this)[count - 1]; }
+
+  // element i, for writing
+  T &mut(size_t i) { return own(i >> CHUNK_SHIFT)[i & (CHUNK - 1)]; }
+
+  template <typename... Args>
+  T &emplace_back(Args &&...args) {
+    if (count % CHUNK == 0) {
+      chunks.push_back(std::make_shared<std::vector<T>>());
+      chunks.back()->reserve(CHUNK);
+    }
+    ++count;
+    return own(chunks.size() - 1).emplace_back(std::forward<Args>(args)...);
+  }
+  void push_back(T v) { emplace_back(std::move(v)); }
+
+  void resize(size_t n, T const &v = T()) {
+    while (count > n) pop_back();
+    while (count < n) emplace_back(v);
+  }
+  void assign(size_t n, T const &v) {
+    clear();
+    resize(n, v);
+  }
+  void clear() {
+    chunks.clear();
+    count = 0;
+  }
+
+ private:
+  void pop_back() {
+    own(chunks.size() - 1).pop_back();
+    if (--count % CHUNK == 0) chunks.pop_back();
+  }
+
+  std::vector<T> &own(size_t c) {
+    // use_count() only falls below 2 once no other copy holds the chunk
+    if (chunks[c].use_count() > 1) {
+      auto copy = std::make_shared<std::vector<T>>();
+      copy->reserve(CHUNK);
+      copy->assign(chunks[c]->begin(), chunks[c]->end());
+      chunks[c] = std::move(copy);
+    }
+    return *chunks[c];
+  }
+};
+
+#endif
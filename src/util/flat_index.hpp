@@ -0,0 +1,128 @@
+#ifndef FLAT_INDEX_H
+#define FLAT_INDEX_H
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <string_view>
+
+#include "cow_vector.hpp"
+
+// Open-addressing hash index from a 64-bit hash to a uint32_t value, for
+// tables that keep their keys elsewhere: the caller passes the key's hash
+// and a predicate telling whether a value's key is the one looked for.
+// Linear probing over one flat array, at most 7/8 full, so a lookup touches
+// one or two cache lines. Removal shifts the entries after the hole back, so
+// no tombstones build up. The array is a cow_vector: a copy of the index
+// shares it until either side writes to it.
+struct flat_index {
+  static constexpr uint32_t EMPTY = UINT32_MAX;
+
+  struct slot {
+    uint64_t hash;
+    uint32_t value{EMPTY};
+  };
+
+  cow_vector<slot> slots;
+  size_t used{};
+
+  // the value whose key matches, EMPTY when there is none
+  template <typename Eq>
+  uint32_t find(uint64_t hash, Eq &&eq) const {
+    if (slots.empty()) return EMPTY;
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+      slot const &s = slots[i];
+      if (s.value == EMPTY) return EMPTY;
+      if (s.hash == hash && eq(s.value)) return s.value;
+    }
+  }
+
+  // adds value under hash, or replaces the value whose key matches
+  template <typename Eq>
+  void insert(uint64_t hash, uint32_t value, Eq &&eq) {
+    if ((used + 1) * 8 > slots.size() * 7) grow();
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+      slot const &s = slots[i];
+      if (s.value == EMPTY) {
+        slots.mut(i) = {hash, value};
+        ++used;
+        return;
+      }
+      if (s.hash == hash && eq(s.value)) {
+        slots.mut(i).value = value;
+        return;
+      }
+    }
+  }
+
+  // removes the value whose key matches, if any
+  template <typename Eq>
+  void erase(uint64_t hash, Eq &&eq) {
+    if (slots.empty()) return;
+    size_t mask = slots.size() - 1;
+    size_t hole = hash & mask;
+    for (;; hole = (hole + 1) & mask) {
+      slot const &s = slots[hole];
+      if (s.value == EMPTY) return;
+      if (s.hash == hash && eq(s.value)) break;
+    }
+    // an entry can fill the hole unless its home is cyclically in (hole, i]
+    for (size_t i = (hole + 1) & mask;; i = (i + 1) & mask) {
+      slot s = slots[i];
+      if (s.value == EMPTY) break;
+      size_t home = s.hash & mask;
+      if (((i - home) & mask) >= ((i - hole) & mask)) {
+        slots.mut(hole) = s;
+        hole = i;
+      }
+    }
+    slots.mut(hole) = slot{};
+    --used;
+  }
+
+  void clear() {
+    slots.clear();
+    used = 0;
+  }
+
+  void grow() {
+    cow_vector<slot> old;
+    std::swap(old, slots);
+    slots.resize(old.empty() ? 16 : 2 * old.size());
+    size_t mask = slots.size() - 1;
+    for (size_t j = 0; j < old.size(); ++j) {
+      slot const &s = old[j];
+      if (s.value == EMPTY) continue;
+      size_t i = s.hash & mask;
+      while (slots[i].value != EMPTY) i = (i + 1) & mask;
+      slots.mut(i) = s;
+    }
+  }
+};
+
+// spreads the bits of x over the whole word, so that the low bits the index
+// probes with depend on all of them
+inline uint64_t mix_hash(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+inline uint64_t hash_bytes(void const *p, size_t n) {
+  // FNV-1a, then mixed; keys here are short
+  uint64_t h = 0xcbf29ce484222325ULL;
+  auto const *b = static_cast<unsigned char const *>(p);
+  for (size_t i = 0; i < n; ++i) h = (h ^ b[i]) * 0x100000001b3ULL;
+  return mix_hash(h);
+}
+
+inline uint64_t hash_bytes(std::string_view s) {
+  return hash_bytes(s.data(), s.size());
+}
+
+#endif
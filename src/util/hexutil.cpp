@@ -1,44 +1,52 @@
 #include "hexutil.hpp"
 
 #include <cstdint>
-#include <iomanip>
 #include <iostream>
-#include <sstream>
+#include <span>
 #include <string>
+#include <string_view>
 
-int tobuf(std::string const & hexstr, int8_t *beg, size_t len) {
-  if (len < hexstr.size() - 2) return -1;
-  std::istringstream ss(hexstr);
-  ss.ignore(2);
-
-  char inp[2]{};
-  size_t pos{};
-  int8_t first, second;
-
-  while (ss.read(inp, 2)) {
-    TRANS(inp[0], first);
-    TRANS(inp[1], second);
-    beg[pos++] = first << 4 | second;
+int hex_encode(std::span<int8_t const> src, std::span<char> dst) {
+  if (dst.size() < 2 * src.size()) return -1;
+  char *out = dst.data();
+  for (int8_t b : src) {
+    char const *pair = HEX_PAIRS.val[static_cast<uint8_t>(b)];
+    out[0] = pair[0];
+    out[1] = pair[1];
+    out += 2;
   }
-  return pos;
+  return 2 * src.size();
 }
 
-std::string tohex(int8_t *beg, size_t len) {
-  std::ostringstream ss;
-  ss << "0x" << std::hex;
-  for (size_t i = 0; i < len; ++i) {
-    ss << std::setw(2) << std::setfill('0')
-       << static_cast<int>(static_cast<uint8_t>(beg[i]));
+int hex_decode(std::string_view hex, std::span<int8_t> dst) {
+  if (hex.size() % 2 != 0 || dst.size() < hex.size() / 2) return -1;
+  size_t n = hex.size() / 2;
+  // invalid characters map to 0xff; collect them and check once at the end
+  // instead of branching per byte
+  uint8_t bad{};
+  for (size_t i = 0; i < n; ++i) {
+    uint8_t hi = HEX_VALUES[hex[2 * i]], lo = HEX_VALUES[hex[2 * i + 1]];
+    bad |= hi | lo;
+    dst[i] = static_cast<int8_t>(hi << 4 | (lo & 0xf));
   }
-  return ss.str();
+  return bad & 0xf0 ? -1 : static_cast<int>(n);
+}
+
+std::string tohex(int8_t const *beg, size_t len) {
+  std::string s(2 + 2 * len, '0');
+  s[1] = 'x';
+  hex_encode(std::span<int8_t const>(beg, len), std::span<char>(s).subspan(2));
+  return s;
+}
+
+int tobuf(std::string_view hexstr, int8_t *beg, size_t len) {
+  if (hexstr.starts_with("0x") || hexstr.starts_with("0X"))
+    hexstr.remove_prefix(2);
+  return hex_decode(hexstr, std::span<int8_t>(beg, len));
 }
 
 int readbyte(std::istream &is, int8_t *out) {
   char c[2];
   if (!is.read(c, 2)) return -1;
-  int8_t first, second;
-  TRANS(c[0], first);
-  TRANS(c[1], second);
-  *out = first << 4 | second;
-  return 1;
+  return hex_decode(std::string_view(c, 2), std::span<int8_t>(out, 1));
 }
@@ -4,63 +4,54 @@
 #include <cstddef>
 #include <cstdint>
 #include <istream>
+#include <span>
 #include <string>
+#include <string_view>
 
-#define TRANS(SRC, DST) \
-  switch (SRC) {        \
-    case '0':           \
-      DST = 0;          \
-      break;            \
-    case '1':           \
-      DST = 1;          \
-      break;            \
-    case '2':           \
-      DST = 2;          \
-      break;            \
-    case '3':           \
-      DST = 3;          \
-      break;            \
-    case '4':           \
-      DST = 4;          \
-      break;            \
-    case '5':           \
-      DST = 5;          \
-      break;            \
-    case '6':           \
-      DST = 6;          \
-      break;            \
-    case '7':           \
-      DST = 7;          \
-      break;            \
-    case '8':           \
-      DST = 8;          \
-      break;            \
-    case '9':           \
-      DST = 9;          \
-      break;            \
-    case 'a':           \
-      DST = 10;         \
-      break;            \
-    case 'b':           \
-      DST = 11;         \
-      break;            \
-    case 'c':           \
-      DST = 12;         \
-      break;            \
-    case 'd':           \
-      DST = 13;         \
-      break;            \
-    case 'e':           \
-      DST = 14;         \
-      break;            \
-    case 'f':           \
-      DST = 15;         \
-      break;            \
+// lower-case digit for each nibble, and the nibble for each hex character
+// (0xff for anything that is not a hex digit)
+inline constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+inline constexpr struct hex_value_table {
+  uint8_t val[256];
+  constexpr hex_value_table() : val{} {
+    for (int c = 0; c < 256; ++c) val[c] = 0xff;
+    for (int c = 0; c < 10; ++c) val['0' + c] = c;
+    for (int c = 0; c < 6; ++c) {
+      val['a' + c] = 10 + c;
+      val['A' + c] = 10 + c;
+    }
+  }
+  constexpr uint8_t operator[](char c) const {
+    return val[static_cast<uint8_t>(c)];
+  }
+} HEX_VALUES;
+
+// both digits of every byte, so encoding is one table load per byte
+inline constexpr struct hex_pair_table {
+  char val[256][2];
+  constexpr hex_pair_table() : val{} {
+    for (int b = 0; b < 256; ++b) {
+      val[b][0] = HEX_DIGITS[b >> 4];
+      val[b][1] = HEX_DIGITS[b & 0xf];
+    }
   }
+} HEX_PAIRS;
+
+// writes 2 * src.size() lower-case digits to dst; returns how many, or -1 when
+// dst is too short
+int hex_encode(std::span<int8_t const> src, std::span<char> dst);
+
+// decodes upper- or lower-case digits into dst; returns the number of bytes,
+// or -1 when hex has odd length, a character that is not a hex digit, or
+// does not fit in dst
+int hex_decode(std::string_view hex, std::span<int8_t> dst);
 
-std::string tohex(int8_t *beg, size_t len);
+// "0x"-prefixed dump, mostly for logs and tests
+std::string tohex(int8_t const *beg, size_t len);
 
-int tobuf(std::string const &hexstr, int8_t *beg, size_t len);
+// decodes hexstr, "0x" prefix optional; same result as hex_decode
+int tobuf(std::string_view hexstr, int8_t *beg, size_t len);
 
 int readbyte(std::istream &is, int8_t *out);
 
@@ -0,0 +1,71 @@
+#ifndef UUID_H
+#define UUID_H
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "hexutil.hpp"
+
+// plain 16-byte uuid, cheap to copy, compare and hash so it can key the
+// topic maps directly instead of its 36-character string form
+struct uuid128 {
+  static constexpr size_t STR_LEN = 36;
+
+  uint8_t bytes[16]{};
+
+  // canonical 8-4-4-4-12 form; leaves out untouched and returns false on
+  // malformed input
+  static bool parse(std::string_view s, uuid128& out) {
+    if (s.size() != STR_LEN || s[8] != '-' || s[13] != '-' || s[18] != '-' ||
+        s[23] != '-')
+      return false;
+    uuid128 tmp;
+    size_t pos{};
+    for (int i = 0; i < 16; ++i) {
+      if (pos == 8 || pos == 13 || pos == 18 || pos == 23) ++pos;
+      uint8_t hi = HEX_VALUES[s[pos]], lo = HEX_VALUES[s[pos + 1]];
+      if ((hi | lo) & 0xf0) return false;
+      tmp.bytes[i] = hi << 4 | lo;
+      pos += 2;
+    }
+    out = tmp;
+    return true;
+  }
+
+  // writes exactly STR_LEN characters, no terminator
+  void format(char* out) const {
+    for (int i = 0; i < 16; ++i) {
+      if (i == 4 || i == 6 || i == 8 || i == 10) *out++ = '-';
+      *out++ = HEX_DIGITS[bytes[i] >> 4];
+      *out++ = HEX_DIGITS[bytes[i] & 0xf];
+    }
+  }
+
+  std::string str() const {
+    std::string s(STR_LEN, '\0');
+    format(s.data());
+    return s;
+  }
+
+  friend bool operator==(uuid128 const&, uuid128 const&) = default;
+  friend std::strong_ordering operator<=>(uuid128 const&,
+                                          uuid128 const&) = default;
+};
+
+template <>
+struct std::hash<uuid128> {
+  size_t operator()(uuid128 const& u) const noexcept {
+    uint64_t hi, lo;
+    std::memcpy(&hi, u.bytes, sizeof(hi));
+    std::memcpy(&lo, u.bytes + sizeof(hi), sizeof(lo));
+    // uuids are mostly random already, one multiply spreads the rest
+    return (hi ^ (lo * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL;
+  }
+};
+
+#endif